@@ -0,0 +1,97 @@
+#include "activity_heatmap.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <cmath>
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+// one cell of the map per 8x8 pixels of the frame.
+static const int grid_step = 8;
+// a gap longer than this (paused, reconfigured) counts as one frame.
+static const qint64 max_gap_ms = 1000;
+
+activity_heatmap::activity_heatmap()
+{
+
+}
+
+void activity_heatmap::setHalfLife(double seconds)
+{
+    half_life_s = std::max(1.0, seconds);
+}
+
+void activity_heatmap::clear()
+{
+    heat.release();
+    last_ms = 0;
+}
+
+void activity_heatmap::update(const cv::Mat &fg_mask, qint64 now_ms)
+{
+    if (fg_mask.empty())
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    cv::Size grid((fg_mask.cols + grid_step - 1) / grid_step, (fg_mask.rows + grid_step - 1) / grid_step);
+    if (heat.size() != grid)
+    {
+        heat = cv::Mat::zeros(grid, CV_32F);
+        last_ms = now_ms;
+    }
+
+    // the weight of this frame, so the map halves every half_life_s without activity.
+    qint64 gap_ms = std::min(std::max(now_ms - last_ms, qint64(1)), max_gap_ms);
+    last_ms = now_ms;
+    double alpha = 1 - std::pow(0.5, gap_ms / 1000.0 / half_life_s);
+
+    cv::resize(fg_mask, small, grid, 0, 0, cv::INTER_AREA);
+    cv::accumulateWeighted(small, heat, alpha);
+
+    double update_us = timer.nsecsElapsed() / 1e3;
+    QMutexLocker locker(&stats_lock);
+    updates++;
+    update_us_total += update_us;
+    update_us_max = std::max(update_us_max, update_us);
+}
+
+void activity_heatmap::render(const cv::Mat &background, cv::Mat &rgb)
+{
+    if (heat.empty())
+    {
+        rgb.release();
+        return;
+    }
+
+    // scaled to the busiest cell, a quiet camera still shows where it moved.
+    double max_heat = 0;
+    cv::minMaxLoc(heat, nullptr, &max_heat);
+    cv::Mat levels, colored;
+    heat.convertTo(levels, CV_8U, max_heat > 0 ? 255 / max_heat : 0);
+
+    cv::Size size = background.empty() ? heat.size() : background.size();
+    cv::resize(levels, levels, size, 0, 0, cv::INTER_LINEAR);
+    cv::applyColorMap(levels, colored, cv::COLORMAP_JET);
+
+    // half and half over a grey background, the heat alone has no landmarks.
+    if (!background.empty())
+    {
+        cv::Mat gray;
+        cv::cvtColor(background, gray, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(gray, gray, cv::COLOR_GRAY2BGR);
+        cv::addWeighted(colored, 0.5, gray, 0.5, 0, colored);
+    }
+    cv::cvtColor(colored, rgb, cv::COLOR_BGR2RGB);
+}
+
+QString activity_heatmap::statsReport()
+{
+    QMutexLocker locker(&stats_lock);
+    if (updates == 0)
+        return QString("heatmap : off\n");
+    return QString("heatmap : %1x%2 cells, half life %3 s, %4 updates, %5 us/frame (max %6)\n")
+            .arg(heat.cols).arg(heat.rows).arg(half_life_s, 0, 'f', 0).arg(updates)
+            .arg(update_us_total / updates, 0, 'f', 0)
+            .arg(update_us_max, 0, 'f', 0);
+}
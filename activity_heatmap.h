@@ -0,0 +1,45 @@
+#ifndef ACTIVITY_HEATMAP_H
+#define ACTIVITY_HEATMAP_H
+
+#include <QString>
+#include <QMutex>
+#include <opencv2/core.hpp>
+
+/*
+ * where a camera saw activity over the last hours.
+ *
+ * update() shrinks the foreground mask to an 1/8 grid by area averaging
+ * and adds it with cv::accumulateWeighted, the weight follows from the
+ * time since the last frame and the half life, so the map is an
+ * exponential moving average that needs no history and costs a few
+ * thousand cells per frame. render() colours the map over the background
+ * image, only when someone looks at it.
+ */
+class activity_heatmap
+{
+public:
+    activity_heatmap();
+
+    void setHalfLife(double seconds);
+    void update(const cv::Mat &fg_mask, qint64 now_ms);
+    void clear();
+
+    // RGB, the size of background or of the grid when it is empty.
+    void render(const cv::Mat &background, cv::Mat &rgb);
+
+    QString statsReport();
+
+private:
+    double half_life_s=600;
+    cv::Mat heat;                   // CV_32F, 0..255
+    cv::Mat small;
+    qint64 last_ms=0;
+
+    // metrics, read from the gui thread
+    QMutex stats_lock;
+    qint64 updates=0;
+    double update_us_total=0;
+    double update_us_max=0;
+};
+
+#endif // ACTIVITY_HEATMAP_H
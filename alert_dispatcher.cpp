@@ -0,0 +1,460 @@
+#include "alert_dispatcher.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QProcess>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+#include "thread_tuning.h"
+
+alert_dispatcher *alert_dispatcher::current = nullptr;
+
+QByteArray alert_sink::batchToJson(QString camname, const QList<alert_event> &batch)
+{
+    QJsonArray events;
+    foreach(alert_event event, batch)
+    {
+        QJsonObject json_event;
+        json_event["time"] = event.time.toString(Qt::ISODateWithMs);
+        json_event["message"] = event.message;
+        events.append(json_event);
+    }
+
+    QJsonObject json;
+    json["camera"] = camname;
+    json["events"] = events;
+    return QJsonDocument(json).toJson(QJsonDocument::Compact);
+}
+
+void alert_sink::cancel(bool cancel){cancelled.store(cancel ? 1 : 0);}
+
+bool alert_sink::isCancelled(){return cancelled.load() != 0;}
+
+//------------------------
+// webhook
+//------------------------
+
+webhook_sink::webhook_sink(QString url, double timeout_s):
+    url(url), timeout_ms(timeout_s * 1000)
+{
+
+}
+
+QString webhook_sink::name(){return "webhook " + url;}
+
+bool webhook_sink::deliver(QString camname, const QList<alert_event> &batch, QString &error)
+{
+    // the dispatcher thread has no event loop of its own, run one per request.
+    QNetworkAccessManager manager;
+    QNetworkRequest request((QUrl(url)));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+    QNetworkReply *reply = manager.post(request, batchToJson(camname, batch));
+
+    QEventLoop loop;
+    QTimer timer;
+    timer.setSingleShot(true);
+    QTimer poll;
+    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+    QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+    QObject::connect(&poll, &QTimer::timeout, [&](){
+        if (isCancelled())
+            loop.quit();
+    });
+    timer.start(timeout_ms);
+    poll.start(poll_ms);
+    loop.exec();
+
+    if (!reply->isFinished())
+    {
+        reply->abort();
+        delete reply;
+        error = isCancelled() ? "webhook cancelled" : "webhook timed out";
+        return false;
+    }
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool ok = reply->error() == QNetworkReply::NoError && status >= 200 && status < 300;
+    if (!ok)
+        error = QString("webhook : %1 (http %2)").arg(reply->errorString()).arg(status);
+    delete reply;
+    return ok;
+}
+
+//------------------------
+// mqtt
+//------------------------
+
+mqtt_sink::mqtt_sink(QString host, int port, QString topic, double timeout_s):
+    host(host), port(port), topic(topic), timeout_ms(timeout_s * 1000)
+{
+
+}
+
+QString mqtt_sink::name(){return QString("mqtt %1:%2/%3").arg(host).arg(port).arg(topic);}
+
+QByteArray mqtt_sink::utf8String(QString text)
+{
+    QByteArray utf8 = text.toUtf8();
+    QByteArray out;
+    out += char((utf8.size() >> 8) & 0xFF);
+    out += char(utf8.size() & 0xFF);
+    return out + utf8;
+}
+
+QByteArray mqtt_sink::packet(quint8 type, const QByteArray &body)
+{
+    // fixed header : type, then the remaining length as a varint.
+    QByteArray out;
+    out += char(type);
+    int length = body.size();
+    do
+    {
+        quint8 digit = length % 128;
+        length /= 128;
+        if (length > 0)
+            digit |= 0x80;
+        out += char(digit);
+    } while (length > 0);
+    return out + body;
+}
+
+bool mqtt_sink::deliver(QString camname, const QList<alert_event> &batch, QString &error)
+{
+    QTcpSocket socket;
+    QElapsedTimer waited;
+    waited.start();
+    socket.connectToHost(host, port);
+    while (socket.state() != QAbstractSocket::ConnectedState)
+    {
+        if (isCancelled() || waited.elapsed() >= timeout_ms || socket.state() == QAbstractSocket::UnconnectedState)
+        {
+            error = isCancelled() ? "mqtt cancelled" : "mqtt : " + socket.errorString();
+            return false;
+        }
+        socket.waitForConnected(poll_ms);
+    }
+
+    // CONNECT : protocol "MQTT" level 4, clean session, 60 s keep alive.
+    QByteArray connect_body = utf8String("MQTT");
+    connect_body += char(4);
+    connect_body += char(0x02);
+    connect_body += char(0);
+    connect_body += char(60);
+    connect_body += utf8String(QString("software-%1").arg(QCoreApplication::applicationPid()));
+    socket.write(packet(0x10, connect_body));
+
+    // CONNACK : 0x20 0x02 flags return_code
+    waited.restart();
+    while (socket.bytesAvailable() < 4 && !isCancelled() && waited.elapsed() < timeout_ms &&
+           socket.state() == QAbstractSocket::ConnectedState)
+        socket.waitForReadyRead(poll_ms);
+    if (isCancelled())
+    {
+        error = "mqtt cancelled";
+        return false;
+    }
+    QByteArray connack = socket.read(4);
+    if (connack.size() < 4 || quint8(connack.at(0)) != 0x20 || connack.at(3) != 0)
+    {
+        error = "mqtt : connection refused by broker";
+        return false;
+    }
+
+    // PUBLISH at QoS 0, then DISCONNECT.
+    socket.write(packet(0x30, utf8String(topic) + batchToJson(camname, batch)));
+    socket.write(packet(0xE0, QByteArray()));
+    waited.restart();
+    while (socket.bytesToWrite() > 0)
+    {
+        if (isCancelled() || waited.elapsed() >= timeout_ms || socket.state() != QAbstractSocket::ConnectedState)
+        {
+            error = isCancelled() ? "mqtt cancelled" : "mqtt : " + socket.errorString();
+            return false;
+        }
+        socket.waitForBytesWritten(poll_ms);
+    }
+    socket.disconnectFromHost();
+    return true;
+}
+
+//------------------------
+// local script
+//------------------------
+
+script_sink::script_sink(QString program, double timeout_s):
+    program(program), timeout_ms(timeout_s * 1000)
+{
+
+}
+
+QString script_sink::name(){return "script " + program;}
+
+bool script_sink::deliver(QString camname, const QList<alert_event> &batch, QString &error)
+{
+    QProcess process;
+    process.start(program, QStringList({camname, QString::number(batch.size())}));
+    if (!process.waitForStarted(timeout_ms))
+    {
+        error = "script : " + process.errorString();
+        return false;
+    }
+
+    process.write(batchToJson(camname, batch));
+    process.closeWriteChannel();
+    QElapsedTimer waited;
+    waited.start();
+    while (process.state() != QProcess::NotRunning)
+    {
+        if (isCancelled() || waited.elapsed() >= timeout_ms)
+        {
+            process.kill();
+            process.waitForFinished();
+            error = isCancelled() ? "script cancelled" : "script timed out";
+            return false;
+        }
+        process.waitForFinished(poll_ms);
+    }
+
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+    {
+        error = QString("script exited with %1").arg(process.exitCode());
+        return false;
+    }
+    return true;
+}
+
+//------------------------
+// dispatcher
+//------------------------
+
+alert_dispatcher::alert_dispatcher()
+{
+    // set before start() so an early setRunning(false) is never lost.
+    running = true;
+    clock.start();
+    current = this;
+}
+
+alert_dispatcher::~alert_dispatcher()
+{
+    if (current == this)
+        current = nullptr;
+    qDeleteAll(sinks);
+}
+
+alert_dispatcher *alert_dispatcher::instance(){return current;}
+
+void alert_dispatcher::setRunning(bool run)
+{
+    // stopping also ends a delivery that is in progress.
+    lock.lock();
+    running = run;
+    foreach(alert_sink *sink, sinks)
+        sink->cancel(!run);
+    wake.wakeAll();
+    lock.unlock();
+}
+
+void alert_dispatcher::setConfig(alert_config new_config)
+{
+    // an unchanged config keeps the sinks and their pending retries.
+    lock.lock();
+    if (config.toJson() != new_config.toJson())
+    {
+        config = new_config;
+        sinks_dirty = true;
+    }
+    lock.unlock();
+}
+
+void alert_dispatcher::enqueue(QString camname, QString message)
+{
+    alert_event event;
+    event.camname = camname;
+    event.message = message;
+    event.time = QDateTime::currentDateTime();
+
+    lock.lock();
+    event.enqueued_ms = clock.elapsed();
+    QList<alert_event> &queue = queues[camname];
+    queue.append(event);
+    if (queue.size() > config.max_queue)
+    {
+        queue.removeFirst();
+        dropped++;
+    }
+    enqueued++;
+    wake.wakeOne();
+    lock.unlock();
+}
+
+void alert_dispatcher::rebuildSinks()
+{
+    // pending deliveries point at the old sinks.
+    foreach(delivery item, deliveries)
+        dropped += item.batch.size();
+    deliveries.clear();
+    qDeleteAll(sinks);
+    sinks.clear();
+
+    if (!config.webhook_url.isEmpty())
+        sinks.append(new webhook_sink(config.webhook_url, config.timeout_s));
+    if (!config.mqtt_host.isEmpty())
+        sinks.append(new mqtt_sink(config.mqtt_host, config.mqtt_port, config.mqtt_topic, config.timeout_s));
+    if (!config.script.isEmpty())
+        sinks.append(new script_sink(config.script, config.timeout_s));
+    sinks_dirty = false;
+}
+
+void alert_dispatcher::takeBatches(qint64 now_ms)
+{
+    foreach(QString camname, queues.keys())
+    {
+        QList<alert_event> &queue = queues[camname];
+        if (queue.isEmpty())
+            continue;
+
+        // rate limit : one batch per camera and interval.
+        if (last_sent_ms.contains(camname) && now_ms - last_sent_ms.value(camname) < config.min_interval_s * 1000)
+            continue;
+
+        QList<alert_event> batch = queue.mid(0, config.max_batch);
+        queue.erase(queue.begin(), queue.begin() + batch.size());
+        last_sent_ms[camname] = now_ms;
+
+        if (sinks.isEmpty())
+        {
+            dropped += batch.size();
+            continue;
+        }
+
+        for (int i=0; i<sinks.size(); i++)
+        {
+            delivery item;
+            item.sink = i;
+            item.camname = camname;
+            item.batch = batch;
+            item.next_try_ms = now_ms;
+            deliveries.append(item);
+        }
+    }
+}
+
+void alert_dispatcher::deliver(delivery &item, qint64 now_ms)
+{
+    QString error;
+    item.attempts++;
+    bool ok = sinks.at(item.sink)->deliver(item.camname, item.batch, error);
+    qint64 done_ms = clock.elapsed();
+
+    QMutexLocker locker(&lock);
+
+    // cut short by a stop, that does not count as an attempt.
+    if (!ok && !running)
+    {
+        item.attempts--;
+        return;
+    }
+
+    if (ok)
+    {
+        double latency_ms = done_ms - item.batch.first().enqueued_ms;
+        latency_ms_total += latency_ms;
+        latency_ms_max = qMax(latency_ms_max, latency_ms);
+        delivered += item.batch.size();
+        delivered_batches++;
+        item.next_try_ms = -1;
+        return;
+    }
+
+    last_error = error;
+    if (item.attempts >= config.max_attempts)
+    {
+        qDebug() << "alert dropped after retries : " << error;
+        failed += item.batch.size();
+        item.next_try_ms = -1;
+        return;
+    }
+
+    // back off 1 s, 2 s, 4 s ... up to a minute, the shift stays small
+    // whatever max_attempts is.
+    item.next_try_ms = now_ms + qMin(1000LL << qMin(item.attempts - 1, 6), 60000LL);
+    retried++;
+}
+
+void alert_dispatcher::run()
+{
+    thread_tuning::registerThread("io", "alerts");
+    while (true)
+    {
+        lock.lock();
+        if (!running)
+        {
+            lock.unlock();
+            break;
+        }
+        if (sinks_dirty)
+            rebuildSinks();
+        qint64 now_ms = clock.elapsed();
+        takeBatches(now_ms);
+        lock.unlock();
+
+        // network and process calls happen outside the lock.
+        for (int i=0; i<deliveries.size(); i++)
+        {
+            lock.lock();
+            bool stop = !running;
+            lock.unlock();
+            if (stop)
+                break;
+
+            if (deliveries[i].next_try_ms <= now_ms)
+                deliver(deliveries[i], now_ms);
+        }
+
+        lock.lock();
+        for (int i=deliveries.size()-1; i>=0; i--)
+        {
+            if (deliveries.at(i).next_try_ms < 0)
+                deliveries.removeAt(i);
+        }
+        pending_deliveries = deliveries.size();
+        if (running)
+            wake.wait(&lock, 250);
+        lock.unlock();
+    }
+
+    thread_tuning::unregisterThread();
+    qDebug() << "alert dispatcher stopped.";
+}
+
+QString alert_dispatcher::statsReport()
+{
+    QMutexLocker locker(&lock);
+
+    int queue_depth = 0;
+    foreach(QList<alert_event> queue, queues)
+        queue_depth += queue.size();
+
+    QString report = QString("alerts : %1 sinks, %2 queued, %3 pending deliveries\n")
+            .arg(sinks.size()).arg(queue_depth).arg(pending_deliveries);
+    report += QString("  %1 enqueued, %2 delivered, %3 retried, %4 failed, %5 dropped\n")
+            .arg(enqueued).arg(delivered).arg(retried).arg(failed).arg(dropped);
+
+    report += QString("  latency avg %1 ms, max %2 ms\n")
+            .arg(delivered_batches ? latency_ms_total / delivered_batches : 0.0, 0, 'f', 0)
+            .arg(latency_ms_max, 0, 'f', 0);
+    foreach(alert_sink *sink, sinks)
+        report += "  - " + sink->name() + "\n";
+    if (!last_error.isEmpty())
+        report += "  last error : " + last_error + "\n";
+    return report;
+}
@@ -0,0 +1,160 @@
+#ifndef ALERT_DISPATCHER_H
+#define ALERT_DISPATCHER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <QList>
+#include <QMap>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <QAtomicInt>
+#include "pipeline_config.h"
+
+struct alert_event
+{
+    QString camname;
+    QString message;
+    QDateTime time;
+    qint64 enqueued_ms;         // on the dispatcher clock, for latency
+};
+
+/*
+ * a place alerts are delivered to. deliver() runs on the dispatcher
+ * thread and may block up to the configured timeout, it waits in short
+ * slices so cancel() from any thread ends it early.
+ */
+class alert_sink
+{
+public:
+    virtual ~alert_sink(){}
+    virtual QString name() = 0;
+    virtual bool deliver(QString camname, const QList<alert_event> &batch, QString &error) = 0;
+
+    void cancel(bool cancel=true);
+
+    static QByteArray batchToJson(QString camname, const QList<alert_event> &batch);
+
+protected:
+    bool isCancelled();
+
+    static const int poll_ms = 100;
+
+private:
+    QAtomicInt cancelled;
+};
+
+class webhook_sink : public alert_sink
+{
+public:
+    webhook_sink(QString url, double timeout_s);
+    QString name() override;
+    bool deliver(QString camname, const QList<alert_event> &batch, QString &error) override;
+
+private:
+    QString url;
+    int timeout_ms;
+};
+
+// minimal MQTT 3.1.1 client : connect, QoS 0 publish, disconnect.
+class mqtt_sink : public alert_sink
+{
+public:
+    mqtt_sink(QString host, int port, QString topic, double timeout_s);
+    QString name() override;
+    bool deliver(QString camname, const QList<alert_event> &batch, QString &error) override;
+
+private:
+    static QByteArray packet(quint8 type, const QByteArray &body);
+    static QByteArray utf8String(QString text);
+
+    QString host;
+    int port;
+    QString topic;
+    int timeout_ms;
+};
+
+class script_sink : public alert_sink
+{
+public:
+    script_sink(QString program, double timeout_s);
+    QString name() override;
+    bool deliver(QString camname, const QList<alert_event> &batch, QString &error) override;
+
+private:
+    QString program;
+    int timeout_ms;
+};
+
+/*
+ * delivers motion alerts without blocking the capture threads.
+ *
+ * enqueue() only appends to a per camera queue. the dispatcher thread
+ * sends a camera's queued events as one batch at most every
+ * min_interval_s, to every configured sink. failed deliveries are retried
+ * with exponential backoff until max_attempts.
+ *
+ * alert_sink_stub/ is a local webhook and mqtt stand-in to try it against.
+ */
+class alert_dispatcher : public QThread
+{
+    Q_OBJECT;
+
+public:
+    alert_dispatcher();
+    ~alert_dispatcher();
+
+    // the dispatcher utilities::notifyMobile() feeds, may be null.
+    static alert_dispatcher *instance();
+
+    void setConfig(alert_config config);
+    void enqueue(QString camname, QString message);
+    void setRunning(bool);
+    QString statsReport();
+
+protected:
+    void run() override;
+
+private:
+    struct delivery{
+        int sink;
+        QString camname;
+        QList<alert_event> batch;
+        int attempts=0;
+        qint64 next_try_ms=0;
+    };
+
+    void rebuildSinks();
+    void takeBatches(qint64 now_ms);
+    void deliver(delivery &item, qint64 now_ms);
+
+    static alert_dispatcher *current;
+
+    QMutex lock;
+    QWaitCondition wake;
+    bool running=false;
+    bool sinks_dirty=true;
+    alert_config config;
+    QElapsedTimer clock;
+
+    QMap<QString, QList<alert_event>> queues;
+    QMap<QString, qint64> last_sent_ms;
+    QList<delivery> deliveries;      // only touched by the dispatcher thread
+    QList<alert_sink*> sinks;
+
+    // metrics
+    qint64 enqueued=0;
+    qint64 delivered=0;
+    qint64 delivered_batches=0;
+    qint64 failed=0;
+    qint64 dropped=0;
+    qint64 retried=0;
+    double latency_ms_total=0;
+    double latency_ms_max=0;
+    int pending_deliveries=0;
+    QString last_error;
+};
+
+#endif // ALERT_DISPATCHER_H
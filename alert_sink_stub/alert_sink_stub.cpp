@@ -0,0 +1,156 @@
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QHash>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+/*
+ * what the alert dispatcher talks to, without a real web server or broker.
+ *
+ * the http port answers every request with http_status (200 by default,
+ * e.g. 503 to exercise the retries) and prints the posted body. the mqtt
+ * port accepts any CONNECT and prints every PUBLISH, QoS 0 only, which is
+ * all mqtt_sink sends. point the "alerts" section of the config at it :
+ *   "webhook_url" : "http://127.0.0.1:8080/alerts", "mqtt_host" : "127.0.0.1", "mqtt_port" : 1883
+ */
+
+static QHash<QTcpSocket*, QByteArray> buffers;
+
+static void print(QString source, QString text)
+{
+    QString line = QDateTime::currentDateTime().toString("HH:mm:ss.zzz") + " " + source + " : " + text;
+    printf("%s\n", line.toUtf8().constData());
+    fflush(stdout);
+}
+
+// true once a whole request is buffered, its request line and body are returned.
+static bool takeHttpRequest(QByteArray &buffer, QByteArray &request_line, QByteArray &body)
+{
+    int header_end = buffer.indexOf("\r\n\r\n");
+    if (header_end < 0)
+        return false;
+
+    QList<QByteArray> headers = buffer.left(header_end).split('\n');
+    int content_length = 0;
+    foreach(QByteArray header, headers)
+    {
+        if (header.toLower().startsWith("content-length:"))
+            content_length = header.mid(15).trimmed().toInt();
+    }
+    if (buffer.size() < header_end + 4 + content_length)
+        return false;
+
+    request_line = headers.first().trimmed();
+    body = buffer.mid(header_end + 4, content_length);
+    buffer.remove(0, header_end + 4 + content_length);
+    return true;
+}
+
+// true once a whole packet is buffered, its type byte and body are returned.
+static bool takeMqttPacket(QByteArray &buffer, quint8 &type, QByteArray &body)
+{
+    int length = 0, shift = 0, pos = 1;
+    while (true)
+    {
+        if (pos >= buffer.size() || pos > 4)
+            return false;
+        quint8 digit = buffer.at(pos++);
+        length += (digit & 0x7F) << shift;
+        shift += 7;
+        if ((digit & 0x80) == 0)
+            break;
+    }
+    if (buffer.size() < pos + length)
+        return false;
+
+    type = buffer.at(0);
+    body = buffer.mid(pos, length);
+    buffer.remove(0, pos + length);
+    return true;
+}
+
+static void handleHttp(QTcpSocket *socket, int http_status)
+{
+    QByteArray &buffer = buffers[socket];
+    buffer += socket->readAll();
+
+    QByteArray request_line, body;
+    while (takeHttpRequest(buffer, request_line, body))
+    {
+        print("http", QString::fromUtf8(request_line) + " " + QString::fromUtf8(body));
+        socket->write(QString("HTTP/1.1 %1 stub\r\nContent-Length: 0\r\nConnection: close\r\n\r\n")
+                      .arg(http_status).toUtf8());
+        socket->disconnectFromHost();
+    }
+}
+
+static void handleMqtt(QTcpSocket *socket)
+{
+    QByteArray &buffer = buffers[socket];
+    buffer += socket->readAll();
+
+    quint8 type;
+    QByteArray body;
+    while (takeMqttPacket(buffer, type, body))
+    {
+        switch (type >> 4)
+        {
+        case 1:     // CONNECT, accepted
+            socket->write(QByteArray("\x20\x02\x00\x00", 4));
+            break;
+        case 3:     // PUBLISH, topic then payload at QoS 0
+        {
+            int topic_size = (quint8(body.at(0)) << 8) | quint8(body.at(1));
+            print("mqtt", QString::fromUtf8(body.mid(2, topic_size)) + " " + QString::fromUtf8(body.mid(2 + topic_size)));
+            break;
+        }
+        case 14:    // DISCONNECT
+            socket->disconnectFromHost();
+            break;
+        default:
+            print("mqtt", QString("ignored packet type %1").arg(type >> 4));
+        }
+    }
+}
+
+static bool listen(QTcpServer &server, int port, std::function<void(QTcpSocket*)> handle)
+{
+    QObject::connect(&server, &QTcpServer::newConnection, [&server, handle](){
+        while (QTcpSocket *socket = server.nextPendingConnection())
+        {
+            QObject::connect(socket, &QTcpSocket::readyRead, [socket, handle](){handle(socket);});
+            QObject::connect(socket, &QTcpSocket::disconnected, [socket](){
+                buffers.remove(socket);
+                socket->deleteLater();
+            });
+        }
+    });
+
+    if (!server.listen(QHostAddress::LocalHost, port))
+    {
+        fprintf(stderr, "can not listen on port %d : %s\n", port, server.errorString().toUtf8().constData());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    int http_port = argc > 1 ? atoi(argv[1]) : 8080;
+    int mqtt_port = argc > 2 ? atoi(argv[2]) : 1883;
+    int http_status = argc > 3 ? atoi(argv[3]) : 200;
+
+    QTcpServer http, mqtt;
+    if (!listen(http, http_port, [http_status](QTcpSocket *socket){handleHttp(socket, http_status);}) ||
+            !listen(mqtt, mqtt_port, handleMqtt))
+        return 1;
+
+    printf("webhook on http://127.0.0.1:%d/, mqtt on 127.0.0.1:%d, answering http %d\n",
+           http_port, mqtt_port, http_status);
+    fflush(stdout);
+    return app.exec();
+}
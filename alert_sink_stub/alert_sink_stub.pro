@@ -0,0 +1,10 @@
+# local stand-in for the alert webhook and mqtt broker, prints what it receives.
+# qmake && make, then ./alert_sink_stub [http_port] [mqtt_port] [http_status]
+
+TEMPLATE = app
+TARGET = alert_sink_stub
+CONFIG += console c++11
+CONFIG -= app_bundle
+QT = core network
+
+SOURCES += alert_sink_stub.cpp
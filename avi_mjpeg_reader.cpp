@@ -0,0 +1,148 @@
+#include "avi_mjpeg_reader.h"
+#include <QtEndian>
+#include <QDebug>
+
+avi_mjpeg_reader::avi_mjpeg_reader()
+{
+
+}
+
+avi_mjpeg_reader::~avi_mjpeg_reader()
+{
+    close();
+}
+
+bool avi_mjpeg_reader::open(QString path)
+{
+    close();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    packet_list.clear();
+    frame_rate = 0.0;
+    frame_size = cv::Size();
+    stream_fourcc.clear();
+    has_index = false;
+    truncated = false;
+
+    scanChunks(0, file.size());
+    return !packet_list.isEmpty();
+}
+
+void avi_mjpeg_reader::close()
+{
+    if (file.isOpen())
+        file.close();
+}
+
+quint32 avi_mjpeg_reader::readU32(qint64 offset)
+{
+    uchar bytes[4] = {0, 0, 0, 0};
+    file.seek(offset);
+    file.read(reinterpret_cast<char*>(bytes), 4);
+    return qFromLittleEndian<quint32>(bytes);
+}
+
+void avi_mjpeg_reader::scanChunks(qint64 begin, qint64 end)
+{
+    qint64 pos = begin;
+    while (pos + 8 <= end)
+    {
+        file.seek(pos);
+        QByteArray head = file.read(12);
+        if (head.size() < 8)
+        {
+            truncated = true;
+            return;
+        }
+
+        QByteArray id = head.left(4);
+        quint32 size = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(head.constData() + 4));
+        qint64 data = pos + 8;
+        qint64 chunk_end = data + size;
+
+        if (id == "RIFF" || id == "LIST")
+        {
+            // a crash leaves list sizes unpatched (zero) : run to the end.
+            if (size < 4 || chunk_end > end)
+            {
+                chunk_end = end;
+                truncated = true;
+            }
+
+            QByteArray type = head.mid(8, 4);
+            if (type == "AVI " || type == "AVIX" || type == "hdrl" || type == "strl" ||
+                    type == "movi" || type == "rec ")
+                scanChunks(data + 4, chunk_end);
+        }
+        else
+        {
+            // the last chunk was only partly written.
+            if (chunk_end > end)
+            {
+                truncated = true;
+                return;
+            }
+
+            if (id == "avih" && size >= 40)
+            {
+                quint32 usec_per_frame = readU32(data);
+                if (usec_per_frame > 0 && frame_rate == 0.0)
+                    frame_rate = 1e6 / usec_per_frame;
+                frame_size = cv::Size(readU32(data + 32), readU32(data + 36));
+            }
+            else if (id == "strh" && size >= 28)
+            {
+                file.seek(data);
+                QByteArray type_handler = file.read(8);
+                if (type_handler.startsWith("vids"))
+                    stream_fourcc = type_handler.mid(4, 4);
+                quint32 scale = readU32(data + 20);
+                quint32 rate = readU32(data + 24);
+                if (scale > 0 && rate > 0)
+                    frame_rate = double(rate) / scale;
+            }
+            else if (id == "idx1")
+            {
+                has_index = true;
+            }
+            else if (id.endsWith("dc") && size > 0)
+            {
+                packet_list.append({data, size});
+            }
+        }
+
+        // chunks are word aligned.
+        pos = chunk_end + (size & 1);
+    }
+}
+
+int avi_mjpeg_reader::packetCount(){return packet_list.size();}
+
+const QVector<avi_mjpeg_reader::packet> &avi_mjpeg_reader::packets(){return packet_list;}
+
+bool avi_mjpeg_reader::readPacket(int index, QByteArray &jpeg)
+{
+    if (index < 0 || index >= packet_list.size())
+        return false;
+
+    const packet &p = packet_list.at(index);
+    jpeg.resize(p.size);
+    file.seek(p.offset);
+    return file.read(jpeg.data(), p.size) == p.size;
+}
+
+double avi_mjpeg_reader::fps(){return frame_rate;}
+
+cv::Size avi_mjpeg_reader::frameSize(){return frame_size;}
+
+QByteArray avi_mjpeg_reader::fourcc(){return stream_fourcc;}
+
+bool avi_mjpeg_reader::isDamaged(){return truncated || !has_index;}
+
+QString avi_mjpeg_reader::errorString()
+{
+    return file.error() == QFileDevice::NoError ? QString() : file.errorString();
+}
@@ -0,0 +1,59 @@
+#ifndef AVI_MJPEG_READER_H
+#define AVI_MJPEG_READER_H
+
+#include <QString>
+#include <QFile>
+#include <QByteArray>
+#include <QVector>
+#include <opencv2/core.hpp>
+
+/*
+ * walks the RIFF chunks of an MJPG avi and indexes the jpeg packets
+ * without decoding them.
+ *
+ * the index (idx1) is not needed, the movi list is scanned directly, so
+ * files that were cut off by a crash (no index, zero sized lists, a half
+ * written last chunk) still give every complete packet.
+ */
+class avi_mjpeg_reader
+{
+public:
+    struct packet{
+        qint64 offset;      // of the packet data in the file
+        quint32 size;
+    };
+
+    avi_mjpeg_reader();
+    ~avi_mjpeg_reader();
+
+    bool open(QString path);
+    void close();
+
+    int packetCount();
+    bool readPacket(int index, QByteArray &jpeg);
+    const QVector<packet> &packets();
+
+    double fps();
+    cv::Size frameSize();
+    // of the video stream, e.g. "MJPG", empty when the header is gone.
+    QByteArray fourcc();
+
+    // true when the file ended inside a chunk or had no index.
+    bool isDamaged();
+    // the file could not be opened or read, empty if it could.
+    QString errorString();
+
+private:
+    void scanChunks(qint64 begin, qint64 end);
+    quint32 readU32(qint64 offset);
+
+    QFile file;
+    QVector<packet> packet_list;
+    double frame_rate=0.0;
+    cv::Size frame_size;
+    QByteArray stream_fourcc;
+    bool has_index=false;
+    bool truncated=false;
+};
+
+#endif // AVI_MJPEG_READER_H
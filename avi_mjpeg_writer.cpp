@@ -0,0 +1,173 @@
+#include "avi_mjpeg_writer.h"
+#include <QtEndian>
+#include <QDebug>
+
+// chunk flag of the index entries, every MJPG frame is a keyframe.
+static const quint32 AVIIF_KEYFRAME = 0x10;
+static const quint32 AVIF_HASINDEX = 0x10;
+
+avi_mjpeg_writer::avi_mjpeg_writer()
+{
+
+}
+
+avi_mjpeg_writer::~avi_mjpeg_writer()
+{
+    close();
+}
+
+void avi_mjpeg_writer::writeU32(quint32 value)
+{
+    uchar bytes[4];
+    qToLittleEndian<quint32>(value, bytes);
+    file.write(reinterpret_cast<const char*>(bytes), 4);
+}
+
+void avi_mjpeg_writer::patchU32(qint64 offset, quint32 value)
+{
+    qint64 pos = file.pos();
+    file.seek(offset);
+    writeU32(value);
+    file.seek(pos);
+}
+
+bool avi_mjpeg_writer::open(QString path, cv::Size frame_size, double fps)
+{
+    close();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "failed to open avi for writing : " << path;
+        return false;
+    }
+
+    index_offsets.clear();
+    index_sizes.clear();
+    max_packet_size = 0;
+    if (fps <= 0)
+        fps = 30;
+
+    quint32 width = frame_size.width;
+    quint32 height = frame_size.height;
+
+    file.write("RIFF", 4);
+    riff_size_pos = file.pos();
+    writeU32(0);
+    file.write("AVI ", 4);
+
+    // hdrl : avih + strl(strh + strf)
+    file.write("LIST", 4);
+    writeU32(4 + (8 + 56) + (8 + 116));
+    file.write("hdrl", 4);
+
+    file.write("avih", 4);
+    writeU32(56);
+    writeU32(qRound(1e6 / fps));    // micro seconds per frame
+    writeU32(0);                    // max bytes per second
+    writeU32(0);                    // padding granularity
+    writeU32(AVIF_HASINDEX);
+    total_frames_pos = file.pos();
+    writeU32(0);                    // total frames
+    writeU32(0);                    // initial frames
+    writeU32(1);                    // streams
+    suggested_buffer_pos = file.pos();
+    writeU32(0);                    // suggested buffer size
+    writeU32(width);
+    writeU32(height);
+    for (int i=0; i<4; i++)
+        writeU32(0);                // reserved
+
+    file.write("LIST", 4);
+    writeU32(4 + (8 + 56) + (8 + 40));
+    file.write("strl", 4);
+
+    file.write("strh", 4);
+    writeU32(56);
+    file.write("vids", 4);
+    file.write("MJPG", 4);
+    writeU32(0);                    // flags
+    writeU32(0);                    // priority, language
+    writeU32(0);                    // initial frames
+    writeU32(1000);                 // scale
+    writeU32(qRound(fps * 1000));   // rate
+    writeU32(0);                    // start
+    stream_length_pos = file.pos();
+    writeU32(0);                    // length in frames
+    writeU32(0);                    // suggested buffer size
+    writeU32(0xFFFFFFFF);           // quality, default
+    writeU32(0);                    // sample size
+    writeU32(0);                    // frame rect left, top
+    writeU32(width | (height << 16));
+
+    file.write("strf", 4);
+    writeU32(40);
+    writeU32(40);                   // BITMAPINFOHEADER size
+    writeU32(width);
+    writeU32(height);
+    writeU32(1 | (24 << 16));       // planes, bit count
+    file.write("MJPG", 4);
+    writeU32(width * height * 3);
+    for (int i=0; i<4; i++)
+        writeU32(0);
+
+    file.write("LIST", 4);
+    movi_size_pos = file.pos();
+    writeU32(0);
+    movi_start = file.pos();
+    file.write("movi", 4);
+
+    return true;
+}
+
+bool avi_mjpeg_writer::isOpened(){return file.isOpen();}
+
+bool avi_mjpeg_writer::writePacket(const char *data, quint32 size)
+{
+    if (!file.isOpen())
+        return false;
+
+    index_offsets.append(file.pos() - movi_start);
+    index_sizes.append(size);
+    max_packet_size = qMax(max_packet_size, size);
+
+    file.write("00dc", 4);
+    writeU32(size);
+    bool ok = file.write(data, size) == size;
+    if (size & 1)
+        file.putChar(0);
+    return ok;
+}
+
+bool avi_mjpeg_writer::writePacket(const QByteArray &jpeg)
+{
+    return writePacket(jpeg.constData(), jpeg.size());
+}
+
+void avi_mjpeg_writer::close()
+{
+    if (!file.isOpen())
+        return;
+
+    patchU32(movi_size_pos, file.pos() - movi_start);
+
+    file.write("idx1", 4);
+    writeU32(index_offsets.size() * 16);
+    for (int i=0; i<index_offsets.size(); i++)
+    {
+        file.write("00dc", 4);
+        writeU32(AVIIF_KEYFRAME);
+        writeU32(index_offsets.at(i));
+        writeU32(index_sizes.at(i));
+    }
+
+    patchU32(riff_size_pos, file.pos() - 8);
+    patchU32(total_frames_pos, index_offsets.size());
+    patchU32(suggested_buffer_pos, max_packet_size);
+    patchU32(stream_length_pos, index_offsets.size());
+    file.close();
+}
+
+int avi_mjpeg_writer::framesWritten(){return index_offsets.size();}
+
+qint64 avi_mjpeg_writer::bytesWritten(){return file.isOpen() ? file.pos() : file.size();}
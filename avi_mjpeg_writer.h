@@ -0,0 +1,49 @@
+#ifndef AVI_MJPEG_WRITER_H
+#define AVI_MJPEG_WRITER_H
+
+#include <QString>
+#include <QFile>
+#include <QByteArray>
+#include <QVector>
+#include <opencv2/core.hpp>
+
+/*
+ * writes already encoded jpeg packets into an MJPG avi (packet copy).
+ * used to re-mux damaged recordings and to cut clips without decoding.
+ */
+class avi_mjpeg_writer
+{
+public:
+    avi_mjpeg_writer();
+    ~avi_mjpeg_writer();
+
+    bool open(QString path, cv::Size frame_size, double fps);
+    bool writePacket(const char *data, quint32 size);
+    bool writePacket(const QByteArray &jpeg);
+
+    // writes the index and patches the header sizes.
+    void close();
+    bool isOpened();
+
+    int framesWritten();
+    qint64 bytesWritten();
+
+private:
+    void writeU32(quint32 value);
+    void patchU32(qint64 offset, quint32 value);
+
+    QFile file;
+    QVector<quint32> index_offsets;
+    QVector<quint32> index_sizes;
+    quint32 max_packet_size=0;
+
+    // header fields patched on close.
+    qint64 riff_size_pos=0;
+    qint64 total_frames_pos=0;
+    qint64 suggested_buffer_pos=0;
+    qint64 stream_length_pos=0;
+    qint64 movi_size_pos=0;
+    qint64 movi_start=0;
+};
+
+#endif // AVI_MJPEG_WRITER_H
@@ -0,0 +1,13 @@
+# the pipeline benchmark : the software plus pipeline_bench, with the heap
+# counting allocator. only this binary replaces malloc, see pipeline_bench.h
+# qmake bench.pro && make, then ./bench --bench (or "make bench" from software.pro)
+
+DEFINES += BENCH
+include(software.pro)
+
+TARGET = bench
+OBJECTS_DIR = bench_objects
+MOC_DIR = bench_objects
+
+SOURCES += pipeline_bench.cpp
+HEADERS += pipeline_bench.h
@@ -0,0 +1,268 @@
+#include "blob_tracker.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+
+// kalman noise, in px^2 : process noise of position and velocity, and
+// the jitter of a blob centre from one mask to the next.
+static const float q_pos = 4.0f;
+static const float q_vel = 1.0f;
+static const float r_meas = 25.0f;
+// size follows the blobs slowly, masks breathe more than objects do.
+static const float size_alpha = 0.3f;
+
+struct match_candidate
+{
+    float score;
+    int track;
+    int blob;
+};
+
+blob_tracker::blob_tracker(float iou_threshold, int min_hits, int max_misses):
+    iou_threshold(iou_threshold), min_hits(min_hits), max_misses(max_misses)
+{
+
+}
+
+void blob_tracker::setParameters(float new_iou_threshold, int new_min_hits, int new_max_misses)
+{
+    iou_threshold = new_iou_threshold;
+    min_hits = new_min_hits;
+    max_misses = new_max_misses;
+}
+
+int blob_tracker::size() const {return ids.size();}
+
+bool blob_tracker::isConfirmed(int i) const {return hits[i] >= min_hits;}
+
+int blob_tracker::trackId(int i) const {return ids[i];}
+
+double blob_tracker::dwellSeconds(int i) const {return (last_ms[i] - first_ms[i]) / 1000.0;}
+
+int blob_tracker::confirmedCount() const
+{
+    int count = 0;
+    for (size_t i=0; i<hits.size(); i++)
+        count += hits[i] >= min_hits;
+    return count;
+}
+
+cv::Rect blob_tracker::box(int i) const
+{
+    return cv::Rect(cvRound(cx[i] - w[i] / 2), cvRound(cy[i] - h[i] / 2), cvRound(w[i]), cvRound(h[i]));
+}
+
+void blob_tracker::predict()
+{
+    for (size_t i=0; i<ids.size(); i++)
+    {
+        cx[i] += vx[i];
+        cy[i] += vy[i];
+        p00[i] += 2 * p01[i] + p11[i] + q_pos;
+        p01[i] += p11[i];
+        p11[i] += q_vel;
+    }
+}
+
+void blob_tracker::correct(int i, const cv::Rect &blob, qint64 time_ms)
+{
+    float zx = blob.x + blob.width / 2.0f;
+    float zy = blob.y + blob.height / 2.0f;
+
+    float s = p00[i] + r_meas;
+    float k0 = p00[i] / s;
+    float k1 = p01[i] / s;
+    float ix = zx - cx[i];
+    float iy = zy - cy[i];
+    cx[i] += k0 * ix;
+    cy[i] += k0 * iy;
+    vx[i] += k1 * ix;
+    vy[i] += k1 * iy;
+    p11[i] -= k1 * p01[i];
+    p00[i] *= 1 - k0;
+    p01[i] *= 1 - k0;
+
+    w[i] += size_alpha * (blob.width - w[i]);
+    h[i] += size_alpha * (blob.height - h[i]);
+    hits[i]++;
+    misses[i] = 0;
+    last_ms[i] = time_ms;
+
+    // append the centre to the trail.
+    cv::Point2f centre(cx[i], cy[i]);
+    cv::Point2f *trail = &trails[i * trail_length];
+    if (trail_count[i] > 0)
+    {
+        cv::Point2f step = centre - trail[trail_head[i]];
+        path_px[i] += std::sqrt(step.dot(step));
+    }
+    trail_head[i] = (trail_head[i] + 1) % trail_length;
+    trail[trail_head[i]] = centre;
+    trail_count[i] = std::min(trail_count[i] + 1, int(trail_length));
+}
+
+void blob_tracker::add(const cv::Rect &blob, qint64 time_ms)
+{
+    float bx = blob.x + blob.width / 2.0f;
+    float by = blob.y + blob.height / 2.0f;
+
+    ids.push_back(next_id++);
+    cx.push_back(bx);
+    cy.push_back(by);
+    vx.push_back(0);
+    vy.push_back(0);
+    w.push_back(blob.width);
+    h.push_back(blob.height);
+    p00.push_back(r_meas);
+    p01.push_back(0);
+    p11.push_back(100);
+    hits.push_back(1);
+    misses.push_back(0);
+    first_ms.push_back(time_ms);
+    last_ms.push_back(time_ms);
+    path_px.push_back(0);
+
+    trails.resize(trails.size() + trail_length);
+    trails[trails.size() - trail_length] = cv::Point2f(bx, by);
+    trail_head.push_back(0);
+    trail_count.push_back(1);
+}
+
+void blob_tracker::remove(int i)
+{
+    // move the last track into slot i, order does not matter.
+    int last = ids.size() - 1;
+    if (i != last)
+    {
+        ids[i] = ids[last];
+        cx[i] = cx[last]; cy[i] = cy[last];
+        vx[i] = vx[last]; vy[i] = vy[last];
+        w[i] = w[last]; h[i] = h[last];
+        p00[i] = p00[last]; p01[i] = p01[last]; p11[i] = p11[last];
+        hits[i] = hits[last]; misses[i] = misses[last];
+        first_ms[i] = first_ms[last]; last_ms[i] = last_ms[last];
+        path_px[i] = path_px[last];
+        std::copy(trails.begin() + last * trail_length, trails.begin() + (last + 1) * trail_length,
+                  trails.begin() + i * trail_length);
+        trail_head[i] = trail_head[last];
+        trail_count[i] = trail_count[last];
+    }
+
+    ids.pop_back();
+    cx.pop_back(); cy.pop_back();
+    vx.pop_back(); vy.pop_back();
+    w.pop_back(); h.pop_back();
+    p00.pop_back(); p01.pop_back(); p11.pop_back();
+    hits.pop_back(); misses.pop_back();
+    first_ms.pop_back(); last_ms.pop_back();
+    path_px.pop_back();
+    trails.resize(trails.size() - trail_length);
+    trail_head.pop_back();
+    trail_count.pop_back();
+}
+
+void blob_tracker::update(const std::vector<cv::Rect> &blobs, qint64 time_ms)
+{
+    predict();
+
+    int n_tracks = ids.size();
+    std::vector<char> track_matched(n_tracks, 0);
+    std::vector<char> blob_matched(blobs.size(), 0);
+    std::vector<match_candidate> candidates;
+
+    // greedy assignment, best score first.
+    auto assign = [&]() {
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const match_candidate &a, const match_candidate &b) { return a.score > b.score; });
+        for (size_t c=0; c<candidates.size(); c++)
+        {
+            const match_candidate &m = candidates[c];
+            if (track_matched[m.track] || blob_matched[m.blob])
+                continue;
+            track_matched[m.track] = blob_matched[m.blob] = 1;
+            correct(m.track, blobs[m.blob], time_ms);
+        }
+        candidates.clear();
+    };
+
+    // first by overlap with the predicted box, the state after predict().
+    for (int t=0; t<n_tracks; t++)
+    {
+        cv::Rect predicted = box(t);
+        for (size_t b=0; b<blobs.size(); b++)
+        {
+            float overlap = (predicted & blobs[b]).area();
+            if (overlap <= 0)
+                continue;
+            float iou = overlap / (predicted.area() + blobs[b].area() - overlap);
+            if (iou >= iou_threshold)
+                candidates.push_back({iou, t, int(b)});
+        }
+    }
+    assign();
+
+    // then small or fast objects by centre distance, within one track size.
+    for (int t=0; t<n_tracks; t++)
+    {
+        if (track_matched[t])
+            continue;
+        float gate = std::max(w[t], h[t]);
+        for (size_t b=0; b<blobs.size(); b++)
+        {
+            if (blob_matched[b])
+                continue;
+            float dx = blobs[b].x + blobs[b].width / 2.0f - cx[t];
+            float dy = blobs[b].y + blobs[b].height / 2.0f - cy[t];
+            float distance = std::sqrt(dx * dx + dy * dy);
+            if (distance < gate)
+                candidates.push_back({-distance, t, int(b)});
+        }
+    }
+    assign();
+
+    for (int t=0; t<n_tracks; t++)
+    {
+        if (!track_matched[t])
+            misses[t]++;
+    }
+    for (size_t b=0; b<blobs.size(); b++)
+    {
+        if (!blob_matched[b])
+            add(blobs[b], time_ms);
+    }
+
+    // a tentative track dies on its first miss, a confirmed one coasts.
+    for (int i=ids.size()-1; i>=0; i--)
+    {
+        bool confirmed = hits[i] >= min_hits;
+        if (misses[i] > max_misses || (!confirmed && misses[i] > 0))
+        {
+            if (confirmed)
+                finished.push_back({ids[i], first_ms[i], last_ms[i], path_px[i], box(i)});
+            remove(i);
+        }
+    }
+}
+
+void blob_tracker::clear()
+{
+    while (!ids.empty())
+        remove(ids.size() - 1);
+    finished.clear();
+}
+
+std::vector<finished_track> blob_tracker::takeFinished()
+{
+    std::vector<finished_track> taken;
+    taken.swap(finished);
+    return taken;
+}
+
+std::vector<cv::Point> blob_tracker::trail(int i) const
+{
+    std::vector<cv::Point> points;
+    const cv::Point2f *ring = &trails[i * trail_length];
+    for (int k=trail_count[i]-1; k>=0; k--)
+        points.push_back(ring[(trail_head[i] - k + trail_length) % trail_length]);
+    return points;
+}
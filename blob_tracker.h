@@ -0,0 +1,82 @@
+#ifndef BLOB_TRACKER_H
+#define BLOB_TRACKER_H
+
+#include <QString>
+#include <vector>
+#include <opencv2/core.hpp>
+
+struct finished_track
+{
+    int id;
+    qint64 first_ms;
+    qint64 last_ms;
+    float path_px;              // distance the centre travelled
+    cv::Rect last_box;
+};
+
+/*
+ * follows the motion blobs of one camera from frame to frame.
+ *
+ * every track has a constant velocity kalman filter on its centre; the
+ * predicted boxes are matched to the new blobs by IoU, then by centre
+ * distance for what is left. a track is confirmed after min_hits matched
+ * frames and dropped after max_misses frames without a match, so a blob
+ * that flickers for a frame neither starts nor ends anything.
+ *
+ * tracks are stored as parallel arrays (one vector per field, track i at
+ * index i in all of them), the per frame loops only touch the fields
+ * they need. x and y share one covariance, both axes see the same
+ * measurements.
+ */
+class blob_tracker
+{
+public:
+    explicit blob_tracker(float iou_threshold=0.3f, int min_hits=3, int max_misses=10);
+
+    void setParameters(float iou_threshold, int min_hits, int max_misses);
+    void update(const std::vector<cv::Rect> &blobs, qint64 time_ms);
+    void clear();
+
+    int size() const;
+    int confirmedCount() const;
+    bool isConfirmed(int i) const;
+    int trackId(int i) const;
+    cv::Rect box(int i) const;
+    double dwellSeconds(int i) const;
+
+    // tracks dropped since the last call.
+    std::vector<finished_track> takeFinished();
+
+    // recent centres of track i, oldest first.
+    std::vector<cv::Point> trail(int i) const;
+
+    static const int trail_length = 32;
+
+private:
+    void predict();
+    void correct(int i, const cv::Rect &blob, qint64 time_ms);
+    void add(const cv::Rect &blob, qint64 time_ms);
+    void remove(int i);
+
+    float iou_threshold;
+    int min_hits;
+    int max_misses;
+    int next_id=1;
+
+    // track state, index i is one track.
+    std::vector<int> ids;
+    std::vector<float> cx, cy, vx, vy;         // centre and velocity, px per frame
+    std::vector<float> w, h;                   // smoothed size
+    std::vector<float> p00, p01, p11;          // position/velocity covariance
+    std::vector<int> hits, misses;
+    std::vector<qint64> first_ms, last_ms;
+    std::vector<float> path_px;
+
+    // trail_length centres per track, a ring buffer for each.
+    std::vector<cv::Point2f> trails;
+    std::vector<int> trail_head, trail_count;
+
+    std::vector<finished_track> finished;
+};
+
+#endif // BLOB_TRACKER_H
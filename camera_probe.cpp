@@ -0,0 +1,124 @@
+#include "camera_probe.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QMutexLocker>
+#include <QtConcurrent>
+
+// never deleted, a probe stuck in the driver must not hold up the exit.
+QThreadPool *camera_probe::pool = nullptr;
+QMutex camera_probe::busy_lock;
+QWaitCondition camera_probe::busy_changed;
+QSet<QString> camera_probe::busy;
+
+bool camera_probe::openCapture(cv::VideoCapture &cap, std::string device, int width, int height, int timeout_ms)
+{
+    std::vector<int> params = {cv::CAP_PROP_FRAME_WIDTH, width,
+                               cv::CAP_PROP_FRAME_HEIGHT, height,
+                               cv::CAP_PROP_OPEN_TIMEOUT_MSEC, timeout_ms};
+    if (cap.open(device, cv::CAP_ANY, params))
+        return true;
+
+    // backends that refuse a parameter refuse the whole open, retry plain.
+    return cap.open(device);
+}
+
+probe_result camera_probe::probe(QString device, int width, int height, int timeout_ms)
+{
+    probe_result result;
+    result.device = device;
+
+    QElapsedTimer timer;
+    timer.start();
+    cv::VideoCapture cap;
+    result.opened = openCapture(cap, device.toStdString(), width, height, timeout_ms);
+    result.open_ms = timer.nsecsElapsed() / 1e6;
+    if (result.opened)
+    {
+        result.width = cap.get(cv::CAP_PROP_FRAME_WIDTH);
+        result.height = cap.get(cv::CAP_PROP_FRAME_HEIGHT);
+    }
+    cap.release();
+
+    busy_lock.lock();
+    busy.remove(device);
+    busy_changed.wakeAll();
+    busy_lock.unlock();
+    return result;
+}
+
+bool camera_probe::waitForDevice(QString device, int timeout_ms)
+{
+    QMutexLocker locker(&busy_lock);
+    QElapsedTimer timer;
+    timer.start();
+    while (busy.contains(device))
+    {
+        qint64 left_ms = timeout_ms - timer.elapsed();
+        if (left_ms <= 0)
+            return false;
+        busy_changed.wait(&busy_lock, left_ms);
+    }
+    return true;
+}
+
+bool camera_probe::isProbing(QString device)
+{
+    QMutexLocker locker(&busy_lock);
+    return busy.contains(device);
+}
+
+QList<probe_result> camera_probe::probeAll(QStringList devices, int width, int height, int timeout_ms)
+{
+    // one open per device, all at the same time, off the global pool so a
+    // hung driver never holds one of its workers.
+    busy_lock.lock();
+    if (pool == nullptr)
+        pool = new QThreadPool();
+    pool->setMaxThreadCount(qMax(pool->maxThreadCount(), devices.size()));
+    foreach(QString device, devices)
+        busy.insert(device);
+    busy_lock.unlock();
+
+    QList<QFuture<probe_result>> futures;
+    foreach(QString device, devices)
+        futures.append(QtConcurrent::run(pool, &camera_probe::probe, device, width, height, timeout_ms));
+
+    QElapsedTimer timer;
+    timer.start();
+    pool->waitForDone(timeout_ms);
+
+    QList<probe_result> results;
+    for (int i=0; i<devices.size(); i++)
+    {
+        if (futures.at(i).isFinished())
+            results.append(futures.at(i).result());
+        else
+        {
+            probe_result result;
+            result.device = devices.at(i);
+            result.timed_out = true;
+            result.open_ms = timer.elapsed();
+            results.append(result);
+        }
+    }
+
+    qDebug().noquote() << report(results);
+    return results;
+}
+
+QString camera_probe::report(const QList<probe_result> &results)
+{
+    QString report = QString("camera probe : %1 devices\n").arg(results.size());
+    foreach(probe_result result, results)
+    {
+        if (result.timed_out)
+            report += QString("  %1 : timed out after %2 ms\n").arg(result.device).arg(result.open_ms, 0, 'f', 0);
+        else if (!result.opened)
+            report += QString("  %1 : failed to open (%2 ms)\n").arg(result.device).arg(result.open_ms, 0, 'f', 0);
+        else
+            report += QString("  %1 : %2x%3, opened in %4 ms\n")
+                    .arg(result.device).arg(result.width).arg(result.height).arg(result.open_ms, 0, 'f', 0);
+    }
+    return report;
+}
@@ -0,0 +1,55 @@
+#ifndef CAMERA_PROBE_H
+#define CAMERA_PROBE_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <string>
+#include <opencv2/videoio.hpp>
+
+struct probe_result
+{
+    QString device;
+    bool opened=false;
+    bool timed_out=false;
+    double open_ms=0;
+    int width=0;
+    int height=0;
+};
+
+/*
+ * opens camera devices without blocking the caller on a slow driver.
+ *
+ * probeAll() opens every device at once on a pool of its own and waits
+ * at most timeout_ms for all of them; a device that has not answered by
+ * then is reported as timed out and left to finish in the background.
+ * it keeps the device open until then, so whoever opens it next first
+ * calls waitForDevice(). openCapture() opens one device with its resolution and
+ * open timeout passed in the open call, so the driver negotiates the
+ * format once instead of again for every cap.set().
+ */
+class camera_probe
+{
+public:
+    static QList<probe_result> probeAll(QStringList devices, int width, int height, int timeout_ms);
+    static bool openCapture(cv::VideoCapture &cap, std::string device, int width, int height, int timeout_ms);
+    static QString report(const QList<probe_result> &results);
+
+    // false when a probe of device still runs after timeout_ms.
+    static bool waitForDevice(QString device, int timeout_ms);
+    static bool isProbing(QString device);
+
+private:
+    static probe_result probe(QString device, int width, int height, int timeout_ms);
+
+    static QThreadPool *pool;
+    static QMutex busy_lock;
+    static QWaitCondition busy_changed;
+    static QSet<QString> busy;          // devices with a probe running
+};
+
+#endif // CAMERA_PROBE_H
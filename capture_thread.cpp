@@ -1,39 +1,68 @@
 #include "capture_thread.h"
 #include "utilities.h"
+#include "camera_probe.h"
+#include "object_detector.h"
+#include "thread_tuning.h"
+#include "memory_governor.h"
 #include <string>
 #include <QDebug>
 #include <QTime>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QFile>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <QVector>
 #include <opencv2/highgui.hpp>
 
+// learning rate while the model settles after a scene change.
+static const double settle_rate = 0.1;
+// the saved background is applied this many times before the first frame.
+static const int warm_frames = 10;
+// the model counts as stable once the mask stays this empty for this long.
+static const float stable_ratio = 0.01f;
+static const int stable_frames = 15;
+// frame latencies kept until someone takes them.
+static const size_t latency_samples = 4096;
+// the heatmap view is refreshed this often.
+static const qint64 heatmap_emit_interval_ms = 1000;
+// the memory a camera holds is accounted this often.
+static const qint64 memory_account_interval_ms = 1000;
+// the background model runs on frames this much smaller under memory pressure.
+static const double reduced_analysis_scale = 0.5;
+
 capture_thread::capture_thread(std::string camname, QMutex *lock):
-    running(false), camname(camname), videopath(""), data_lock(lock)
+    running(false), camname(camname), videopath(""), data_lock(lock), graph(QString::fromStdString(camname))
 {
     fps_calculating = false;
     fps = 0.0;
 
     frame_width=frame_height=0;
-    video_writer=nullptr;
+    recorder=new video_recorder();
     video_saving_status=STOPPED;
+    buildGraph();
 }
 
 capture_thread::capture_thread(QString videopath, QMutex *lock):
-    running(false), camname("nocam"), videopath(videopath), data_lock(lock)
+    running(false), camname("nocam"), videopath(videopath), data_lock(lock), graph(videopath)
 {
     fps_calculating = false;
     fps = 0.0;
 
     frame_width=frame_height=0;
-    video_writer=nullptr;
+    recorder=new video_recorder();
     video_saving_status=STOPPED;
     saved_video_name="";
+    buildGraph();
 
 }
 
 capture_thread::~capture_thread()
 {
+    delete recorder;
 
 }
 
@@ -75,17 +104,25 @@ void capture_thread::run()
 
     // set thread running
     setRunning(true);
-
-    // open webcam
-    cv::VideoCapture cap(camname);
-    if (!cap.isOpened()){
-        CV_Assert("Failed to open camera.");
+    startup_timer.start();
+    thread_tuning::registerThread("capture", "cap " + camName().section('/', -1));
+
+    // take the configuration handed in before start, it has the open parameters.
+    cv::VideoCapture cap;
+    if (config_pending)
+        applyPendingConfig(cap);
+
+    // open webcam, the resolution is negotiated in the open itself. a startup
+    // probe still stuck on the device would race this open, wait for it.
+    bool probing = !camera_probe::waitForDevice(camName(), config.open_timeout_ms);
+    if (probing || !camera_probe::openCapture(cap, camname, config.frame_width, config.frame_height, config.open_timeout_ms)){
+        qDebug() << (probing ? "camera probe still running : " : "failed to open camera : ") << camName();
+        thread_tuning::unregisterThread();
+        setRunning(false);
+        emit RunComplete(false);
+        return;
     }
-
-    //set framerate, width and height
-//    cap.set(cv::CAP_PROP_FPS, 30);
-    cap.set(cv::CAP_PROP_FRAME_WIDTH, 1920);
-    cap.set(cv::CAP_PROP_FRAME_HEIGHT, 1080);
+    open_ms = startup_timer.nsecsElapsed() / 1e6;
 
     // get the actual frame height and width we got.
     frame_width=cap.get(cv::CAP_PROP_FRAME_WIDTH);
@@ -97,35 +134,54 @@ void capture_thread::run()
     blankFrame = new cv::Mat(frame_height, frame_width, CV_8U, 255);
 
     // create segmentor
-    segmentor = cv::createBackgroundSubtractorMOG2(500, 16, true);
+    segmentor = cv::createBackgroundSubtractorMOG2(config.mog2_history, config.mog2_var_threshold, config.mog2_detect_shadows);
+    if (config.warm_start)
+        warmBackgroundModel();
+    noise_kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(config.noise_size, config.noise_size));
 
-    // tmp_frames for resource allocation.
-    cv::Mat tmp_frame;
-    cv::Mat tmp_frame2;
+    updateCompositor();
+    updateZones();
 
     // for fps calculation.
     int frame_count=0;
     QTime timer;
     bool first_time=true;
-    const int n_frames_to_consider=30;
+    qint64 sequence=0;
 
     while(running){
 
         if ( pause )
             continue;
 
-        cap >> tmp_frame;
-        if(tmp_frame.empty())
-            break;
+        // the stages use the config, it only changes while they are idle.
+        if (config_pending)
+        {
+            graph.waitIdle();
+            applyPendingConfig(cap);
+        }
 
-        if (doMirror)
+        // the same for a new memory level, see memory_governor.
+        memory_governor::Level level = memory_governor::poll();
+        if (level != memory_level)
         {
-            cv::flip(tmp_frame, tmp_frame2, 1);
-            tmp_frame = tmp_frame2;
+            graph.waitIdle();
+            applyMemoryLevel(level);
         }
+        accountMemory();
 
-        if (motion_detecting_status && segmentor != nullptr)
-            motionDetect(tmp_frame);
+        packet_ptr packet = graph.newPacket();
+        packet->clock.start();
+        cap >> packet->frame;
+        if(packet->frame.empty())
+            break;
+        packet->sequence = ++sequence;
+        packet->timestamp_us = QDateTime::currentMSecsSinceEpoch() * 1000;
+
+        if (first_frame_ms < 0)
+        {
+            first_frame_ms = startup_timer.nsecsElapsed() / 1e6;
+            qDebug() << QString("%1 : first frame after %2 ms").arg(camName()).arg(first_frame_ms, 0, 'f', 0);
+        }
 
         if (fps_calculating)
         {
@@ -135,10 +191,10 @@ void capture_thread::run()
                 first_time=false;
             }
 
-            else if(frame_count != n_frames_to_consider)
+            else if(frame_count < config.fps_frames)
                 frame_count++;
 
-            else if(frame_count == n_frames_to_consider)
+            else
             {
                 int elapsed_ms = timer.elapsed();
                 fps = frame_count / (elapsed_ms / 1000.0);
@@ -150,31 +206,25 @@ void capture_thread::run()
 
         }
 
-        if (video_saving_status != STOPPED )
-        {
-            if(video_saving_status == STARTING)
-                startSavingVideo(tmp_frame);
-
-            else if(video_saving_status == STARTED)
-                video_writer->write(tmp_frame);
-
-            else if(video_saving_status == STOPPING)
-                stopSavingVideo();
-        }
+        // detection, display, recording and streaming run on the executor,
+        // this thread only waits when the recording falls behind.
+        graph.push(source_node, packet, packet->clock.nsecsElapsed() / 1e3);
+    }
 
-        // convert color to visualise at screen
-        cv::cvtColor(tmp_frame, tmp_frame, cv::COLOR_BGR2RGB);
+    graph.waitIdle();
+    memory_governor::remove(camName());
 
-        // write and emit frame
-        data_lock->lock();
-        frame=tmp_frame;
-        data_lock->unlock();
-        emit frameCaptured(&frame);
+    if(video_saving_status != STOPPED)
+        stopSavingVideo();
 
+    if (motion_detected)
+    {
+        motion_detected = false;
+        finishEvent();
     }
 
-    if(video_saving_status != STOPPED)
-        stopSavingVideo();
+    saveBackgroundModel();
+    bus.close();
 
     emit frameCaptured(blankFrame);
     emit fgMaskCaptured(blankFrame);
@@ -182,6 +232,7 @@ void capture_thread::run()
     cap.release();
     setRunning(false);
 
+    thread_tuning::unregisterThread();
     qDebug()<<"stopped running.";
     emit RunComplete(true);
 }
@@ -195,37 +246,143 @@ void capture_thread::setVideoSavingStatus(VideoSavingStatus status)
 
 void capture_thread::startSavingVideo(cv::Mat &firstFrame)
 {
-    saved_video_name = utilities::newSavedVideoName();
+    saved_video_name = recording_prefix + utilities::newSavedVideoName();
 
     // generate a cover image for video.
     QString cover_path = utilities::getSavedVideoPath(saved_video_name, "jpg");
     cv::imwrite(cover_path.toStdString(), firstFrame);
 
-    // video save path.
-    QString video_saved_path = utilities::getSavedVideoPath(saved_video_name, "avi");
-    video_writer = new cv::VideoWriter(
-                video_saved_path.toStdString(),
-                cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
-                fps? fps:30,
-                cv::Size(frame_width, frame_height)
-                );
-    setVideoSavingStatus(STARTED);
-    saved_video_name = video_saved_path;
+    // open the main stream and its sub streams.
+    recorder->open(saved_video_name, cv::Size(frame_width, frame_height), fps? fps:config.default_fps);
+
+    // detection may have asked for a stop meanwhile, that one wins.
+    data_lock->lock();
+    if (video_saving_status == STARTING)
+        video_saving_status = STARTED;
+    data_lock->unlock();
+    saved_video_name = utilities::getSavedVideoPath(saved_video_name, "avi");
     emit videoRecordStatus(video_saving_status, saved_video_name);
 
 }
 
 void capture_thread::stopSavingVideo()
 {
-    setVideoSavingStatus( STOPPED );
-    if (video_writer != nullptr )
+    // a start asked for meanwhile opens the next recording on the next frame.
+    data_lock->lock();
+    if (video_saving_status != STARTING)
+        video_saving_status = STOPPED;
+    data_lock->unlock();
+    recorder->release();
+    emit videoRecordStatus(video_saving_status, saved_video_name);
+}
+
+QString capture_thread::recordingStats()
+{
+    return recorder->statsReport();
+}
+
+void capture_thread::setTileStorage(bool enable)
+{
+    data_lock->lock();
+    pending_config = config_pending ? pending_config : config;
+    pending_config.tile_storage = enable;
+    config_pending = true;
+    data_lock->unlock();
+}
+
+bool capture_thread::isTileStorage(){return config.tile_storage;}
+
+QString capture_thread::camName(){return QString::fromStdString(camname);}
+
+void capture_thread::applyConfig(camera_config new_config)
+{
+    // picked up by the capture loop before the next frame.
+    data_lock->lock();
+    pending_config = new_config;
+    config_pending = true;
+    data_lock->unlock();
+}
+
+camera_config capture_thread::activeConfig()
+{
+    data_lock->lock();
+    camera_config active = config;
+    data_lock->unlock();
+    return active;
+}
+
+void capture_thread::applyPendingConfig(cv::VideoCapture &cap)
+{
+    data_lock->lock();
+    camera_config old_config = config;
+    config = pending_config;
+    config_pending = false;
+    data_lock->unlock();
+
+    // the segmentor is tuned in place, its background model is kept.
+    if (segmentor != nullptr)
+    {
+        segmentor->setHistory(config.mog2_history);
+        segmentor->setVarThreshold(config.mog2_var_threshold);
+        segmentor->setDetectShadows(config.mog2_detect_shadows);
+    }
+    noise_kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(config.noise_size, config.noise_size));
+    tracker.setParameters(config.track_iou, config.track_min_hits, config.track_max_misses);
+    scene.setParameters(config.tamper_fg_ratio, config.tamper_hist_shift, config.tamper_sharpness_drop);
+    updateRecordStreams();
+    updateCompositor();
+    updateZones();
+
+    // a new resolution restarts a running recording at the new size.
+    if (cap.isOpened() && (config.frame_width != old_config.frame_width || config.frame_height != old_config.frame_height))
+    {
+        cap.set(cv::CAP_PROP_FRAME_WIDTH, config.frame_width);
+        cap.set(cv::CAP_PROP_FRAME_HEIGHT, config.frame_height);
+        frame_width=cap.get(cv::CAP_PROP_FRAME_WIDTH);
+        frame_height=cap.get(cv::CAP_PROP_FRAME_HEIGHT);
+        if (video_saving_status == STARTED)
+        {
+            stopSavingVideo();
+            setVideoSavingStatus(STARTING);
+        }
+    }
+
+    qDebug().noquote() << QString("%1 config applied : %2").arg(camName(),
+                QString(QJsonDocument(config.toJson()).toJson(QJsonDocument::Compact)));
+}
+
+void capture_thread::updateRecordStreams()
+{
+    QList<video_recorder::stream_config> streams;
+    int fourcc = cv::VideoWriter::fourcc(config.fourcc[0].toLatin1(), config.fourcc[1].toLatin1(),
+                                         config.fourcc[2].toLatin1(), config.fourcc[3].toLatin1());
+
+    // motion tiles take the place of the full resolution archive.
+    if (config.tile_storage)
+        streams.append(video_recorder::tileStream(config.main_quality));
+    else
     {
-        video_writer->release();
-        delete video_writer;
-        video_writer=nullptr;
+        video_recorder::stream_config main_stream;
+        main_stream.name = "main";
+        main_stream.fourcc = fourcc;
+        main_stream.quality = config.main_quality;
+        streams.append(main_stream);
+    }
 
+    if (config.sub_scale > 0)
+    {
+        video_recorder::stream_config sub_stream;
+        sub_stream.name = "sub";
+        sub_stream.scale = config.sub_scale;
+        sub_stream.fps_divisor = config.sub_fps_divisor;
+        sub_stream.fourcc = fourcc;
+        sub_stream.quality = config.sub_quality;
+        streams.append(sub_stream);
     }
-    emit videoRecordStatus(video_saving_status, saved_video_name);
+
+    // streams change with the next recording, the segment length at once.
+    recorder->setStreams(streams);
+    recorder->setSegmentSeconds(config.segment_seconds);
 }
 
 void capture_thread::setMirror(bool mirror)
@@ -252,78 +409,783 @@ void capture_thread::setMotionDetectingStatus(bool status){
     data_lock->unlock();
 }
 
+void capture_thread::applySegmentor(const cv::Mat &frame, cv::Mat &fg_mask, double learning_rate)
+{
+    if (analysis_scale < 1)
+    {
+        // a smaller model, the mask is scaled back so everything after works on frame pixels.
+        cv::resize(frame, analysis_frame, cv::Size(), analysis_scale, analysis_scale, cv::INTER_AREA);
+        segmentor->apply(analysis_frame, fg_mask, learning_rate);
+        if (!fg_mask.empty())
+            cv::resize(fg_mask, fg_mask, frame.size(), 0, 0, cv::INTER_NEAREST);
+    }
+    else
+        segmentor->apply(frame, fg_mask, learning_rate);
+}
+
 void capture_thread::motionDetect(cv::Mat &frame)
 {
     cv::Mat fgMask;
-    segmentor->apply(frame, fgMask);
+    applySegmentor(frame, fgMask, settle_frames > 0 ? settle_rate : -1);
 
     if (fgMask.empty())
         return;
 
-    //apply thresholding on fgmask
-    cv::threshold(fgMask, fgMask, 25, 255, cv::THRESH_BINARY);
+    // the model is relearning after a scene change, nothing is motion yet.
+    if (settle_frames > 0)
+    {
+        settle_frames--;
+        return;
+    }
+
+    // a change of the whole scene skips the morphology and contours.
+    if (config.tamper_detection)
+    {
+        scene_monitor::SceneChange change = scene.check(frame, fgMask);
+        if (change != scene_monitor::NONE)
+        {
+            handleSceneChange(frame, change);
+            return;
+        }
+    }
+
+    // every bit of foreground warms the heatmap, zones or not.
+    if (config.heatmap)
+        updateHeatmap(fgMask);
+
+    // apply thresholding on fgmask, per zone when the camera has zones.
+    zones.threshold(fgMask, fgMask, config.fg_threshold);
 
     // remove noise by erosion than dilation.
-    int noise_size = 9;
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(noise_size, noise_size));
-    cv::erode(fgMask, fgMask, kernel);
-    kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(noise_size, noise_size));
-    cv::dilate(fgMask, fgMask, kernel, cv::Point(-1, -1), 3);
+    cv::erode(fgMask, fgMask, noise_kernel);
+    cv::dilate(fgMask, fgMask, noise_kernel, cv::Point(-1, -1), config.dilate_iterations);
 
-    // update fgMaskToEmit
-    data_lock->lock();
-    cv::cvtColor(fgMask, fgMaskToEmit, cv::COLOR_GRAY2RGB);
-    data_lock->unlock();
+    float fg_ratio = float(cv::countNonZero(fgMask)) / fgMask.total();
+    trackModelStability(fg_ratio);
 
-    // update background image
+    // update background image, the BGR copy feeds the tile storage.
     data_lock->lock();
-    segmentor->getBackgroundImage(bgImageToEmit);
-    cv::cvtColor(bgImageToEmit, bgImageToEmit, cv::COLOR_BGR2RGB);
+    // a new image every frame, compose may still read the last one.
+    last_background.release();
+    segmentor->getBackgroundImage(last_background);
+    if (last_background.size() != frame.size())
+        cv::resize(last_background, last_background, frame.size(), 0, 0, cv::INTER_LINEAR);
     data_lock->unlock();
 
-    // emit background image and fgMaskToEmit
-    emit fgMaskCaptured(&fgMaskToEmit);
-    emit bgImageCaptured(&bgImageToEmit);
+    // update and emit fgMaskToEmit and the background image, unless memory is short.
+    if (memory_level < memory_governor::NO_DISPLAY_COPIES)
+    {
+        data_lock->lock();
+        cv::cvtColor(fgMask, fgMaskToEmit, cv::COLOR_GRAY2RGB);
+        cv::cvtColor(last_background, bgImageToEmit, cv::COLOR_BGR2RGB);
+        data_lock->unlock();
+        emit fgMaskCaptured(&fgMaskToEmit);
+        emit bgImageCaptured(&bgImageToEmit);
+    }
+
+    // keep the mask for the overlay stream.
+    last_fg_mask = fgMask;
 
-    // find contours
+    // find contours, outer ones only, a hole is not another object.
     std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(fgMask, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+    cv::findContours(fgMask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+    // bounding boxes of the moving objects.
+    std::vector<cv::Rect> blobs;
+    motion_zones.clear();
+    for(size_t i=0; i<contours.size(); i++)
+    {
+        cv::Rect blob = cv::boundingRect(contours[i]);
+
+        // with zones a blob only counts inside an armed one and big enough for it.
+        if (!zones.isEmpty())
+        {
+            int zone = zones.zoneOf(fgMask, blob);
+            if (zone < 0)
+                continue;
+            if (!motion_zones.contains(zones.zoneName(zone)))
+                motion_zones.append(zones.zoneName(zone));
+        }
+        blobs.push_back(blob);
+    }
 
-    // motion detecting using contours.
-    bool has_motion = contours.size() > 0;
+    // follow the blobs over frames, confirmed tracks are the motion.
+    tracker.update(blobs, QDateTime::currentMSecsSinceEpoch());
+    bool has_motion = tracker.confirmedCount() > 0;
+    std::vector<finished_track> done = tracker.takeFinished();
+    if (motion_detected)
+        current_event.tracks.insert(current_event.tracks.end(), done.begin(), done.end());
 
     // update the statuses
     if(!motion_detected && has_motion)
     {
         motion_detected = true;
-        setVideoSavingStatus(STARTING);
+        beginEvent(frame);
+
+        // with classes configured only a matching object starts the recording.
+        object_detector *detector = object_detector::instance();
+        awaiting_class = !wantedClasses().isEmpty() && detector != nullptr && detector->isReady();
+        if (!awaiting_class)
+            triggerEvent(motion_zones.isEmpty() ? QString("motion detected")
+                                                : "motion detected in " + motion_zones.join(", "));
 //        qDebug() << "new motion detected. ";
     }
     else if (motion_detected && !has_motion)
     {
         motion_detected=false;
-        setVideoSavingStatus(STOPPING);
+        if (!awaiting_class)
+            setVideoSavingStatus(STOPPING);
+        awaiting_class = false;
+        finishEvent();
     }
 
-    // create rectangles around moving objects
-    cv::Scalar color = cv::Scalar(0, 0, 255);
-    int max_area=0;
-    cv::Rect choosen_rect;
+    // crops are taken before anything is drawn on the frame.
+    if (motion_detected)
+        classifyBlobs(frame, blobs);
 
-    // find the biggest rectangle and draw it.
-    for(size_t i=0; i<contours.size(); i++)
+    last_blobs = blobs;
+
+    // keep the blobs of the strongest frame of the event.
+    if (motion_detected)
+    {
+        if (fg_ratio >= current_event.motion_score)
+        {
+            current_event.motion_score = fg_ratio;
+            current_event.blobs = blobs;
+        }
+    }
+
+    addOverlays();
+}
+
+void capture_thread::addOverlays()
+{
+    // the tracks with their id, dwell time and trail.
+    for (int i=0; i<tracker.size(); i++)
+    {
+        if (!tracker.isConfirmed(i))
+            continue;
+
+        // a stable colour per id.
+        int id = tracker.trackId(i);
+        cv::Scalar color((id * 67) % 200 + 55, (id * 139) % 200 + 55, (id * 29) % 200 + 55);
+
+        std::vector<cv::Point> trail = tracker.trail(i);
+        for (size_t k=1; k<trail.size(); k++)
+            overlay_lines.push_back({trail[k - 1], trail[k], color});
+
+        overlay_box box;
+        box.box = tracker.box(i);
+        box.color = color;
+        box.thickness = 2;
+        box.label = cv::format("#%d %.1fs", id, tracker.dwellSeconds(i));
+        overlay_boxes.push_back(box);
+    }
+
+    // and the classified objects with their label.
+    foreach(detection found, last_detections)
+    {
+        overlay_box box;
+        box.box = found.box;
+        box.color = cv::Scalar(0, 255, 0);
+        box.label = QString("%1 %2").arg(found.label).arg(found.confidence, 0, 'f', 2).toStdString();
+        overlay_boxes.push_back(box);
+    }
+}
+
+void capture_thread::updateCompositor()
+{
+    QList<QPolygon> polygons;
+    QString error;
+    camera_config::parsePolygons(config.privacy_masks, polygons, error);
+    compositor.setPrivacyMasks(polygons);
+    compositor.setCaption(config.overlay_timestamp,
+                          config.overlay_label.isEmpty() ? camName() : config.overlay_label,
+                          config.overlay_scale);
+}
+
+void capture_thread::updateZones()
+{
+    zones.setZones(config.zones);
+    heatmap.setHalfLife(config.heatmap_half_life_s);
+    if (!config.heatmap)
+        heatmap.clear();
+}
+
+void capture_thread::updateHeatmap(const cv::Mat &raw_fg_mask)
+{
+    qint64 now_ms = QDateTime::currentMSecsSinceEpoch();
+    heatmap.update(raw_fg_mask, now_ms);
+
+    // the colours are only worth a frame now and then.
+    if (now_ms - heatmap_emit_ms < heatmap_emit_interval_ms || memory_level >= memory_governor::NO_DISPLAY_COPIES)
+        return;
+    heatmap_emit_ms = now_ms;
+
+    data_lock->lock();
+    heatmap.render(last_background, heatmapToEmit);
+    data_lock->unlock();
+    if (!heatmapToEmit.empty())
+        emit heatmapCaptured(&heatmapToEmit);
+}
+
+QString capture_thread::zoneStats()
+{
+    return zones.statsReport() + heatmap.statsReport();
+}
+
+void capture_thread::warmBackgroundModel()
+{
+    cv::Mat background = cv::imread(utilities::backgroundModelPath(camName()).toStdString());
+    if (background.empty() || background.cols != frame_width || background.rows != frame_height)
+        return;
+    if (analysis_scale < 1)
+        cv::resize(background, background, cv::Size(), analysis_scale, analysis_scale, cv::INTER_AREA);
+
+    // the first apply makes the image the whole model, the repeats give it
+    // the weight of a few frames so live frames refine it instead of replacing it.
+    cv::Mat mask;
+    segmentor->apply(background, mask, 1.0);
+    for (int i=1; i<warm_frames; i++)
+        segmentor->apply(background, mask);
+    model_warm = true;
+}
+
+void capture_thread::saveBackgroundModel()
+{
+    // only a model that settled is worth starting from next time.
+    if (segmentor == nullptr || stable_ms < 0)
+        return;
+
+    cv::Mat background;
+    segmentor->getBackgroundImage(background);
+    if (background.empty())
+        return;
+
+    // a model reduced to save memory is stored at frame size, like any other.
+    if (background.size() != cv::Size(frame_width, frame_height))
+        cv::resize(background, background, cv::Size(frame_width, frame_height), 0, 0, cv::INTER_LINEAR);
+
+    // written aside and renamed, a crash never leaves half an image.
+    QString path = utilities::backgroundModelPath(camName());
+    QString tmp_path = path.left(path.size() - 4) + ".tmp.png";
+    if (cv::imwrite(tmp_path.toStdString(), background))
+    {
+        QFile::remove(path);
+        QFile::rename(tmp_path, path);
+    }
+}
+
+void capture_thread::trackModelStability(float fg_ratio)
+{
+    if (model_started_ms < 0)
+        model_started_ms = startup_timer.nsecsElapsed() / 1e6;
+    model_frames++;
+    if (stable_ms >= 0)
+        return;
+
+    stable_run = fg_ratio < stable_ratio ? stable_run + 1 : 0;
+    if (stable_run >= stable_frames)
+    {
+        stable_ms = startup_timer.nsecsElapsed() / 1e6;
+        stable_frame = model_frames;
+        qDebug().noquote() << startupStats();
+    }
+}
+
+QString capture_thread::startupStats()
+{
+    QString report = QString("startup (%1) : open %2 ms, first frame %3 ms\n")
+            .arg(camName()).arg(open_ms, 0, 'f', 0).arg(first_frame_ms, 0, 'f', 0);
+
+    QString model = model_warm ? "warm" : "cold";
+    if (stable_ms >= 0)
+        report += QString("  %1 background model stable after %2 frames, %3 ms of detection\n")
+                .arg(model).arg(stable_frame).arg(stable_ms - model_started_ms, 0, 'f', 0);
+    else if (model_started_ms >= 0)
+        report += QString("  %1 background model not stable yet, %2 frames\n").arg(model).arg(model_frames);
+    else
+        report += QString("  %1 background model, detection off\n").arg(model);
+    return report;
+}
+
+void capture_thread::handleSceneChange(cv::Mat &frame, scene_monitor::SceneChange change)
+{
+    // the new scene is the background from now on, the old tracks are gone.
+    // a running event ends by itself once the model has settled.
+    cv::Mat mask;
+    applySegmentor(frame, mask, 1.0);
+    settle_frames = config.tamper_settle_frames;
+    tracker.clear();
+
+    // reported as its own event instead of a recording.
+    QString kind = scene_monitor::changeName(change);
+    qDebug() << camName() << " : " << kind;
+    utilities::notifyMobile(camName(), kind);
+
+    journal_event event;
+    event.camname = camName();
+    event.kind = kind;
+    event.start_ms = event.end_ms = QDateTime::currentMSecsSinceEpoch();
+    event.motion_score = scene.lastFgRatio();
+    cv::Mat redacted, small;
+    compositor_lock.lock();
+    compositor.redact(frame, redacted);
+    compositor_lock.unlock();
+    double scale = 320.0 / frame.cols;
+    cv::resize(redacted, small, cv::Size(), scale, scale, cv::INTER_AREA);
+    std::vector<uchar> jpeg;
+    cv::imencode(".jpg", small, jpeg, {cv::IMWRITE_JPEG_QUALITY, 70});
+    event.snapshot = QByteArray(reinterpret_cast<const char*>(jpeg.data()), jpeg.size());
+
+    event_journal *journal = event_journal::instance();
+    if (journal != nullptr)
+        journal->append(event);
+}
+
+QString capture_thread::sceneStats()
+{
+    return scene.statsReport();
+}
+
+QString capture_thread::compositorStats()
+{
+    return compositor.statsReport();
+}
+
+QString capture_thread::frameBusStats()
+{
+    return bus.statsReport();
+}
+
+void capture_thread::buildGraph()
+{
+    //            +-> motion (detector)
+    //  capture --+
+    //            +-> compose --+-> display
+    //                          +-> record
+    //                          +-> stream
+    //                          +-> frame bus
+    source_node = graph.addSource("capture");
+    pipeline_node *motion = graph.addNode("motion", pipeline_node::DETECTOR,
+            [this](frame_packet &packet){return detectStage(packet);}, 2, pipeline_node::DROP_OLDEST);
+    pipeline_node *compose = graph.addNode("compose", pipeline_node::TRANSFORM,
+            [this](frame_packet &packet){return composeStage(packet);}, 2, pipeline_node::BLOCK);
+    pipeline_node *display = graph.addNode("display", pipeline_node::SINK,
+            [this](frame_packet &packet){return displayStage(packet);}, 1, pipeline_node::DROP_OLDEST);
+    pipeline_node *record = graph.addNode("record", pipeline_node::SINK,
+            [this](frame_packet &packet){return recordStage(packet);}, 8, pipeline_node::BLOCK);
+    pipeline_node *stream = graph.addNode("stream", pipeline_node::SINK,
+            [this](frame_packet &packet){return streamStage(packet);}, 1, pipeline_node::DROP_OLDEST);
+    pipeline_node *bus_sink = graph.addNode("frame bus", pipeline_node::SINK,
+            [this](frame_packet &packet){return busStage(packet);}, 1, pipeline_node::DROP_OLDEST);
+
+    graph.connect(source_node, motion);
+    graph.connect(source_node, compose);
+    graph.connect(compose, display);
+    graph.connect(compose, record);
+    graph.connect(compose, stream);
+    graph.connect(compose, bus_sink);
+}
+
+bool capture_thread::detectStage(frame_packet &packet)
+{
+    // detection works on the frame as captured, the compositor mirrors the boxes.
+    overlay_boxes.clear();
+    overlay_lines.clear();
+    last_blobs.clear();
+    if (motion_detecting_status && segmentor != nullptr)
+        motionDetect(packet.frame);
+    else if (!last_fg_mask.empty())
     {
-        cv::Rect rect = cv::boundingRect(contours[i]);
-        if (rect.area() > max_area)
+        last_fg_mask.release();
+        last_background.release();
+        tracker.clear();
+    }
+
+    // compose takes the newest result, it does not wait for this frame's.
+    analysis_lock.lock();
+    analysis.boxes = overlay_boxes;
+    analysis.lines = overlay_lines;
+    analysis.blobs = last_blobs;
+    analysis.fg_mask = last_fg_mask;
+    analysis.background = last_background;
+    analysis.motion = motion_detected;
+    analysis_lock.unlock();
+    return true;
+}
+
+bool capture_thread::composeStage(frame_packet &packet)
+{
+    analysis_lock.lock();
+    frame_analysis latest = analysis;
+    analysis_lock.unlock();
+
+    // the event snapshots of the detector use it too.
+    QMutexLocker locker(&compositor_lock);
+
+    // a recycled packet may still share these with a sink of an older one,
+    // the screen keeps showing its rgb until the next frame arrives.
+    packet.bgr.release();
+    packet.rgb.release();
+    packet.fg_mask.release();
+    packet.background.release();
+    packet.clean.release();
+
+    // mirror, privacy masks, caption and boxes in one pass, BGR for the
+    // recorder and the streams, RGB for the screen.
+    compositor.setMirror(doMirror);
+    compositor.compose(packet.frame, latest.boxes, latest.lines, packet.bgr, packet.rgb);
+    packet.caption = compositor.captionRect();
+
+    // the mask and background have to line up with the composed frame.
+    if (stream_overlay || config.frame_bus || (video_saving_status == STARTED && isTileStorage()))
+    {
+        compositor.redact(latest.fg_mask, packet.fg_mask);
+        compositor.redact(latest.background, packet.background);
+    }
+
+    // the frame bus gets the frame without overlays.
+    packet.motion = latest.motion;
+    packet.blobs = latest.blobs;
+    if (config.frame_bus)
+    {
+        compositor.redact(packet.frame, packet.clean);
+        if (doMirror)
         {
-            max_area = rect.area();
-            choosen_rect = rect;
+            for (cv::Rect &blob : packet.blobs)
+                blob.x = packet.frame.cols - blob.x - blob.width;
         }
     }
-    cv::rectangle(frame, choosen_rect, color, 1);
+    return true;
+}
 
+bool capture_thread::displayStage(frame_packet &packet)
+{
+    data_lock->lock();
+    frame = packet.rgb;
+    if (frame_latency_ms.size() >= latency_samples)
+        frame_latency_ms.erase(frame_latency_ms.begin(), frame_latency_ms.begin() + latency_samples / 2);
+    frame_latency_ms.push_back(packet.clock.nsecsElapsed() / 1e6);
+    data_lock->unlock();
+    emit frameCaptured(&frame);
+    return true;
 }
 
+bool capture_thread::recordStage(frame_packet &packet)
+{
+    data_lock->lock();
+    VideoSavingStatus status = video_saving_status;
+    data_lock->unlock();
+
+    if(status == STARTING)
+        startSavingVideo(packet.bgr);
+
+    else if(status == STARTED)
+        recorder->write(packet.bgr, packet.fg_mask, packet.background, packet.caption);
+
+    else if(status == STOPPING)
+        stopSavingVideo();
+    return true;
+}
+
+bool capture_thread::streamStage(frame_packet &packet)
+{
+    if (stream_live || stream_overlay)
+        encodeStreams(packet.bgr, packet.fg_mask);
+    return true;
+}
+
+bool capture_thread::busStage(frame_packet &packet)
+{
+    if (!config.frame_bus)
+    {
+        if (bus.isOpen())
+            bus.close();
+        return true;
+    }
+
+    // a new resolution or ring size makes a new segment.
+    if (!bus.isOpen() || bus.frameSize() != packet.clean.size() || bus_slots != busSlots())
+    {
+        bus_slots = busSlots();
+        if (!bus.open(utilities::frameBusName(camName()), camName(), packet.clean.cols, packet.clean.rows, bus_slots))
+            return true;
+    }
+    bus.publish(packet.clean, packet.fg_mask, packet.blobs, packet.motion, packet.timestamp_us);
+    return true;
+}
+
+int capture_thread::busSlots()
+{
+    return memory_level >= memory_governor::SMALL_BUFFERS ? 2 : config.frame_bus_slots;
+}
+
+void capture_thread::applyMemoryLevel(int level)
+{
+    qDebug().noquote() << QString("%1 : memory %2").arg(camName(), memory_governor::levelName(memory_governor::Level(level)));
+    memory_level = level;
+
+    // the gui copies of the mask, background and heatmap.
+    if (level >= memory_governor::NO_DISPLAY_COPIES)
+    {
+        data_lock->lock();
+        fgMaskToEmit.release();
+        bgImageToEmit.release();
+        heatmapToEmit.release();
+        data_lock->unlock();
+    }
+
+    // a new model size relearns the background, quietly like after a scene change.
+    double scale = level >= memory_governor::REDUCED_ANALYSIS ? reduced_analysis_scale : 1.0;
+    if (scale != analysis_scale)
+    {
+        analysis_scale = scale;
+        analysis_frame.release();
+        settle_frames = config.tamper_settle_frames;
+        tracker.clear();
+    }
+
+    // the queues and the spare packets, the frame bus follows on its next frame.
+    if (level >= memory_governor::SMALL_BUFFERS)
+        graph.setLimits(1, 0);
+    else
+        graph.setLimits(0, 32);
+
+    emit memoryLevelChanged(level);
+}
+
+void capture_thread::accountMemory()
+{
+    qint64 now_ms = QDateTime::currentMSecsSinceEpoch();
+    if (now_ms - memory_account_ms < memory_account_interval_ms)
+        return;
+    memory_account_ms = now_ms;
+
+    // estimates from the sizes, the mats themselves belong to other threads.
+    qint64 area = qint64(frame_width) * frame_height;
+    qint64 analysis_area = qint64(area * analysis_scale * analysis_scale);
+    QMap<QString, qint64> bytes;
+
+    // a packet : frame, composed BGR and RGB, mask, background and the clean copy.
+    bytes["capture"] = graph.packetCount() * area * (3 + 3 + 3 + 1 + 3 + (config.frame_bus ? 3 : 0));
+
+    // MOG2 keeps weight, variance and a mean per channel for every mixture of
+    // every pixel, in floats, plus the mixture count.
+    int mixtures = segmentor != nullptr ? segmentor->getNMixtures() : 0;
+    bytes["analysis"] = segmentor != nullptr ? analysis_area * (mixtures * (2 + 3) * 4 + 1) + area * (1 + 3) : 0;
+    if (!zones.isEmpty())
+        bytes["analysis"] += area * 2;
+
+    data_lock->lock();
+    bytes["display"] = qint64(frame.total() * frame.elemSize()) + qint64(fgMaskToEmit.total() * fgMaskToEmit.elemSize())
+            + qint64(bgImageToEmit.total() * bgImageToEmit.elemSize()) + qint64(heatmapToEmit.total() * heatmapToEmit.elemSize());
+    data_lock->unlock();
+
+    bytes["buffers"] = config.frame_bus ? busSlots() * area * 4 : 0;
+    memory_governor::account(camName(), bytes);
+}
+
+QString capture_thread::pipelineStats()
+{
+    return graph.statsReport();
+}
+
+void capture_thread::setRecordingPrefix(QString prefix)
+{
+    data_lock->lock();
+    recording_prefix = prefix;
+    data_lock->unlock();
+}
+
+std::vector<float> capture_thread::takeFrameLatencies()
+{
+    std::vector<float> taken;
+    data_lock->lock();
+    taken.swap(frame_latency_ms);
+    data_lock->unlock();
+    return taken;
+}
+
+void capture_thread::triggerEvent(QString message)
+{
+    setVideoSavingStatus(STARTING);
+    utilities::notifyMobile(camName(), message);
+}
+
+QStringList capture_thread::wantedClasses()
+{
+    QStringList wanted;
+    foreach(QString name, config.detect_classes.split(','))
+    {
+        if (!name.trimmed().isEmpty())
+            wanted.append(name.trimmed());
+    }
+    return wanted;
+}
+
+void capture_thread::classifyBlobs(cv::Mat &frame, const std::vector<cv::Rect> &blobs)
+{
+    object_detector *detector = object_detector::instance();
+    if (detector == nullptr)
+        return;
+
+    detection_result result;
+    if (detector->takeResult(camName(), result))
+    {
+        classify_pending = false;
+        if (result.id == current_event.start_ms)
+            applyDetections(result);
+    }
+
+    // one request in flight per camera, none once the event has a wanted class
+    // (or any label without classes) or the detector skipped it.
+    if (classify_pending || classify_done || !detector->isReady())
+        return;
+
+    // the largest blobs, with a margin so the object is not cut off.
+    std::vector<cv::Rect> sorted = blobs;
+    std::sort(sorted.begin(), sorted.end(), [](const cv::Rect &a, const cv::Rect &b) { return a.area() > b.area(); });
+    std::vector<cv::Mat> crops;
+    std::vector<cv::Rect> boxes;
+    cv::Rect bounds(0, 0, frame.cols, frame.rows);
+    for (size_t i=0; i<sorted.size() && int(crops.size()) < config.detect_max_crops; i++)
+    {
+        cv::Rect box = sorted[i];
+        if (box.width < config.detect_min_size || box.height < config.detect_min_size)
+            break;
+        int margin = qMax(box.width, box.height) / 10;
+        box = cv::Rect(box.x - margin, box.y - margin, box.width + 2 * margin, box.height + 2 * margin) & bounds;
+        crops.push_back(frame(box).clone());
+        boxes.push_back(box);
+    }
+    if (crops.empty())
+        return;
+
+    classify_pending = detector->submit(camName(), current_event.start_ms, crops, boxes);
+    if (!classify_pending)
+    {
+        detection_result skipped;
+        skipped.id = current_event.start_ms;
+        skipped.skipped = true;
+        applyDetections(skipped);
+    }
+}
+
+void capture_thread::applyDetections(const detection_result &result)
+{
+    // a detector under load never holds back a recording.
+    if (result.skipped)
+    {
+        classify_done = true;
+        if (awaiting_class)
+        {
+            awaiting_class = false;
+            triggerEvent("motion detected, not classified");
+        }
+        return;
+    }
+
+    last_detections = result.detections;
+    QStringList wanted = wantedClasses();
+    float best = 0;
+    foreach(detection found, result.detections)
+    {
+        bool is_wanted = wanted.contains(found.label);
+        if (found.confidence > best || is_wanted)
+        {
+            best = found.confidence;
+            current_label = found.label;
+        }
+        if (is_wanted)
+        {
+            classify_done = true;
+            if (awaiting_class)
+            {
+                awaiting_class = false;
+                triggerEvent(found.label + " detected");
+            }
+            break;
+        }
+    }
+
+    // without classes the first label is all the event needs, an unwanted
+    // one keeps the crops coming while the event lasts.
+    if (wanted.isEmpty() && !current_label.isEmpty())
+        classify_done = true;
+}
+
+void capture_thread::beginEvent(cv::Mat &frame)
+{
+    current_event = journal_event();
+    current_event.camname = camName();
+    current_label.clear();
+    last_detections.clear();
+    classify_pending = false;
+    classify_done = false;
+    current_event.start_ms = QDateTime::currentMSecsSinceEpoch();
+
+    // a small snapshot, taken before the box is drawn but with the privacy masks.
+    cv::Mat redacted, small;
+    compositor_lock.lock();
+    compositor.redact(frame, redacted);
+    compositor_lock.unlock();
+    double scale = 320.0 / frame.cols;
+    cv::resize(redacted, small, cv::Size(), scale, scale, cv::INTER_AREA);
+    std::vector<uchar> jpeg;
+    cv::imencode(".jpg", small, jpeg, {cv::IMWRITE_JPEG_QUALITY, 70});
+    current_event.snapshot = QByteArray(reinterpret_cast<const char*>(jpeg.data()), jpeg.size());
+}
+
+void capture_thread::finishEvent()
+{
+    current_event.end_ms = QDateTime::currentMSecsSinceEpoch();
+    last_detections.clear();
+
+    // the journal thread does the writing.
+    event_journal *journal = event_journal::instance();
+    if (journal != nullptr && current_event.start_ms > 0)
+        journal->append(current_event);
+    current_event = journal_event();
+}
+
+
+void capture_thread::encodeStreams(cv::Mat &frame, const cv::Mat &fg_mask)
+{
+    std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, config.stream_quality};
+    std::vector<uchar> buffer;
+    QElapsedTimer timer;
+
+    // encode once, the server fans the same buffer out to every client.
+    if (stream_live)
+    {
+        timer.start();
+        cv::imencode(".jpg", frame, buffer, params);
+        QByteArray jpeg(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        emit jpegEncoded("live", jpeg, timer.nsecsElapsed() / 1e6);
+    }
+
+    if (stream_overlay)
+    {
+        timer.start();
+        cv::Mat overlay = frame.clone();
+        if (!fg_mask.empty() && fg_mask.size() == frame.size())
+            overlay.setTo(cv::Scalar(0, 0, 255), fg_mask);
+        cv::imencode(".jpg", overlay, buffer, params);
+        QByteArray jpeg(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        emit jpegEncoded("overlay", jpeg, timer.nsecsElapsed() / 1e6);
+    }
+}
+
+void capture_thread::setStreamDemand(QString stream, bool wanted)
+{
+    data_lock->lock();
+    if (stream == "live")
+        stream_live = wanted;
+    else if (stream == "overlay")
+        stream_overlay = wanted;
+    data_lock->unlock();
+}
 
 void capture_thread::setPause(bool doPause)
 {
@@ -4,10 +4,24 @@
 #include <QString>
 #include <QThread>
 #include <QMutex>
+#include <QByteArray>
+#include <QStringList>
+#include <QElapsedTimer>
 #include <string>
 #include <opencv2/opencv.hpp>
 #include <opencv2/videoio.hpp>
 #include <opencv2/video/background_segm.hpp>
+#include "video_recorder.h"
+#include "pipeline_config.h"
+#include "event_journal.h"
+#include "object_detector.h"
+#include "blob_tracker.h"
+#include "scene_monitor.h"
+#include "frame_compositor.h"
+#include "frame_bus.h"
+#include "pipeline_graph.h"
+#include "zone_map.h"
+#include "activity_heatmap.h"
 
 class capture_thread : public QThread
 {
@@ -35,6 +49,21 @@ public:
     void setMotionDetectingStatus(bool);
     void setVideoMode(QString);
     void setWebcamMode();
+    void setStreamDemand(QString stream, bool wanted);
+    QString recordingStats();
+    void setTileStorage(bool);
+    bool isTileStorage();
+    void applyConfig(camera_config);
+    camera_config activeConfig();
+    QString camName();
+    QString startupStats();
+    QString sceneStats();
+    QString compositorStats();
+    QString frameBusStats();
+    QString pipelineStats();
+    QString zoneStats();
+    void setRecordingPrefix(QString prefix);
+    std::vector<float> takeFrameLatencies();
 
 private:
     bool generateFrames(cv::VideoCapture &cap, cv::Mat &tmp_frame);
@@ -47,14 +76,45 @@ private:
     void startSavingVideo(cv::Mat &firstFrame);
     void stopSavingVideo();
     void motionDetect(cv::Mat &frame);
+    void applySegmentor(const cv::Mat &frame, cv::Mat &fg_mask, double learning_rate);
+    void encodeStreams(cv::Mat &frame, const cv::Mat &fg_mask);
+    void beginEvent(cv::Mat &frame);
+    void triggerEvent(QString message);
+    void handleSceneChange(cv::Mat &frame, scene_monitor::SceneChange change);
+    QStringList wantedClasses();
+    void classifyBlobs(cv::Mat &frame, const std::vector<cv::Rect> &blobs);
+    void applyDetections(const detection_result &result);
+    void finishEvent();
+    void applyPendingConfig(cv::VideoCapture &cap);
+    void updateRecordStreams();
+    void updateCompositor();
+    void addOverlays();
+    void updateZones();
+    void updateHeatmap(const cv::Mat &raw_fg_mask);
+    void applyMemoryLevel(int level);
+    void accountMemory();
+    int busSlots();
+    void buildGraph();
+    bool detectStage(frame_packet &packet);
+    bool composeStage(frame_packet &packet);
+    bool displayStage(frame_packet &packet);
+    bool recordStage(frame_packet &packet);
+    bool streamStage(frame_packet &packet);
+    bool busStage(frame_packet &packet);
+    void warmBackgroundModel();
+    void saveBackgroundModel();
+    void trackModelStability(float fg_ratio);
 
 signals:
     void frameCaptured(cv::Mat *data);
     void fgMaskCaptured(cv::Mat *data);
     void bgImageCaptured(cv::Mat *data);
+    void heatmapCaptured(cv::Mat *data);
+    void memoryLevelChanged(int level);
     void fpsChanged(float fps, int width, int height);
     void videoRecordStatus(int status, QString saved_video_name);
     void RunComplete(bool);
+    void jpegEncoded(QString stream, QByteArray jpeg, double encode_ms);
 
 private:
     bool running;
@@ -75,12 +135,90 @@ private:
     int frame_width, frame_height;
     VideoSavingStatus video_saving_status;
     QString saved_video_name;
-    cv::VideoWriter *video_writer;
+    video_recorder *recorder;
 
     // motion detecting parameters
     bool motion_detecting_status=false;
     bool motion_detected=false;
     cv::Ptr<cv::BackgroundSubtractorMOG2> segmentor=nullptr;
+    cv::Mat last_fg_mask;
+    cv::Mat last_background;
+    cv::Mat noise_kernel;
+    journal_event current_event;
+    blob_tracker tracker;
+    scene_monitor scene;
+    int settle_frames=0;
+
+    // motion rules per region and where motion was seen, see zone_map.
+    zone_map zones;
+    QStringList motion_zones;
+    activity_heatmap heatmap;
+    cv::Mat heatmapToEmit;
+    qint64 heatmap_emit_ms=0;
+
+    // burned in overlays, drawn by the compositor after motion detection.
+    frame_compositor compositor;
+    QMutex compositor_lock;
+    std::vector<overlay_box> overlay_boxes;
+    std::vector<overlay_line> overlay_lines;
+
+    // the frame, mask and blobs for other processes.
+    frame_bus bus;
+    int bus_slots=0;
+    std::vector<cv::Rect> last_blobs;
+
+    // what the detector found last, compose takes a copy for every frame.
+    struct frame_analysis{
+        std::vector<overlay_box> boxes;
+        std::vector<overlay_line> lines;
+        std::vector<cv::Rect> blobs;
+        cv::Mat fg_mask;
+        cv::Mat background;
+        bool motion=false;
+    };
+    QMutex analysis_lock;
+    frame_analysis analysis;
+
+    // capture -> motion, compose -> display, record, stream, frame bus.
+    pipeline_graph graph;
+    pipeline_node *source_node=nullptr;
+
+    // object classes of the current event, see object_detector.
+    bool awaiting_class=false;
+    bool classify_pending=false;
+    bool classify_done=false;
+    QString current_label;
+    QList<detection> last_detections;
+
+    // startup metrics, ms since run() began, -1 until reached.
+    QElapsedTimer startup_timer;
+    double open_ms=-1;
+    double first_frame_ms=-1;
+    double model_started_ms=-1;
+    double stable_ms=-1;
+    int model_frames=0;
+    int stable_frame=0;
+    int stable_run=0;
+    bool model_warm=false;
+
+    // applied memory_governor level, changed only while the graph is idle.
+    int memory_level=0;
+    double analysis_scale=1.0;
+    cv::Mat analysis_frame;
+    qint64 memory_account_ms=0;
+
+    // read to display time of recent frames, taken by the benchmark.
+    std::vector<float> frame_latency_ms;
+    QString recording_prefix;
+
+    // active configuration, replaced between frames by applyPendingConfig.
+    camera_config config;
+    camera_config pending_config;
+    bool config_pending=false;
+
+    // network streaming, frames are only encoded while someone watches.
+    bool stream_live=false;
+    bool stream_overlay=false;
 
     //open a video mode.
     bool webcam_mode;
@@ -0,0 +1,446 @@
+#include "clip_export.h"
+#include "avi_mjpeg_reader.h"
+#include "avi_mjpeg_writer.h"
+#include "utilities.h"
+#include "pipeline_config.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QThreadPool>
+#include <QRegularExpression>
+#include <QtConcurrent/QtConcurrent>
+#include <cmath>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+static const QString name_format = "yyyy-MM-dd+HH:mm:ss";
+// a grey level change that counts, and the share of changed pixels that
+// makes a frame worth keeping in a motion summary.
+static const int motion_pixel_delta = 25;
+static const double motion_changed_ratio = 0.005;
+// a last segment modified later than this after its end was rewritten
+// (recovered, copied), its time says nothing about the recording.
+static const qint64 max_close_delay_ms = 10000;
+
+static QString option(const QStringList &arguments, QString name, QString fallback)
+{
+    int index = arguments.indexOf(name);
+    if (index < 0 || index + 1 >= arguments.size())
+        return fallback;
+    return arguments[index + 1];
+}
+
+static qint64 clipEndMs(const clip_export::clip &source)
+{
+    return source.start.toMSecsSinceEpoch() + source.duration_ms;
+}
+
+QString clip_export::report::toString() const
+{
+    double read_mb = bytes_read / 1048576.0;
+    double written_mb = bytes_written / 1048576.0;
+    QString text = QString("%1 clips, %2 of %3 frames, %4 MB read, %5 MB written in %6 s : %7 MB/s read, %8 MB/s written, %9 threads")
+            .arg(clips).arg(frames_out).arg(frames_in)
+            .arg(read_mb, 0, 'f', 1).arg(written_mb, 0, 'f', 1).arg(seconds, 0, 'f', 2)
+            .arg(seconds > 0 ? read_mb / seconds : 0.0, 0, 'f', 0)
+            .arg(seconds > 0 ? written_mb / seconds : 0.0, 0, 'f', 0)
+            .arg(threads);
+    foreach(QString skip, skipped)
+        text += "\nskipped " + skip;
+    return text;
+}
+
+QVector<clip_export::clip> clip_export::findClips(QString dir, QString prefix, QDateTime from, QDateTime to,
+                                                  double segment_seconds)
+{
+    qint64 segment_ms = qRound64(segment_seconds * 1000);
+
+    // <prefix><start>[.partNNN].avi, sub streams and exports do not match.
+    QRegularExpression pattern("^(.*)(\\d{4}-\\d{2}-\\d{2}\\+\\d{2}:\\d{2}:\\d{2})(\\.part(\\d{3}))?\\.avi$");
+    QDir data_dir(dir);
+
+    // start -> segment number -> file, the name format sorts by time.
+    QMap<QString, QMap<int, QString>> recordings;
+    foreach(QString file, data_dir.entryList(QStringList("*.avi"), QDir::Files))
+    {
+        QRegularExpressionMatch match = pattern.match(file);
+        if (!match.hasMatch() || match.captured(1) != prefix)
+            continue;
+        QDateTime start = QDateTime::fromString(match.captured(2), name_format);
+        if (!start.isValid() || start > to)
+            continue;
+        recordings[match.captured(2)][match.captured(4).toInt()] = data_dir.absoluteFilePath(file);
+    }
+
+    // newest first, only the files of the recordings that reach into the range are opened.
+    QVector<clip> found;
+    QMap<QString, QMap<int, QString>>::iterator it = recordings.end();
+    while (it != recordings.begin())
+    {
+        --it;
+        QVector<clip> parts;
+        qint64 recording_ms = QDateTime::fromString(it.key(), name_format).toMSecsSinceEpoch();
+        QDateTime next_start = QDateTime::fromMSecsSinceEpoch(recording_ms);
+        for (QMap<int, QString>::iterator part_it = it.value().begin(); part_it != it.value().end(); ++part_it)
+        {
+            avi_mjpeg_reader reader;
+            if (!reader.open(part_it.value()) || reader.packetCount() == 0)
+                continue;
+            clip part;
+            part.path = part_it.value();
+            part.packets = reader.packetCount();
+            part.size = reader.frameSize();
+
+            // segments rotate on the wall clock, without them only the first file exists.
+            int number = part_it.key();
+            qint64 start_ms = segment_ms > 0 ? recording_ms + number * segment_ms : next_start.toMSecsSinceEpoch();
+            part.start = QDateTime::fromMSecsSinceEpoch(start_ms);
+
+            // up to the next segment, or to the last write of the file.
+            qint64 nominal_ms = qRound64(part.packets * 1000.0 / (reader.fps() > 0 ? reader.fps() : 30));
+            qint64 modified_ms = QFileInfo(part.path).lastModified().toMSecsSinceEpoch();
+            qint64 limit_ms = segment_ms > 0 ? segment_ms : nominal_ms * 4;
+            if (segment_ms > 0 && it.value().contains(number + 1))
+                part.duration_ms = segment_ms;
+            else if (modified_ms > start_ms && modified_ms - start_ms <= limit_ms + max_close_delay_ms)
+                part.duration_ms = modified_ms - start_ms;
+            else
+                part.duration_ms = segment_ms > 0 ? qMin(nominal_ms, segment_ms) : nominal_ms;
+            part.duration_ms = qMax(part.duration_ms, qint64(1));
+            part.fps = part.packets * 1000.0 / part.duration_ms;
+
+            next_start = QDateTime::fromMSecsSinceEpoch(clipEndMs(part));
+            parts.append(part);
+        }
+
+        // the recordings of a camera do not overlap, the older ones end before this.
+        if (next_start < from)
+            break;
+
+        for (int i=parts.size() - 1; i>=0; i--)
+        {
+            if (clipEndMs(parts[i]) > from.toMSecsSinceEpoch() && parts[i].start <= to)
+                found.prepend(parts[i]);
+        }
+    }
+    return found;
+}
+
+int clip_export::packetAt(const clip &source, qint64 time_ms)
+{
+    // the packets are spread evenly over the real duration of the file.
+    qint64 offset_ms = time_ms - source.start.toMSecsSinceEpoch();
+    return int(std::ceil(double(offset_ms) * source.packets / source.duration_ms));
+}
+
+bool clip_export::isJpeg(const QByteArray &packet)
+{
+    return packet.size() > 2 && uchar(packet[0]) == 0xFF && uchar(packet[1]) == 0xD8;
+}
+
+bool clip_export::copyPackets(const clip &source, const QVector<int> &keep, avi_mjpeg_writer &writer,
+                              report &result, QString &error)
+{
+    avi_mjpeg_reader reader;
+    if (!reader.open(source.path))
+    {
+        result.skipped.append(source.path + " : unreadable");
+        return true;
+    }
+
+    QByteArray jpeg;
+    foreach(int index, keep)
+    {
+        if (!reader.readPacket(index, jpeg))
+            continue;
+        result.bytes_read += jpeg.size();
+
+        // only jpeg packets can be copied as they are.
+        if (!isJpeg(jpeg))
+        {
+            result.skipped.append(source.path + " : not MJPG");
+            return true;
+        }
+        if (!writer.writePacket(jpeg))
+        {
+            error = "could not write the export, disk full?";
+            return false;
+        }
+        result.frames_out++;
+    }
+    result.clips++;
+    return true;
+}
+
+bool clip_export::exportRange(QString dir, QString prefix, double segment_seconds, QDateTime from, QDateTime to,
+                              QString output, report &result, QString &error)
+{
+    QElapsedTimer timer;
+    timer.start();
+    result = report();
+
+    QVector<clip> clips = findClips(dir, prefix, from, to, segment_seconds);
+    if (clips.isEmpty())
+    {
+        error = QString("no recordings between %1 and %2").arg(from.toString(Qt::ISODate), to.toString(Qt::ISODate));
+        return false;
+    }
+
+    avi_mjpeg_writer writer;
+    cv::Size output_size;
+    foreach(clip source, clips)
+    {
+        if (QFileInfo(output).absoluteFilePath() == source.path)
+        {
+            error = output + " is one of the recordings";
+            return false;
+        }
+
+        // the frames whose time falls into [from, to].
+        int first = qMax(0, packetAt(source, from.toMSecsSinceEpoch()));
+        int last = qMin(source.packets - 1, packetAt(source, to.toMSecsSinceEpoch() + 1) - 1);
+        if (last < first)
+            continue;
+
+        // one avi has one frame size.
+        if (writer.isOpened() && source.size != output_size)
+        {
+            result.skipped.append(QString("%1 : %2x%3 frames").arg(source.path).arg(source.size.width).arg(source.size.height));
+            continue;
+        }
+        if (!writer.isOpened() && !writer.open(output, source.size, source.fps))
+        {
+            error = "could not open " + output;
+            return false;
+        }
+        output_size = source.size;
+
+        QVector<int> keep;
+        keep.reserve(last - first + 1);
+        for (int i=first; i<=last; i++)
+            keep.append(i);
+        result.frames_in += keep.size();
+        if (!copyPackets(source, keep, writer, result, error))
+        {
+            writer.close();
+            return false;
+        }
+    }
+
+    writer.close();
+    result.bytes_written = writer.bytesWritten();
+    result.seconds = timer.nsecsElapsed() / 1e9;
+    if (result.frames_out == 0)
+    {
+        QFile::remove(output);
+        error = "nothing to export";
+        return false;
+    }
+    utilities::syncFile(output);
+    return true;
+}
+
+clip_export::selection clip_export::select(clip source, SummaryMode mode, int stride, int first_index, int begin, int end)
+{
+    selection result;
+    avi_mjpeg_reader reader;
+    if (!reader.open(source.path))
+    {
+        result.error = "unreadable";
+        return result;
+    }
+
+    QByteArray jpeg;
+    cv::Mat last_kept, gray, diff;
+    for (int i=begin; i<end; i++)
+    {
+        // the stride runs on over the files, a time-lapse keeps its pace.
+        if ((first_index + i - begin) % stride != 0)
+            continue;
+
+        if (mode == TIMELAPSE)
+        {
+            result.keep.append(i);
+            continue;
+        }
+
+        if (!reader.readPacket(i, jpeg))
+            continue;
+        result.bytes_read += jpeg.size();
+
+        // the decoder scales by 1/8 in the DCT, a fraction of a full decode.
+        gray = cv::imdecode(cv::Mat(1, jpeg.size(), CV_8U, jpeg.data()), cv::IMREAD_REDUCED_GRAYSCALE_8);
+        if (gray.empty())
+            continue;
+
+        bool changed = last_kept.empty() || last_kept.size() != gray.size();
+        if (!changed)
+        {
+            cv::absdiff(gray, last_kept, diff);
+            cv::threshold(diff, diff, motion_pixel_delta, 255, cv::THRESH_BINARY);
+            changed = cv::countNonZero(diff) >= motion_changed_ratio * diff.total();
+        }
+        if (changed)
+        {
+            result.keep.append(i);
+            last_kept = gray;
+        }
+    }
+    return result;
+}
+
+bool clip_export::summarize(QString dir, QString prefix, double segment_seconds, QDate day, SummaryMode mode,
+                            int stride, double fps, QString output, report &result, QString &error)
+{
+    QElapsedTimer timer;
+    timer.start();
+    result = report();
+    stride = qMax(1, stride);
+
+    QDateTime from(day, QTime(0, 0));
+    QDateTime to = QDateTime(day.addDays(1), QTime(0, 0)).addMSecs(-1);
+    QVector<clip> clips = findClips(dir, prefix, from, to, segment_seconds);
+    if (clips.isEmpty())
+    {
+        error = "no recordings on " + day.toString(Qt::ISODate);
+        return false;
+    }
+
+    foreach(clip source, clips)
+    {
+        if (QFileInfo(output).absoluteFilePath() == source.path)
+        {
+            error = output + " is one of the recordings";
+            return false;
+        }
+    }
+
+    // every file is analysed as soon as a pool thread is free, the copy
+    // below waits for them in order.
+    QList<QFuture<selection>> selections;
+    int first_index = 0;
+    foreach(clip source, clips)
+    {
+        // a recording over midnight only gives its frames of this day.
+        int begin = qMax(0, packetAt(source, from.toMSecsSinceEpoch()));
+        int end = qMin(source.packets, packetAt(source, to.toMSecsSinceEpoch() + 1));
+        selections.append(QtConcurrent::run([=]() {
+            return select(source, mode, stride, first_index, begin, end);
+        }));
+        first_index += qMax(0, end - begin);
+        result.frames_in += qMax(0, end - begin);
+    }
+    result.threads = qMin(clips.size(), QThreadPool::globalInstance()->maxThreadCount());
+
+    avi_mjpeg_writer writer;
+    cv::Size output_size;
+    bool ok = true;
+    for (int i=0; i<clips.size() && ok; i++)
+    {
+        selection picked = selections[i].result();
+        result.bytes_read += picked.bytes_read;
+        if (!picked.error.isEmpty())
+        {
+            result.skipped.append(clips[i].path + " : " + picked.error);
+            continue;
+        }
+        if (picked.keep.isEmpty())
+            continue;
+
+        if (writer.isOpened() && clips[i].size != output_size)
+        {
+            result.skipped.append(QString("%1 : %2x%3 frames").arg(clips[i].path).arg(clips[i].size.width).arg(clips[i].size.height));
+            continue;
+        }
+        if (!writer.isOpened() && !writer.open(output, clips[i].size, fps))
+        {
+            error = "could not open " + output;
+            ok = false;
+            break;
+        }
+        output_size = clips[i].size;
+        ok = copyPackets(clips[i], picked.keep, writer, result, error);
+    }
+
+    // the tasks still running only read, let them finish before returning.
+    foreach(QFuture<selection> pending, selections)
+        pending.waitForFinished();
+
+    writer.close();
+    result.bytes_written = writer.bytesWritten();
+    result.seconds = timer.nsecsElapsed() / 1e9;
+    if (ok && result.frames_out == 0)
+    {
+        QFile::remove(output);
+        error = "nothing to summarize";
+        ok = false;
+    }
+    if (ok)
+        utilities::syncFile(output);
+    return ok;
+}
+
+QDateTime clip_export::parseTime(QString text)
+{
+    // "2021-01-28 21:30:00", iso or a recording name.
+    QDateTime time = QDateTime::fromString(text, "yyyy-MM-dd HH:mm:ss");
+    if (!time.isValid())
+        time = QDateTime::fromString(text, Qt::ISODate);
+    if (!time.isValid())
+        time = QDateTime::fromString(text, name_format);
+    return time;
+}
+
+int clip_export::run(QStringList arguments)
+{
+    QString dir = option(arguments, "--dir", utilities::getDataPath());
+    QString prefix = option(arguments, "--prefix", "");
+    QString segment = option(arguments, "--segment", "");
+    double segment_seconds = segment.isEmpty() ? pipeline_config().cameraConfig(option(arguments, "--camera", "")).segment_seconds
+                                               : segment.toDouble();
+    report result;
+    QString error;
+    bool ok = false;
+
+    int index = arguments.indexOf("--export");
+    if (index >= 0)
+    {
+        QDateTime from = parseTime(arguments.value(index + 1));
+        QDateTime to = parseTime(arguments.value(index + 2));
+        QString output = arguments.value(index + 3);
+        if (!from.isValid() || !to.isValid() || to < from || output.isEmpty())
+        {
+            qWarning().noquote() << "usage : --export \"yyyy-MM-dd HH:mm:ss\" \"yyyy-MM-dd HH:mm:ss\" <output.avi>";
+            return 2;
+        }
+        ok = exportRange(dir, prefix, segment_seconds, from, to, output, result, error);
+    }
+    else
+    {
+        index = arguments.indexOf("--summary");
+        QDate day = QDate::fromString(arguments.value(index + 1), "yyyy-MM-dd");
+        QString output = arguments.value(index + 2);
+        QString mode = option(arguments, "--mode", "timelapse");
+        if (!day.isValid() || output.isEmpty() || (mode != "timelapse" && mode != "motion"))
+        {
+            qWarning().noquote() << "usage : --summary yyyy-MM-dd <output.avi> [--mode timelapse|motion] [--stride n] [--fps n]";
+            return 2;
+        }
+        ok = summarize(dir, prefix, segment_seconds, day, mode == "motion" ? MOTION : TIMELAPSE,
+                       option(arguments, "--stride", "30").toInt(),
+                       qBound(1.0, option(arguments, "--fps", "30").toDouble(), 240.0),
+                       output, result, error);
+    }
+
+    if (!ok)
+    {
+        qWarning().noquote() << error;
+        return 1;
+    }
+    qInfo().noquote() << result.toString();
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef CLIP_EXPORT_H
+#define CLIP_EXPORT_H
+
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <QVector>
+#include <opencv2/core.hpp>
+
+class avi_mjpeg_writer;
+
+/*
+ * cuts, joins and condenses MJPG recordings by packet copy, no frame is
+ * decoded and encoded again.
+ *
+ * a recording is <prefix><yyyy-MM-dd+HH:mm:ss>.avi followed by its
+ * segments .part001.avi, .part002.avi ... (see video_recorder). segment n
+ * starts n x segment_seconds after the recording, the recorder rotates on
+ * the wall clock. a segment ends where the next one starts, the last one
+ * at its modification time. the packets are spread evenly over that, the
+ * fps in the header is only the configured one, not what the camera gave.
+ *
+ *  - exportRange() cuts [from, to] out of the recordings and their
+ *    segments into one avi, both ends fall on whole frames.
+ *  - summarize() condenses a day into one avi : TIMELAPSE keeps every
+ *    stride-th frame, MOTION only those of them that differ from the last
+ *    one kept. the files are analysed on the global pool, one task per
+ *    file, MOTION decodes a 1/8 size grey copy only to compare. the packets
+ *    are copied in order while the next files are still analysed.
+ *
+ * headless :
+ *   software --export "2021-01-28 21:30:00" "2021-01-28 21:35:00" out.avi
+ *   software --summary 2021-01-28 out.avi --mode motion --stride 30 --fps 30
+ * both take --dir <recordings>, --prefix <camera prefix> and --segment
+ * <seconds>, by default the segment_seconds of --camera <name> in config.json.
+ */
+class clip_export
+{
+public:
+    enum SummaryMode{
+        TIMELAPSE,
+        MOTION
+    };
+
+    // one file of a recording.
+    struct clip{
+        QString path;
+        QDateTime start;
+        qint64 duration_ms=0;
+        double fps=0;                   // measured, packets over duration
+        int packets=0;
+        cv::Size size;
+    };
+
+    struct report{
+        int clips=0;
+        int frames_in=0;
+        int frames_out=0;
+        qint64 bytes_read=0;
+        qint64 bytes_written=0;
+        double seconds=0;
+        int threads=1;
+        QStringList skipped;            // files left out and why
+
+        QString toString() const;
+    };
+
+    // the files of the recordings overlapping [from, to], oldest first.
+    static QVector<clip> findClips(QString dir, QString prefix, QDateTime from, QDateTime to,
+                                   double segment_seconds);
+
+    static bool exportRange(QString dir, QString prefix, double segment_seconds, QDateTime from, QDateTime to,
+                            QString output, report &result, QString &error);
+    static bool summarize(QString dir, QString prefix, double segment_seconds, QDate day, SummaryMode mode,
+                          int stride, double fps, QString output, report &result, QString &error);
+
+    static int run(QStringList arguments);
+
+private:
+    struct selection{
+        QVector<int> keep;              // packet indices, ascending
+        qint64 bytes_read=0;
+        QString error;
+    };
+
+    static selection select(clip source, SummaryMode mode, int stride, int first_index, int begin, int end);
+    static bool copyPackets(const clip &source, const QVector<int> &keep, avi_mjpeg_writer &writer,
+                            report &result, QString &error);
+    static bool isJpeg(const QByteArray &packet);
+    static int packetAt(const clip &source, qint64 time_ms);
+    static QDateTime parseTime(QString text);
+};
+
+#endif // CLIP_EXPORT_H
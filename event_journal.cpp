@@ -0,0 +1,434 @@
+#include "event_journal.h"
+#include <QDataStream>
+#include <QDir>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <algorithm>
+#include "thread_tuning.h"
+#include <sys/mman.h>
+
+event_journal *event_journal::current = nullptr;
+
+static const int header_size = 16;
+static const quint16 record_version = 3;
+
+static qint64 align8(qint64 size)
+{
+    return (size + 7) & ~qint64(7);
+}
+
+event_journal::event_journal(QString dir, qint64 segment_size, int max_segments):
+    dir(dir), segment_size(segment_size), max_segments(max_segments)
+{
+    QDir().mkpath(dir);
+    openExisting();
+    current = this;
+}
+
+event_journal::~event_journal()
+{
+    if (current == this)
+        current = nullptr;
+
+    foreach(segment seg, segments)
+    {
+        seg.file->unmap(seg.data);
+        seg.file->close();
+        delete seg.file;
+    }
+}
+
+event_journal *event_journal::instance(){return current;}
+
+QString event_journal::segmentPath(int number)
+{
+    return QString("%1/events-%2.seg").arg(dir).arg(number, 6, 10, QChar('0'));
+}
+
+void event_journal::setRunning(bool run)
+{
+    queue_lock.lock();
+    running = run;
+    wake.wakeAll();
+    queue_lock.unlock();
+}
+
+void event_journal::append(journal_event event)
+{
+    queue_lock.lock();
+    queue.append(event);
+    queue_lock.unlock();
+}
+
+//------------------------
+// record encoding
+//------------------------
+
+QByteArray event_journal::encode(const journal_event &event)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    QByteArray name = event.camname.toUtf8();
+    out << qint64(event.start_ms) << qint64(event.end_ms) << float(event.motion_score);
+    out << quint16(name.size());
+    out.writeRawData(name.constData(), name.size());
+    out << quint16(event.blobs.size());
+    for (size_t i=0; i<event.blobs.size(); i++)
+    {
+        const cv::Rect &blob = event.blobs[i];
+        out << qint32(blob.x) << qint32(blob.y) << qint32(blob.width) << qint32(blob.height);
+    }
+    out << quint32(event.snapshot.size());
+    out.writeRawData(event.snapshot.constData(), event.snapshot.size());
+
+    out << quint16(event.tracks.size());
+    for (size_t i=0; i<event.tracks.size(); i++)
+    {
+        const finished_track &track = event.tracks[i];
+        out << qint32(track.id) << qint64(track.first_ms) << qint64(track.last_ms) << float(track.path_px);
+        out << qint32(track.last_box.x) << qint32(track.last_box.y) << qint32(track.last_box.width) << qint32(track.last_box.height);
+    }
+
+    QByteArray kind = event.kind.toUtf8();
+    out << quint16(kind.size());
+    out.writeRawData(kind.constData(), kind.size());
+    return payload;
+}
+
+bool event_journal::decode(const uchar *data, qint64 available, journal_event &event, qint64 &record_size, bool with_snapshot)
+{
+    if (available < header_size || qFromLittleEndian<quint32>(data) != magic)
+        return false;
+
+    quint32 payload_size = qFromLittleEndian<quint32>(data + 4);
+    quint16 crc = qFromLittleEndian<quint16>(data + 8);
+    quint16 version = qFromLittleEndian<quint16>(data + 10);
+    if (header_size + qint64(payload_size) > available)
+        return false;
+
+    // a torn write leaves a header whose payload does not match.
+    const char *payload = reinterpret_cast<const char*>(data + header_size);
+    if (qChecksum(payload, payload_size) != crc)
+        return false;
+
+    QByteArray raw = QByteArray::fromRawData(payload, payload_size);
+    QDataStream in(raw);
+    in.setByteOrder(QDataStream::LittleEndian);
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    quint16 name_size, n_blobs;
+    quint32 jpeg_size;
+    in >> event.start_ms >> event.end_ms >> event.motion_score >> name_size;
+    QByteArray name(name_size, 0);
+    in.readRawData(name.data(), name_size);
+    event.camname = QString::fromUtf8(name);
+
+    in >> n_blobs;
+    event.blobs.resize(n_blobs);
+    for (int i=0; i<n_blobs; i++)
+    {
+        qint32 x, y, w, h;
+        in >> x >> y >> w >> h;
+        event.blobs[i] = cv::Rect(x, y, w, h);
+    }
+
+    in >> jpeg_size;
+    event.snapshot.clear();
+    if (with_snapshot)
+    {
+        event.snapshot.resize(jpeg_size);
+        in.readRawData(event.snapshot.data(), jpeg_size);
+    }
+    else
+        in.skipRawData(jpeg_size);
+
+    event.tracks.clear();
+    if (version >= 2)
+    {
+        quint16 n_tracks;
+        in >> n_tracks;
+        event.tracks.resize(n_tracks);
+        for (int i=0; i<n_tracks; i++)
+        {
+            qint32 id, x, y, w, h;
+            qint64 first_ms, last_ms;
+            float path_px;
+            in >> id >> first_ms >> last_ms >> path_px >> x >> y >> w >> h;
+            event.tracks[i] = {id, first_ms, last_ms, path_px, cv::Rect(x, y, w, h)};
+        }
+    }
+
+    event.kind = "motion";
+    if (version >= 3)
+    {
+        quint16 kind_size;
+        in >> kind_size;
+        QByteArray kind(kind_size, 0);
+        in.readRawData(kind.data(), kind_size);
+        event.kind = QString::fromUtf8(kind);
+    }
+
+    record_size = align8(header_size + payload_size);
+    return in.status() == QDataStream::Ok;
+}
+
+//------------------------
+// segments
+//------------------------
+
+bool event_journal::mapSegment(int number, bool writable)
+{
+    segment seg;
+    seg.number = number;
+    seg.writable = writable;
+    seg.file = new QFile(segmentPath(number));
+    seg.data = nullptr;
+    if (seg.file->open(writable ? QIODevice::ReadWrite : QIODevice::ReadOnly))
+    {
+        seg.size = seg.file->size();
+        seg.data = seg.file->map(0, seg.size);
+    }
+    if (seg.data == nullptr)
+    {
+        qDebug() << "failed to map journal segment : " << seg.file->fileName();
+        delete seg.file;
+        return false;
+    }
+    segments.append(seg);
+    return true;
+}
+
+bool event_journal::startSegment(int number)
+{
+    // a zero filled file, the zeros terminate the record list. it only gets
+    // its real name once it has its full size.
+    QString path = segmentPath(number);
+    QFile file(path + ".tmp");
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate) || !file.resize(segment_size))
+    {
+        qDebug() << "failed to create journal segment : " << file.fileName();
+        file.remove();
+        return false;
+    }
+    file.close();
+    QFile::remove(path);
+    if (!file.rename(path))
+    {
+        qDebug() << "failed to create journal segment : " << path;
+        file.remove();
+        return false;
+    }
+
+    if (!mapSegment(number, true))
+        return false;
+    write_offset = 0;
+
+    // rotate : drop the oldest segments and their index entries.
+    while (segments.size() > max_segments)
+    {
+        segment oldest = segments.takeFirst();
+        oldest.file->unmap(oldest.data);
+        oldest.file->close();
+        oldest.file->remove();
+        delete oldest.file;
+
+        int dropped = 0;
+        while (dropped < index.size() && index.at(dropped).segment == oldest.number)
+            dropped++;
+        index.remove(0, dropped);
+    }
+    return !segments.isEmpty() && segments.last().number == number;
+}
+
+void event_journal::openExisting()
+{
+    QDir journal_dir(dir);
+
+    // left over by a crash while a segment was being created.
+    foreach(QString name, journal_dir.entryList(QStringList({"events-*.seg.tmp"}), QDir::Files))
+        journal_dir.remove(name);
+
+    QStringList names = journal_dir.entryList(QStringList({"events-*.seg"}), QDir::Files, QDir::Name);
+    int newest = -1;
+    bool newest_mapped = false;
+    for (int i=0; i<names.size(); i++)
+    {
+        newest = names.at(i).mid(7, 6).toInt();
+        newest_mapped = mapSegment(newest, i == names.size() - 1);
+    }
+
+    // rebuild the index, the end of the last segment is where writing resumes.
+    foreach(segment seg, segments)
+    {
+        qint64 offset = 0;
+        journal_event event;
+        qint64 record_size;
+        while (decode(seg.data + offset, seg.size - offset, event, record_size, false))
+        {
+            index.append({seg.number, offset, event.start_ms, event.end_ms, event.camname});
+            next_seq = qFromLittleEndian<quint32>(seg.data + offset + 12) + 1;
+            offset += record_size;
+        }
+        write_offset = offset;
+    }
+
+    // writing only resumes in the newest file if it mapped, otherwise the
+    // next one starts after it.
+    if (!newest_mapped)
+        startSegment(newest + 1);
+
+    qDebug() << QString("event journal : %1 events in %2 segments").arg(index.size()).arg(segments.size());
+}
+
+void event_journal::writeBatch(QList<journal_event> &batch)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QMutexLocker locker(&index_lock);
+    foreach(journal_event event, batch)
+    {
+        QByteArray payload = encode(event);
+        qint64 record_size = align8(header_size + payload.size());
+        if (record_size > segment_size)
+        {
+            // too big for any segment, keep the event without its snapshot.
+            event.snapshot.clear();
+            payload = encode(event);
+            record_size = align8(header_size + payload.size());
+        }
+
+        if (segments.isEmpty() || !segments.last().writable || write_offset + record_size > segments.last().size)
+        {
+            int number = segments.isEmpty() ? 0 : segments.last().number + 1;
+            if (!startSegment(number))
+                return;
+        }
+
+        // payload first, the header makes the record visible.
+        segment &seg = segments.last();
+        uchar *record = seg.data + write_offset;
+        memcpy(record + header_size, payload.constData(), payload.size());
+        qToLittleEndian<quint32>(payload.size(), record + 4);
+        qToLittleEndian<quint16>(qChecksum(payload.constData(), payload.size()), record + 8);
+        qToLittleEndian<quint16>(record_version, record + 10);
+        qToLittleEndian<quint32>(next_seq++, record + 12);
+        qToLittleEndian<quint32>(magic, record);
+
+        index.append({seg.number, write_offset, event.start_ms, event.end_ms, event.camname});
+        write_offset += record_size;
+        bytes_written += record_size;
+        events_written++;
+    }
+
+    // start write back of the batch, the kernel keeps it across a crash anyway.
+    if (!segments.isEmpty())
+        ::msync(segments.last().data, segments.last().size, MS_ASYNC);
+
+    batches_written++;
+    write_ms_total += timer.nsecsElapsed() / 1e6;
+}
+
+void event_journal::run()
+{
+    thread_tuning::registerThread("io", "journal");
+    while (true)
+    {
+        queue_lock.lock();
+        if (queue.isEmpty() && running)
+            wake.wait(&queue_lock, 200);
+        QList<journal_event> batch = queue;
+        queue.clear();
+        bool stop = !running;
+        queue_lock.unlock();
+
+        if (!batch.isEmpty())
+            writeBatch(batch);
+        if (stop)
+            break;
+    }
+    thread_tuning::unregisterThread();
+}
+
+//------------------------
+// queries
+//------------------------
+
+journal_event event_journal::readAt(const index_entry &entry, bool with_snapshot)
+{
+    journal_event event;
+    qint64 record_size;
+    foreach(segment seg, segments)
+    {
+        if (seg.number == entry.segment)
+        {
+            decode(seg.data + entry.offset, seg.size - entry.offset, event, record_size, with_snapshot);
+            break;
+        }
+    }
+    return event;
+}
+
+QList<journal_event> event_journal::tail(int count, bool with_snapshots)
+{
+    QMutexLocker locker(&index_lock);
+    QList<journal_event> events;
+    for (int i=qMax(0, index.size() - count); i<index.size(); i++)
+        events.append(readAt(index.at(i), with_snapshots));
+    return events;
+}
+
+QList<journal_event> event_journal::range(qint64 from_ms, qint64 to_ms, QString camname, bool with_snapshots)
+{
+    QMutexLocker locker(&index_lock);
+
+    // events are appended when they end, so the index is sorted by end time.
+    QVector<index_entry>::const_iterator first = std::lower_bound(
+                index.constBegin(), index.constEnd(), from_ms,
+                [](const index_entry &entry, qint64 time) { return entry.end_ms < time; });
+
+    QList<journal_event> events;
+    for (QVector<index_entry>::const_iterator it = first; it != index.constEnd(); ++it)
+    {
+        if (it->start_ms > to_ms || (!camname.isEmpty() && it->camname != camname))
+            continue;
+        events.append(readAt(*it, with_snapshots));
+    }
+    return events;
+}
+
+QList<journal_event> event_journal::readSegmentFile(QString path)
+{
+    QList<journal_event> events;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return events;
+
+    QByteArray data = file.readAll();
+    const uchar *bytes = reinterpret_cast<const uchar*>(data.constData());
+    qint64 offset = 0;
+    journal_event event;
+    qint64 record_size;
+    while (decode(bytes + offset, data.size() - offset, event, record_size, true))
+    {
+        events.append(event);
+        offset += record_size;
+    }
+    return events;
+}
+
+QString event_journal::statsReport()
+{
+    QMutexLocker locker(&index_lock);
+    QString report = QString("event journal : %1 events in %2 segments (%3)\n")
+            .arg(index.size()).arg(segments.size()).arg(dir);
+    report += QString("  %1 events in %2 batches, %3 KB, %4 ms/batch\n")
+            .arg(events_written).arg(batches_written)
+            .arg(bytes_written / 1024.0, 0, 'f', 1)
+            .arg(batches_written ? write_ms_total / batches_written : 0.0, 0, 'f', 3);
+    return report;
+}
@@ -0,0 +1,129 @@
+#ifndef EVENT_JOURNAL_H
+#define EVENT_JOURNAL_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QFile>
+#include <QByteArray>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "blob_tracker.h"
+
+struct journal_event
+{
+    QString camname;
+    QString kind="motion";      // or the scene change, see scene_monitor
+    qint64 start_ms=0;          // ms since epoch
+    qint64 end_ms=0;
+    float motion_score=0;       // peak foreground ratio, 0..1
+    std::vector<cv::Rect> blobs;
+    QByteArray snapshot;        // jpeg, may be empty
+    std::vector<finished_track> tracks;
+};
+
+/*
+ * append only binary journal of motion events.
+ *
+ * events are stored in fixed size segment files (<data path>/journal/
+ * events-NNNNNN.seg) that are memory mapped while in use. append() only
+ * queues the event, the journal thread copies queued events into the
+ * mapped segment in batches. when a segment is full the next one is
+ * started and the oldest segments beyond max_segments are removed. a new
+ * segment is sized under a temporary name and only then renamed into
+ * place, so a crash never leaves a short segment behind.
+ *
+ * record layout (little endian, 8 byte aligned) :
+ *   uint32 magic 'EVNT', uint32 payload_size, uint16 crc16(payload), uint16 version, uint32 seq
+ *   payload : int64 start_ms, int64 end_ms, float score,
+ *             uint16 name_size, name (utf8), uint16 n_blobs, n_blobs x 4 int32,
+ *             uint32 jpeg_size, jpeg,
+ *             since version 2 : uint16 n_tracks, n_tracks x
+ *             (int32 id, int64 first_ms, int64 last_ms, float path_px, 4 int32 box),
+ *             since version 3 : uint16 kind_size, kind (utf8)
+ * a zero magic marks the end of the written part of a segment.
+ */
+class event_journal : public QThread
+{
+    Q_OBJECT;
+
+public:
+    explicit event_journal(QString dir, qint64 segment_size=8 * 1024 * 1024, int max_segments=16);
+    ~event_journal();
+
+    static event_journal *instance();
+
+    void append(journal_event event);
+    void setRunning(bool);
+
+    // newest last.
+    QList<journal_event> tail(int count, bool with_snapshots=false);
+    QList<journal_event> range(qint64 from_ms, qint64 to_ms, QString camname="", bool with_snapshots=false);
+
+    QString statsReport();
+
+    // for external tools : every valid record of one segment file.
+    static QList<journal_event> readSegmentFile(QString path);
+
+    static const quint32 magic = 0x544E5645;   // "EVNT"
+
+protected:
+    void run() override;
+
+private:
+    struct segment{
+        int number;
+        QFile *file;
+        uchar *data;
+        qint64 size;
+        bool writable;
+    };
+
+    struct index_entry{
+        int segment;            // number of the segment
+        qint64 offset;
+        qint64 start_ms;
+        qint64 end_ms;
+        QString camname;
+    };
+
+    void openExisting();
+    bool startSegment(int number);
+    bool mapSegment(int number, bool writable);
+    void writeBatch(QList<journal_event> &batch);
+    static QByteArray encode(const journal_event &event);
+    static bool decode(const uchar *data, qint64 available, journal_event &event, qint64 &record_size, bool with_snapshot);
+    journal_event readAt(const index_entry &entry, bool with_snapshot);
+    QString segmentPath(int number);
+
+    static event_journal *current;
+
+    QString dir;
+    qint64 segment_size;
+    int max_segments;
+
+    // queue between append() and the journal thread
+    QMutex queue_lock;
+    QWaitCondition wake;
+    QList<journal_event> queue;
+    bool running=true;
+
+    // segments and index, guarded by index_lock
+    QMutex index_lock;
+    QList<segment> segments;
+    QVector<index_entry> index;
+    qint64 write_offset=0;
+    quint32 next_seq=0;
+
+    // metrics
+    qint64 events_written=0;
+    qint64 batches_written=0;
+    qint64 bytes_written=0;
+    double write_ms_total=0;
+};
+
+#endif // EVENT_JOURNAL_H
@@ -0,0 +1,193 @@
+#include "frame_bus.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// slots start on a page, rows of the frame on a cache line.
+static const size_t page_bytes = 4096;
+
+static size_t roundUp(size_t value, size_t step)
+{
+    return (value + step - 1) / step * step;
+}
+
+frame_bus::frame_bus()
+{
+
+}
+
+frame_bus::~frame_bus()
+{
+    close();
+}
+
+bool frame_bus::open(QString new_name, QString camera, int width, int height, int slots)
+{
+    close();
+    stats_lock.lock();
+    name = new_name;
+    stats_lock.unlock();
+    QByteArray path = name.toLocal8Bit();
+
+    size_t frame_offset = roundUp(sizeof(frame_bus_meta), 64);
+    size_t mask_offset = frame_offset + roundUp(size_t(width) * height * 3, 64);
+    size_t slot_bytes = roundUp(mask_offset + size_t(width) * height, page_bytes);
+    size = sizeof(frame_bus_header) + slot_bytes * slots;
+
+    // a segment left behind by a crash is replaced, its readers see it closed.
+    fd = shm_open(path.constData(), O_RDWR, 0);
+    if (fd >= 0)
+    {
+        void *old = mmap(nullptr, sizeof(frame_bus_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (old != MAP_FAILED)
+        {
+            static_cast<frame_bus_header*>(old)->closed.store(1, std::memory_order_release);
+            munmap(old, sizeof(frame_bus_header));
+        }
+        ::close(fd);
+        shm_unlink(path.constData());
+    }
+
+    fd = shm_open(path.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    void *mapped = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, size) == 0)
+        mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        QMutexLocker locker(&stats_lock);
+        last_error = QString("%1 : %2").arg(name, strerror(errno));
+        qDebug() << "frame bus" << last_error;
+        if (fd >= 0)
+        {
+            ::close(fd);
+            shm_unlink(path.constData());
+        }
+        fd = -1;
+        size = 0;
+        return false;
+    }
+
+    // ftruncate zeroed the segment, every slot lock starts even.
+    base = static_cast<uchar*>(mapped);
+    header = reinterpret_cast<frame_bus_header*>(base);
+    header->version = frame_bus_version;
+    header->slot_count = slots;
+    header->slot_bytes = slot_bytes;
+    header->max_width = width;
+    header->max_height = height;
+    header->frame_offset = frame_offset;
+    header->mask_offset = mask_offset;
+    header->producer_pid = getpid();
+    QByteArray camera_name = camera.toUtf8().left(sizeof(header->camera) - 1);
+    memcpy(header->camera, camera_name.constData(), camera_name.size());
+
+    // readers check the magic after mapping, it goes in last.
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = frame_bus_magic;
+    sequence = 0;
+
+    QMutexLocker locker(&stats_lock);
+    last_error.clear();
+    qDebug() << QString("frame bus %1 : %2 slots of %3 MB").arg(name).arg(slots).arg(slot_bytes / 1048576.0, 0, 'f', 1);
+    return true;
+}
+
+void frame_bus::close()
+{
+    if (header != nullptr)
+    {
+        header->closed.store(1, std::memory_order_release);
+        munmap(base, size);
+        shm_unlink(name.toLocal8Bit().constData());
+    }
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    base = nullptr;
+    header = nullptr;
+    size = 0;
+}
+
+bool frame_bus::isOpen(){return header != nullptr;}
+
+cv::Size frame_bus::frameSize()
+{
+    if (header == nullptr)
+        return cv::Size();
+    return cv::Size(header->max_width, header->max_height);
+}
+
+void frame_bus::publish(const cv::Mat &frame, const cv::Mat &mask, const std::vector<cv::Rect> &blobs,
+                        bool motion, qint64 timestamp_us)
+{
+    if (header == nullptr || frame.type() != CV_8UC3
+            || frame.cols > int(header->max_width) || frame.rows > int(header->max_height))
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    uint64_t next = sequence + 1;
+    uchar *slot = base + sizeof(frame_bus_header) + size_t(next % header->slot_count) * header->slot_bytes;
+    frame_bus_meta *meta = reinterpret_cast<frame_bus_meta*>(slot);
+
+    // odd while writing, readers of this slot see the change afterwards.
+    uint64_t lock = meta->lock.load(std::memory_order_relaxed);
+    meta->lock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    meta->sequence = next;
+    meta->timestamp_us = timestamp_us;
+    meta->width = frame.cols;
+    meta->height = frame.rows;
+    meta->frame_stride = frame.cols * 3;
+    meta->motion = motion ? 1 : 0;
+    meta->blob_count = std::min(blobs.size(), size_t(frame_bus_max_blobs));
+    for (uint32_t i=0; i<meta->blob_count; i++)
+        meta->blobs[i] = {blobs[i].x, blobs[i].y, blobs[i].width, blobs[i].height};
+
+    // the one copy, into memory the readers use in place.
+    cv::Mat frame_slot(frame.rows, frame.cols, CV_8UC3, slot + header->frame_offset, meta->frame_stride);
+    frame.copyTo(frame_slot);
+    size_t bytes = size_t(frame.cols) * frame.rows * 3;
+
+    bool has_mask = !mask.empty() && mask.type() == CV_8UC1 && mask.size() == frame.size();
+    meta->mask_stride = has_mask ? frame.cols : 0;
+    if (has_mask)
+    {
+        cv::Mat mask_slot(frame.rows, frame.cols, CV_8UC1, slot + header->mask_offset, meta->mask_stride);
+        mask.copyTo(mask_slot);
+        bytes += size_t(frame.cols) * frame.rows;
+    }
+
+    meta->lock.store(lock + 2, std::memory_order_release);
+    header->latest.store(next, std::memory_order_release);
+    sequence = next;
+
+    double publish_us = timer.nsecsElapsed() / 1e3;
+    QMutexLocker locker(&stats_lock);
+    published++;
+    published_bytes += bytes;
+    publish_us_total += publish_us;
+    publish_us_max = std::max(publish_us_max, publish_us);
+}
+
+QString frame_bus::statsReport()
+{
+    QMutexLocker locker(&stats_lock);
+    if (!last_error.isEmpty())
+        return QString("frame bus : %1\n").arg(last_error);
+    if (published == 0)
+        return QString("frame bus : off\n");
+    return QString("frame bus %1 : %2 frames, %3 MB, %4 us/frame (max %5)\n")
+            .arg(name).arg(published)
+            .arg(published_bytes / 1048576.0, 0, 'f', 0)
+            .arg(publish_us_total / published, 0, 'f', 0)
+            .arg(publish_us_max, 0, 'f', 0);
+}
@@ -0,0 +1,53 @@
+#ifndef FRAME_BUS_H
+#define FRAME_BUS_H
+
+#include <QString>
+#include <QMutex>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "frame_bus_layout.h"
+
+/*
+ * publishes the frames of one camera in a POSIX shared memory ring,
+ * the producer side of frame_bus_reader.
+ *
+ * the segment is /software_<camera> (see utilities::frameBusName) with
+ * slot_count slots sized for the open resolution. publish() copies the
+ * frame and mask into the next slot under its seqlock and moves latest,
+ * it never waits for a reader. a new resolution closes the segment and
+ * creates a new one, readers see closed and open it again.
+ */
+class frame_bus
+{
+public:
+    frame_bus();
+    ~frame_bus();
+
+    bool open(QString name, QString camera, int width, int height, int slots);
+    void close();
+    bool isOpen();
+    cv::Size frameSize();
+
+    void publish(const cv::Mat &frame, const cv::Mat &mask, const std::vector<cv::Rect> &blobs,
+                 bool motion, qint64 timestamp_us);
+
+    QString statsReport();
+
+private:
+    QString name;
+    int fd=-1;
+    uchar *base=nullptr;
+    size_t size=0;
+    frame_bus_header *header=nullptr;
+    uint64_t sequence=0;
+
+    // metrics, read from the gui thread
+    QMutex stats_lock;
+    qint64 published=0;
+    qint64 published_bytes=0;
+    double publish_us_total=0;
+    double publish_us_max=0;
+    QString last_error;
+};
+
+#endif // FRAME_BUS_H
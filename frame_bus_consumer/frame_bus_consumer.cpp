@@ -0,0 +1,98 @@
+#include "frame_bus_reader.h"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+/*
+ * follows the frame bus of one camera and prints once a second what it
+ * saw : frames read and dropped, the mean brightness, the foreground share
+ * and the blobs of the newest frame. everything is computed on the shared
+ * frame in place, the result only counts if the slot is still valid.
+ */
+
+static double meanBrightness(const frame_view &view)
+{
+    // every 8th pixel of every 8th row is plenty for an average.
+    double sum = 0;
+    long count = 0;
+    for (int y=0; y<view.height; y+=8)
+    {
+        const uint8_t *row = view.frame + size_t(y) * view.frame_stride;
+        for (int x=0; x<view.width; x+=8, count++)
+            sum += (row[3 * x] + row[3 * x + 1] + row[3 * x + 2]) / 3.0;
+    }
+    return count ? sum / count : 0;
+}
+
+static double foregroundShare(const frame_view &view)
+{
+    if (view.mask == nullptr)
+        return 0;
+    long foreground = 0;
+    for (int y=0; y<view.height; y++)
+    {
+        const uint8_t *row = view.mask + size_t(y) * view.mask_stride;
+        for (int x=0; x<view.width; x++)
+            foreground += row[x] != 0;
+    }
+    return double(foreground) / (long(view.width) * view.height);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string name = argc > 1 ? argv[1] : "/software_dev_video0";
+    frame_bus_reader reader;
+    frame_view view;
+
+    long frames = 0, torn = 0;
+    double brightness = 0, foreground = 0;
+    auto report_time = std::chrono::steady_clock::now();
+
+    while (true)
+    {
+        // the camera is not running yet, or it restarted.
+        if (reader.closed())
+        {
+            if (!reader.open(name))
+            {
+                fprintf(stderr, "%s, retrying\n", reader.error().c_str());
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                continue;
+            }
+            printf("reading %s (%s)\n", name.c_str(), reader.camera().c_str());
+        }
+
+        if (!reader.next(view))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+
+        double frame_brightness = meanBrightness(view);
+        double frame_foreground = foregroundShare(view);
+        if (!reader.valid(view))
+        {
+            torn++;
+            continue;
+        }
+        frames++;
+        brightness = frame_brightness;
+        foreground = frame_foreground;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - report_time < std::chrono::seconds(1))
+            continue;
+        report_time = now;
+
+        printf("#%llu %dx%d : %ld frames/s, %llu dropped, %ld torn, brightness %.0f, foreground %.1f%%, %s, %zu blobs",
+               (unsigned long long)view.sequence, view.width, view.height, frames,
+               (unsigned long long)reader.dropped(), torn, brightness, foreground * 100,
+               view.motion ? "motion" : "quiet", view.blobs.size());
+        for (const frame_bus_blob &blob : view.blobs)
+            printf(" [%d,%d %dx%d]", blob.x, blob.y, blob.width, blob.height);
+        printf("\n");
+        fflush(stdout);
+        frames = 0;
+    }
+    return 0;
+}
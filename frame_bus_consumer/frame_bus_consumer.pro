@@ -0,0 +1,17 @@
+# example consumer of the frame bus, builds without qt or opencv.
+# qmake && make, then ./frame_bus_consumer /software_dev_video0
+
+TEMPLATE = app
+TARGET = frame_bus_consumer
+CONFIG += console c++11
+CONFIG -= qt app_bundle
+INCLUDEPATH += ..
+
+SOURCES += frame_bus_consumer.cpp \
+    ../frame_bus_reader.cpp
+
+HEADERS += \
+    ../frame_bus_layout.h \
+    ../frame_bus_reader.h
+
+unix: LIBS += -lrt
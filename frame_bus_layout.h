@@ -0,0 +1,62 @@
+#ifndef FRAME_BUS_LAYOUT_H
+#define FRAME_BUS_LAYOUT_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * memory layout of a frame bus segment, shared by the producer in the
+ * application and frame_bus_reader in other processes. plain C++, no qt
+ * or opencv, so a consumer only needs this header and the reader.
+ *
+ *   frame_bus_header | slot 0 | slot 1 | ... | slot n-1
+ *   slot : frame_bus_meta | BGR frame | 8 bit foreground mask
+ *
+ * every slot is a seqlock. the producer makes its lock odd, writes the
+ * slot and makes it even again, never waiting for anyone. a reader reads
+ * the lock before and after looking at the slot, a change means the
+ * producer came round the ring and the data may be torn.
+ */
+
+static const uint32_t frame_bus_magic = 0x53554246;     // "FBUS"
+static const uint32_t frame_bus_version = 1;
+static const int frame_bus_max_blobs = 64;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && sizeof(std::atomic<uint64_t>) == 8, "the frame bus needs lock free 64 bit atomics");
+
+struct frame_bus_blob
+{
+    int32_t x, y, width, height;
+};
+
+struct frame_bus_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_bytes;                // stride between slots
+    uint32_t max_width;
+    uint32_t max_height;
+    uint32_t frame_offset;              // from the start of a slot
+    uint32_t mask_offset;
+    std::atomic<uint64_t> latest;       // sequence of the newest complete frame, 0 for none
+    std::atomic<uint32_t> closed;       // the producer stopped or made a new segment
+    uint32_t producer_pid;
+    char camera[64];
+};
+
+struct frame_bus_meta
+{
+    std::atomic<uint64_t> lock;         // odd while the producer writes
+    uint64_t sequence;                  // frame number, from 1
+    int64_t timestamp_us;               // capture time, unix epoch
+    uint32_t width;
+    uint32_t height;
+    uint32_t frame_stride;              // bytes per BGR row
+    uint32_t mask_stride;               // 0 when there is no mask
+    uint32_t motion;                    // 1 while a motion event runs
+    uint32_t blob_count;
+    frame_bus_blob blobs[frame_bus_max_blobs];
+};
+
+#endif // FRAME_BUS_LAYOUT_H
@@ -0,0 +1,166 @@
+#include "frame_bus_reader.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+frame_bus_reader::frame_bus_reader()
+{
+
+}
+
+frame_bus_reader::~frame_bus_reader()
+{
+    close();
+}
+
+bool frame_bus_reader::open(const std::string &name)
+{
+    close();
+    fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        last_error = name + " : " + strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(frame_bus_header))
+    {
+        last_error = name + " : segment too small";
+        close();
+        return false;
+    }
+    size = info.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        last_error = name + " : " + strerror(errno);
+        base = nullptr;
+        close();
+        return false;
+    }
+    base = static_cast<const uint8_t*>(mapped);
+    header = reinterpret_cast<const frame_bus_header*>(base);
+
+    // the producer writes the magic last, after the layout.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->magic != frame_bus_magic || header->version != frame_bus_version
+            || sizeof(frame_bus_header) + size_t(header->slot_count) * header->slot_bytes > size)
+    {
+        last_error = name + " : not a frame bus or another version";
+        close();
+        return false;
+    }
+
+    // start with the frame published next.
+    last = header->latest.load(std::memory_order_acquire);
+    dropped_frames = 0;
+    last_error.clear();
+    return true;
+}
+
+void frame_bus_reader::close()
+{
+    if (base != nullptr)
+        munmap(const_cast<uint8_t*>(base), size);
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+    base = nullptr;
+    header = nullptr;
+    size = 0;
+}
+
+bool frame_bus_reader::isOpen() const {return header != nullptr;}
+
+bool frame_bus_reader::closed() const
+{
+    return header == nullptr || header->closed.load(std::memory_order_acquire) != 0;
+}
+
+uint64_t frame_bus_reader::dropped() const {return dropped_frames;}
+
+std::string frame_bus_reader::camera() const
+{
+    return header == nullptr ? std::string() : std::string(header->camera, strnlen(header->camera, sizeof(header->camera)));
+}
+
+std::string frame_bus_reader::error() const {return last_error;}
+
+bool frame_bus_reader::read(uint64_t sequence, frame_view &view) const
+{
+    const uint8_t *slot = base + sizeof(frame_bus_header) + size_t(sequence % header->slot_count) * header->slot_bytes;
+    const frame_bus_meta *meta = reinterpret_cast<const frame_bus_meta*>(slot);
+
+    uint64_t lock = meta->lock.load(std::memory_order_acquire);
+    if ((lock & 1) != 0 || meta->sequence != sequence)
+        return false;
+
+    view.sequence = meta->sequence;
+    view.timestamp_us = meta->timestamp_us;
+    view.width = meta->width;
+    view.height = meta->height;
+    view.frame = slot + header->frame_offset;
+    view.frame_stride = meta->frame_stride;
+    view.mask = meta->mask_stride > 0 ? slot + header->mask_offset : nullptr;
+    view.mask_stride = meta->mask_stride;
+    view.motion = meta->motion != 0;
+    uint32_t count = meta->blob_count < uint32_t(frame_bus_max_blobs) ? meta->blob_count : frame_bus_max_blobs;
+    view.blobs.assign(meta->blobs, meta->blobs + count);
+    view.slot = meta;
+    view.lock = lock;
+
+    // the metadata copy is only good if the slot was not touched meanwhile.
+    return valid(view);
+}
+
+bool frame_bus_reader::valid(const frame_view &view) const
+{
+    if (view.slot == nullptr)
+        return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return view.slot->lock.load(std::memory_order_relaxed) == view.lock;
+}
+
+bool frame_bus_reader::next(frame_view &view)
+{
+    if (header == nullptr)
+        return false;
+    uint64_t newest = header->latest.load(std::memory_order_acquire);
+    if (newest == 0 || newest <= last)
+        return false;
+
+    // too far behind, the older slots are being rewritten.
+    uint64_t wanted = last + 1;
+    if (newest - wanted >= header->slot_count - 1)
+        wanted = newest;
+
+    if (!read(wanted, view))
+    {
+        // overtaken while reading, the newest one is still good.
+        wanted = header->latest.load(std::memory_order_acquire);
+        if (!read(wanted, view))
+            return false;
+    }
+    dropped_frames += wanted - last - 1;
+    last = wanted;
+    return true;
+}
+
+bool frame_bus_reader::latest(frame_view &view)
+{
+    if (header == nullptr)
+        return false;
+    uint64_t newest = header->latest.load(std::memory_order_acquire);
+    if (newest == 0 || !read(newest, view))
+        return false;
+    if (newest > last)
+    {
+        dropped_frames += newest - last - 1;
+        last = newest;
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef FRAME_BUS_READER_H
+#define FRAME_BUS_READER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "frame_bus_layout.h"
+
+// one frame, pointing into the shared segment, nothing is copied.
+struct frame_view
+{
+    uint64_t sequence=0;
+    int64_t timestamp_us=0;
+    int width=0;
+    int height=0;
+    const uint8_t *frame=nullptr;       // BGR
+    int frame_stride=0;
+    const uint8_t *mask=nullptr;        // nullptr without foreground mask
+    int mask_stride=0;
+    bool motion=false;
+    std::vector<frame_bus_blob> blobs;
+
+    // seqlock state the view was taken at, see frame_bus_reader::valid().
+    const frame_bus_meta *slot=nullptr;
+    uint64_t lock=0;
+};
+
+/*
+ * reads the frame bus of one camera from another process.
+ *
+ *   frame_bus_reader reader;
+ *   reader.open("/software_dev_video0");
+ *   frame_view view;
+ *   if (reader.next(view))
+ *   {
+ *       ... use view.frame and view.mask in place ...
+ *       if (!reader.valid(view))
+ *           ... the producer overwrote the slot meanwhile, drop the result ...
+ *   }
+ *
+ * the segment is mapped read only and reading takes no lock, the producer
+ * never waits for a reader. a reader that falls more than slot_count - 1
+ * frames behind skips to the newest frame and counts the rest as dropped.
+ * the producer keeps a slot for slot_count - 1 frame times at least, work
+ * that takes longer should copy the frame first. once closed() turns true
+ * the camera stopped or changed resolution, open() again.
+ */
+class frame_bus_reader
+{
+public:
+    frame_bus_reader();
+    ~frame_bus_reader();
+
+    bool open(const std::string &name);
+    void close();
+    bool isOpen() const;
+    bool closed() const;
+
+    bool next(frame_view &view);
+    bool latest(frame_view &view);
+    bool valid(const frame_view &view) const;
+
+    uint64_t dropped() const;
+    std::string camera() const;
+    std::string error() const;
+
+private:
+    bool read(uint64_t sequence, frame_view &view) const;
+
+    int fd=-1;
+    const uint8_t *base=nullptr;
+    size_t size=0;
+    const frame_bus_header *header=nullptr;
+    uint64_t last=0;
+    uint64_t dropped_frames=0;
+    std::string last_error;
+};
+
+#endif // FRAME_BUS_READER_H
@@ -0,0 +1,368 @@
+#include "frame_compositor.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cstring>
+#include <opencv2/imgproc.hpp>
+
+static const int font_face = cv::FONT_HERSHEY_SIMPLEX;
+static const double label_scale = 0.45;
+// margin of the caption and padding of its band.
+static const int caption_margin = 8;
+static const int band_padding = 4;
+
+static inline void fillSpan(uchar *row, int x0, int x1, int width, const cv::Vec3b &color)
+{
+    x0 = std::max(x0, 0);
+    x1 = std::min(x1, width - 1);
+    for (uchar *p = row + 3 * x0; x0 <= x1; x0++, p += 3)
+    {
+        p[0] = color[0];
+        p[1] = color[1];
+        p[2] = color[2];
+    }
+}
+
+static inline cv::Vec3b toVec(const cv::Scalar &color)
+{
+    return cv::Vec3b(cv::saturate_cast<uchar>(color[0]), cv::saturate_cast<uchar>(color[1]),
+                     cv::saturate_cast<uchar>(color[2]));
+}
+
+frame_compositor::frame_compositor()
+{
+    renderFont(label_font, label_scale);
+    renderFont(caption_font, 0.6);
+}
+
+void frame_compositor::renderFont(glyph_font &font, double scale)
+{
+    int thickness = std::max(1, int(scale * 2 + 0.5));
+    int baseline = 0;
+    cv::Size cell = cv::getTextSize("Ag", font_face, scale, thickness, &baseline);
+    font.scale = scale;
+    font.ascent = cell.height + thickness;
+    font.height = font.ascent + baseline;
+    font.alpha.clear();
+    font.advance.clear();
+
+    // each glyph once, anti aliased, the pixel value is its coverage.
+    for (int c=32; c<127; c++)
+    {
+        std::string text(1, char(c));
+        cv::Size size = cv::getTextSize(text, font_face, scale, thickness, &baseline);
+        cv::Mat alpha = cv::Mat::zeros(font.height, size.width + thickness, CV_8UC1);
+        cv::putText(alpha, text, cv::Point(0, font.ascent), font_face, scale, cv::Scalar(255), thickness, cv::LINE_AA);
+        font.alpha.push_back(alpha);
+        font.advance.push_back(size.width);
+    }
+}
+
+int frame_compositor::textWidth(const glyph_font &font, const std::string &text)
+{
+    int width = 0;
+    for (char c : text)
+        width += font.advance[(c >= 32 && c < 127 ? c : '?') - 32];
+    return width;
+}
+
+void frame_compositor::setMirror(bool new_mirror)
+{
+    mirror = new_mirror;
+}
+
+void frame_compositor::setPrivacyMasks(const QList<QPolygon> &new_polygons)
+{
+    polygons = new_polygons;
+    spans_dirty = true;
+}
+
+void frame_compositor::setCaption(bool timestamp, QString label, double scale)
+{
+    caption_timestamp = timestamp;
+    caption_label = label;
+    caption_second = -1;
+    if (scale != caption_font.scale)
+        renderFont(caption_font, scale);
+}
+
+void frame_compositor::updateSpans(cv::Size size)
+{
+    if (!spans_dirty && size == spans_size && mirror == spans_mirror)
+        return;
+    spans_dirty = false;
+    spans_size = size;
+    spans_mirror = mirror;
+    spans.assign(size.height, std::vector<cv::Vec2i>());
+
+    // the polygons are given on the captured frame, the spans are for the output.
+    cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
+    foreach(QPolygon polygon, polygons)
+    {
+        std::vector<cv::Point> points;
+        for (const QPoint &point : polygon)
+            points.push_back(cv::Point(mirror ? size.width - 1 - point.x() : point.x(), point.y()));
+        cv::fillPoly(mask, std::vector<std::vector<cv::Point>>{points}, cv::Scalar(255));
+    }
+
+    for (int y=0; y<size.height; y++)
+    {
+        const uchar *row = mask.ptr<uchar>(y);
+        for (int x=0; x<size.width; x++)
+        {
+            if (!row[x])
+                continue;
+            int start = x;
+            while (x < size.width && row[x])
+                x++;
+            spans[y].push_back(cv::Vec2i(start, x));
+        }
+    }
+
+    QMutexLocker locker(&stats_lock);
+    mask_count = polygons.size();
+}
+
+void frame_compositor::prepareItems(cv::Size size, const std::vector<overlay_box> &boxes, const std::vector<overlay_line> &lines)
+{
+    box_items.clear();
+    line_items.clear();
+    text_items.clear();
+    caption_rect = cv::Rect();
+    cv::Rect bounds(cv::Point(0, 0), size);
+
+    for (const overlay_box &item : boxes)
+    {
+        cv::Rect rect = item.box & bounds;
+        if (rect.empty())
+            continue;
+        box_item box;
+        box.x0 = mirror ? size.width - rect.x - rect.width : rect.x;
+        box.x1 = box.x0 + rect.width - 1;
+        box.y0 = rect.y;
+        box.y1 = rect.y + rect.height - 1;
+        box.thickness = std::max(1, item.thickness);
+        box.color = toVec(item.color);
+        box_items.push_back(box);
+
+        // above the box, inside it when there is no room.
+        if (!item.label.empty())
+        {
+            int y = box.y0 - label_font.height - 1;
+            text_items.push_back({box.x0 + 2, y >= 0 ? y : box.y0 + 2, &label_font, item.label,
+                                  box.color, false});
+        }
+    }
+
+    for (const overlay_line &item : lines)
+    {
+        line_item line;
+        line.x0 = mirror ? size.width - 1 - item.from.x : item.from.x;
+        line.x1 = mirror ? size.width - 1 - item.to.x : item.to.x;
+        line.y0 = item.from.y;
+        line.y1 = item.to.y;
+        line.color = toVec(item.color);
+        line_items.push_back(line);
+    }
+
+    // the caption text only changes once a second.
+    if (caption_timestamp || !caption_label.isEmpty())
+    {
+        qint64 second = QDateTime::currentMSecsSinceEpoch() / 1000;
+        if (second != caption_second)
+        {
+            caption_second = second;
+            QString text = caption_label;
+            if (caption_timestamp)
+                text = QDateTime::fromMSecsSinceEpoch(second * 1000).toString("yyyy-MM-dd HH:mm:ss") + "  " + text;
+            caption = text.trimmed().toStdString();
+        }
+        text_items.push_back({caption_margin, caption_margin, &caption_font, caption,
+                              cv::Vec3b(255, 255, 255), true});
+        caption_rect = cv::Rect(caption_margin - band_padding, caption_margin,
+                                textWidth(caption_font, caption) + 2 * band_padding, caption_font.height) & bounds;
+    }
+}
+
+void frame_compositor::copyRow(const cv::Mat &src, int y, cv::Mat &dst) const
+{
+    const uchar *in = src.ptr<uchar>(y);
+    uchar *out = dst.ptr<uchar>(y);
+    int width = src.cols;
+    size_t pixel = src.elemSize();
+
+    if (!mirror)
+        memcpy(out, in, width * pixel);
+    else if (pixel == 3)
+    {
+        const uchar *p = in + 3 * (width - 1);
+        uchar *q = out;
+        for (int x=0; x<width; x++, p -= 3, q += 3)
+        {
+            q[0] = p[0];
+            q[1] = p[1];
+            q[2] = p[2];
+        }
+    }
+    else if (pixel == 1)
+    {
+        for (int x=0; x<width; x++)
+            out[x] = in[width - 1 - x];
+    }
+    else
+    {
+        for (int x=0; x<width; x++)
+            memcpy(out + x * pixel, in + (width - 1 - x) * pixel, pixel);
+    }
+
+    for (const cv::Vec2i &span : spans[y])
+        memset(out + span[0] * pixel, 0, (span[1] - span[0]) * pixel);
+}
+
+void frame_compositor::composeRow(const cv::Mat &src, int y, cv::Mat &bgr, cv::Mat &rgb) const
+{
+    int width = src.cols;
+    copyRow(src, y, bgr);
+    uchar *row = bgr.ptr<uchar>(y);
+
+    for (const box_item &box : box_items)
+    {
+        if (y < box.y0 || y > box.y1)
+            continue;
+        if (y < box.y0 + box.thickness || y > box.y1 - box.thickness)
+            fillSpan(row, box.x0, box.x1, width, box.color);
+        else
+        {
+            fillSpan(row, box.x0, std::min(box.x0 + box.thickness - 1, box.x1), width, box.color);
+            fillSpan(row, std::max(box.x1 - box.thickness + 1, box.x0), box.x1, width, box.color);
+        }
+    }
+
+    // the part of a line within this row, one pixel at least.
+    for (const line_item &line : line_items)
+    {
+        if (y < std::min(line.y0, line.y1) || y > std::max(line.y0, line.y1))
+            continue;
+        float xa = std::min(line.x0, line.x1);
+        float xb = std::max(line.x0, line.x1);
+        if (line.y0 != line.y1)
+        {
+            float t0 = std::min(std::max((y - 0.5f - line.y0) / (line.y1 - line.y0), 0.f), 1.f);
+            float t1 = std::min(std::max((y + 0.5f - line.y0) / (line.y1 - line.y0), 0.f), 1.f);
+            xa = line.x0 + t0 * (line.x1 - line.x0);
+            xb = line.x0 + t1 * (line.x1 - line.x0);
+            if (xa > xb)
+                std::swap(xa, xb);
+        }
+        fillSpan(row, int(xa + 0.5f), int(xb + 0.5f), width, line.color);
+    }
+
+    for (const text_item &text : text_items)
+    {
+        int r = y - text.y;
+        if (r < 0 || r >= text.font->height)
+            continue;
+
+        if (text.shaded)
+        {
+            int x0 = std::max(text.x - band_padding, 0);
+            int x1 = std::min(text.x + textWidth(*text.font, text.text) + band_padding, width);
+            for (uchar *p = row + 3 * x0; p < row + 3 * x1; p++)
+                *p >>= 1;
+        }
+
+        int x = text.x;
+        for (char c : text.text)
+        {
+            int index = (c >= 32 && c < 127 ? c : '?') - 32;
+            const cv::Mat &alpha = text.font->alpha[index];
+            const uchar *coverage = alpha.ptr<uchar>(r);
+            for (int i=0; i<alpha.cols; i++)
+            {
+                int a = coverage[i];
+                int px = x + i;
+                if (a == 0 || px < 0 || px >= width)
+                    continue;
+                uchar *p = row + 3 * px;
+                for (int k=0; k<3; k++)
+                    p[k] = (p[k] * (255 - a) + text.color[k] * a + 127) / 255;
+            }
+            x += text.font->advance[index];
+        }
+    }
+
+    // and the screen copy of the finished row.
+    uchar *out = rgb.ptr<uchar>(y);
+    for (int x=0; x<width; x++, row += 3, out += 3)
+    {
+        out[0] = row[2];
+        out[1] = row[1];
+        out[2] = row[0];
+    }
+}
+
+void frame_compositor::compose(const cv::Mat &src, const std::vector<overlay_box> &boxes,
+                               const std::vector<overlay_line> &lines, cv::Mat &bgr, cv::Mat &rgb)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const cv::Mat *input = &src;
+    if (src.type() != CV_8UC3)
+    {
+        cv::cvtColor(src, converted, src.channels() == 1 ? cv::COLOR_GRAY2BGR : cv::COLOR_BGRA2BGR);
+        input = &converted;
+    }
+
+    updateSpans(input->size());
+    prepareItems(input->size(), boxes, lines);
+
+    // the rows are written in place, the outputs must not share the input.
+    if (bgr.data == input->data)
+        bgr.release();
+    bgr.create(input->size(), CV_8UC3);
+    rgb.create(input->size(), CV_8UC3);
+
+    cv::parallel_for_(cv::Range(0, input->rows), [&](const cv::Range &range){
+        for (int y=range.start; y<range.end; y++)
+            composeRow(*input, y, bgr, rgb);
+    });
+
+    double compose_us = timer.nsecsElapsed() / 1e3;
+    QMutexLocker locker(&stats_lock);
+    frames++;
+    compose_us_total += compose_us;
+    compose_us_max = std::max(compose_us_max, compose_us);
+}
+
+void frame_compositor::redact(const cv::Mat &src, cv::Mat &dst)
+{
+    if (src.empty() || (!mirror && polygons.isEmpty()))
+    {
+        dst = src;
+        return;
+    }
+
+    updateSpans(src.size());
+    if (dst.data == src.data)
+        dst.release();
+    dst.create(src.size(), src.type());
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &range){
+        for (int y=range.start; y<range.end; y++)
+            copyRow(src, y, dst);
+    });
+}
+
+cv::Rect frame_compositor::captionRect() const{return caption_rect;}
+
+QString frame_compositor::statsReport()
+{
+    QMutexLocker locker(&stats_lock);
+    return QString("compositor : %1 frames, %2 us/frame (max %3), %4 privacy masks, mirror %5\n")
+            .arg(frames)
+            .arg(frames ? compose_us_total / frames : 0.0, 0, 'f', 0)
+            .arg(compose_us_max, 0, 'f', 0)
+            .arg(mask_count)
+            .arg(mirror ? "on" : "off");
+}
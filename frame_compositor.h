@@ -0,0 +1,127 @@
+#ifndef FRAME_COMPOSITOR_H
+#define FRAME_COMPOSITOR_H
+
+#include <QString>
+#include <QMutex>
+#include <QList>
+#include <QPolygon>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// drawn by the compositor, in the coordinates of the captured frame.
+struct overlay_box
+{
+    cv::Rect box;
+    cv::Scalar color;               // BGR
+    int thickness=1;
+    std::string label;              // above the box, empty for none
+};
+
+struct overlay_line
+{
+    cv::Point from;
+    cv::Point to;
+    cv::Scalar color;
+};
+
+/*
+ * turns a captured frame into what is recorded, streamed and shown.
+ *
+ * mirroring, privacy masks, the timestamp caption, motion boxes and the
+ * colour conversion for the screen are done row by row in one pass: each
+ * output row is read once from the source, edited while it is in cache and
+ * written out as BGR and RGB. separate flip, fillPoly, putText and cvtColor
+ * passes would each read and write the whole frame again.
+ *
+ * text is blended from glyph bitmaps rendered once per font, the privacy
+ * polygons are rasterised to spans per row whenever they, the frame size
+ * or the mirror change.
+ */
+class frame_compositor
+{
+public:
+    frame_compositor();
+
+    void setMirror(bool mirror);
+    void setPrivacyMasks(const QList<QPolygon> &polygons);
+    void setCaption(bool timestamp, QString label, double scale);
+
+    void compose(const cv::Mat &src, const std::vector<overlay_box> &boxes,
+                 const std::vector<overlay_line> &lines, cv::Mat &bgr, cv::Mat &rgb);
+
+    // mirror and privacy masks only, for snapshots, masks and backgrounds.
+    void redact(const cv::Mat &src, cv::Mat &dst);
+
+    // band of the caption in the last composed frame, empty without one.
+    cv::Rect captionRect() const;
+
+    QString statsReport();
+
+private:
+    struct glyph_font{
+        double scale=0;
+        int ascent=0;
+        int height=0;
+        std::vector<cv::Mat> alpha;     // printable ascii, index c - 32
+        std::vector<int> advance;
+    };
+
+    struct box_item{
+        int x0, y0, x1, y1;             // inclusive, output coordinates
+        int thickness;
+        cv::Vec3b color;
+    };
+
+    struct line_item{
+        float x0, y0, x1, y1;
+        cv::Vec3b color;
+    };
+
+    struct text_item{
+        int x, y;                       // top left
+        const glyph_font *font;
+        std::string text;
+        cv::Vec3b color;
+        bool shaded;                    // darkened band behind the text
+    };
+
+    static void renderFont(glyph_font &font, double scale);
+    static int textWidth(const glyph_font &font, const std::string &text);
+    void updateSpans(cv::Size size);
+    void prepareItems(cv::Size size, const std::vector<overlay_box> &boxes, const std::vector<overlay_line> &lines);
+    void composeRow(const cv::Mat &src, int y, cv::Mat &bgr, cv::Mat &rgb) const;
+    void copyRow(const cv::Mat &src, int y, cv::Mat &dst) const;
+
+    bool mirror=false;
+    QList<QPolygon> polygons;
+
+    // privacy spans of each output row, start and end column (exclusive).
+    std::vector<std::vector<cv::Vec2i>> spans;
+    cv::Size spans_size;
+    bool spans_mirror=false;
+    bool spans_dirty=true;
+
+    bool caption_timestamp=true;
+    QString caption_label;
+    glyph_font caption_font;
+    glyph_font label_font;
+    qint64 caption_second=-1;
+    std::string caption;
+    cv::Rect caption_rect;
+
+    // items of the current frame.
+    std::vector<box_item> box_items;
+    std::vector<line_item> line_items;
+    std::vector<text_item> text_items;
+    cv::Mat converted;
+
+    // metrics, read from the gui thread
+    QMutex stats_lock;
+    qint64 frames=0;
+    double compose_us_total=0;
+    double compose_us_max=0;
+    int mask_count=0;
+};
+
+#endif // FRAME_COMPOSITOR_H
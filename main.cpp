@@ -1,9 +1,34 @@
 #include <QApplication>
+#include <QCoreApplication>
+#include <cstring>
 //#include <QMainWindow>
 #include "mainwindow.h"
+#ifdef BENCH
+#include "pipeline_bench.h"
+#endif
+#include "clip_export.h"
 
 int main(int argc, char* argv[])
 {
+    // the benchmark and the exports run headless.
+    for (int i=1; i<argc; i++)
+    {
+#ifdef BENCH
+        if (strcmp(argv[i], "--bench") == 0)
+        {
+            QCoreApplication app(argc, argv);
+            return pipeline_bench::run(app.arguments());
+        }
+#endif
+
+        // packet copy exports, see clip_export.h
+        if (strcmp(argv[i], "--export") == 0 || strcmp(argv[i], "--summary") == 0)
+        {
+            QCoreApplication app(argc, argv);
+            return clip_export::run(app.arguments());
+        }
+    }
+
     QApplication app(argc, argv);
     MainWindow window;
     window.setWindowTitle("Software");
@@ -9,18 +9,71 @@
 #include <QGridLayout>
 #include <string>
 #include <QShortcut>
+#include <QFileDialog>
 #include "capture_thread.h"
+#include "tile_player.h"
+#include "utilities.h"
+#include "recording_recovery.h"
+#include "camera_probe.h"
+#include "thread_tuning.h"
+#include "memory_governor.h"
+#include <QtConcurrent>
+#include <QFutureWatcher>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QDateTime>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent), fileMenu(nullptr), capturer(nullptr)
 {
+    streamServer = new mjpeg_server(this);
+    pipelineConfig = new pipeline_config(this);
+    connect(pipelineConfig, &pipeline_config::configReloaded, this, &MainWindow::reloadConfig);
+    alertDispatcher = new alert_dispatcher();
+    alertDispatcher->setConfig(pipelineConfig->alertConfig());
+    alertDispatcher->start();
+    eventJournal = new event_journal(utilities::getDataPath() + "/journal");
+    eventJournal->start();
+    objectDetector = new object_detector();
+    objectDetector->setConfig(pipelineConfig->detectorConfig());
+    objectDetector->start();
     initUI();
     toggleHideActions(false);
     data_lock = new QMutex();
+    reloadConfig();
+
+    // open every camera once in parallel, so the driver is warm and dead
+    // devices are known before the user picks one.
+    QStringList devices;
+    foreach(QCameraInfo camera, QCameraInfo::availableCameras())
+        devices.append(camera.deviceName());
+    camera_config probe_config = pipelineConfig->cameraConfig("");
+    cameraProbe = QtConcurrent::run(&camera_probe::probeAll, devices,
+                                    probe_config.frame_width, probe_config.frame_height, probe_config.open_timeout_ms);
+
+    // repair recordings cut off by a crash, without holding up the window.
+    QtConcurrent::run([]() {
+        foreach(QString line, recording_recovery::recoverAll(utilities::getDataPath()))
+            qDebug() << line;
+    });
 }
 
 MainWindow::~MainWindow(){
-
+    // let the capture loop finish, it saves the background model on the way out.
+    if (capturer != nullptr)
+    {
+        capturer->setRunning(false);
+        capturer->wait();
+    }
+    alertDispatcher->setRunning(false);
+    alertDispatcher->wait();
+    delete alertDispatcher;
+    eventJournal->setRunning(false);
+    eventJournal->wait();
+    delete eventJournal;
+    objectDetector->setRunning(false);
+    objectDetector->wait();
+    delete objectDetector;
 }
 
 void MainWindow::initUI(){
@@ -43,6 +96,11 @@ void MainWindow::initUIFileMenu()
     fileMenu->addAction(exitAction);
     connect(exitAction, SIGNAL(triggered(bool)), QApplication::instance(), SLOT(quit()));
     exitAction->setShortcut(QKeySequence("Ctrl+F4"));
+
+    // add action to rebuild a motion tile recording into a video.
+    exportTilesAction = new QAction("Export Tile Recording", this);
+    fileMenu->insertAction(exitAction, exportTilesAction);
+    connect(exportTilesAction, SIGNAL(triggered(bool)), this, SLOT(exportTileRecording()));
 }
 
 void MainWindow::initUICameraMenu()
@@ -96,6 +154,33 @@ void MainWindow::initUICameraMenu()
    connect(cameraMirrorAction, SIGNAL(triggered(bool)), this, SLOT(doCameraMirror()));
    cameraMirrorAction->setShortcut(QKeySequence("Alt+M"));
 
+   // add network streaming toggle and its statistics.
+   streamAction = new QAction("Stream", this);
+   streamAction->setCheckable(true);
+   cameraMenu->addAction(streamAction);
+   cameraToolBar->addAction(streamAction);
+   connect(streamAction, SIGNAL(triggered(bool)), this, SLOT(toggleStreaming()));
+
+   streamInfoAction = new QAction("Stream Info", this);
+   cameraMenu->addAction(streamInfoAction);
+   connect(streamInfoAction, SIGNAL(triggered(bool)), this, SLOT(streamingInfo()));
+
+   // add per stream recording statistics.
+   recordInfoAction = new QAction("Recording Info", this);
+   cameraMenu->addAction(recordInfoAction);
+   connect(recordInfoAction, SIGNAL(triggered(bool)), this, SLOT(recordingInfo()));
+
+   // add motion tile storage toggle, used from the next recording on.
+   tileStorageAction = new QAction("Motion Tiles", this);
+   tileStorageAction->setCheckable(true);
+   cameraMenu->addAction(tileStorageAction);
+   connect(tileStorageAction, SIGNAL(triggered(bool)), this, SLOT(toggleTileStorage()));
+
+   // add active configuration and metrics dump.
+   pipelineInfoAction = new QAction("Pipeline Info", this);
+   cameraMenu->addAction(pipelineInfoAction);
+   connect(pipelineInfoAction, SIGNAL(triggered(bool)), this, SLOT(pipelineInfo()));
+
 }
 
 void MainWindow::initUIViewArea()
@@ -125,7 +210,7 @@ void MainWindow::initUIViewArea()
     imageView3->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 
     imageScene4 = new QGraphicsScene(6, 6, 6, 6, this);
-    imageScene4->addText("Empty.");
+    imageScene4->addText("Activity Heatmap");
     imageView4 = new QGraphicsView(imageScene4);
     imageView4->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     imageView4->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
@@ -158,9 +243,9 @@ void MainWindow::initUIViewArea()
     tools_layout->addWidget(playPauseButton, 0, 2);
     connect(playPauseButton, SIGNAL(clicked(bool)), this, SLOT(togglePlayPause(bool)));
 
-//    // list view bottom
-//    saved_list = new QListView(this);
-//    main_layout->addWidget(saved_list, 13, 0, 4, 1);
+    // saved recordings browser at the bottom
+    recordingsPanel = new recordings_panel(utilities::getDataPath(), this);
+    main_layout->addWidget(recordingsPanel, 13, 0, 4, 12);
 
     QWidget *widget = new QWidget();
     widget->setLayout(main_layout);
@@ -230,6 +315,10 @@ void MainWindow::cameraInfo(){
         info += "    - " + c_info.deviceName() + "\n";
         detailed_info += " - " + c_info.description() + "\n";
     }
+    if (cameraProbe.isFinished())
+        detailed_info += "\n" + camera_probe::report(cameraProbe.result());
+    if (capturer != nullptr)
+        detailed_info += "\n" + capturer->startupStats();
 
     msgBox.setInformativeText(info);
     msgBox.setDetailedText(detailed_info);
@@ -239,7 +328,24 @@ void MainWindow::cameraInfo(){
 
 QString MainWindow::selectCamera(){
 
-    QList<QCameraInfo> cameras = QCameraInfo::availableCameras();
+    // skip the devices the startup probe could not open or still holds,
+    // without opening anything here.
+    QStringList cameras;
+    foreach(QCameraInfo camera, QCameraInfo::availableCameras())
+    {
+        if (!camera_probe::isProbing(camera.deviceName()))
+            cameras.append(camera.deviceName());
+    }
+    if (cameraProbe.isFinished())
+    {
+        // a timed out device may just have been slow, isProbing() covers it
+        // while the probe still holds it.
+        foreach(probe_result result, cameraProbe.result())
+        {
+            if (!result.opened && !result.timed_out)
+                cameras.removeAll(result.device);
+        }
+    }
 
     // no camera available
     if (cameras.empty()){
@@ -249,13 +355,13 @@ QString MainWindow::selectCamera(){
 
    // single camera available
    if (cameras.length()==1){
-       return cameras.at(0).deviceName();
+       return cameras.at(0);
    }
 
    // multi cameras available - let user select camera.
     QMessageBox msgBox;
-    foreach(QCameraInfo camera, cameras){
-        msgBox.addButton(camera.deviceName(), QMessageBox::ActionRole);
+    foreach(QString camera, cameras){
+        msgBox.addButton(camera, QMessageBox::ActionRole);
     }
 
     QPushButton *cancelButton = msgBox.addButton(QMessageBox::Cancel);
@@ -289,6 +395,14 @@ void MainWindow::cameraOpen(){
         connect(capturer, &capture_thread::frameCaptured, this, &MainWindow::updateFrame);
         connect(capturer, &capture_thread::fpsChanged, this, &MainWindow::updateFPS);
         connect(capturer, &capture_thread::RunComplete, this, &MainWindow::closeCapturer);
+        connect(capturer, &capture_thread::jpegEncoded, streamServer, &mjpeg_server::publishFrame);
+        connect(capturer, &capture_thread::memoryLevelChanged, this, &MainWindow::updateMemoryLevel);
+        connect(streamServer, &mjpeg_server::streamDemandChanged, capturer, &capture_thread::setStreamDemand);
+        foreach(QString stream, mjpeg_server::streamNames())
+            capturer->setStreamDemand(stream, streamServer->clientCount(stream) > 0);
+        camera_config config = pipelineConfig->cameraConfig(camname);
+        capturer->applyConfig(config);
+        tileStorageAction->setChecked(config.tile_storage);
         capturer->start();
         // add the text to status label
         updateStatusBar("Camera Name", camname, false);
@@ -354,6 +468,35 @@ void MainWindow::updateBackgroundImage(cv::Mat *mat)
 
 }
 
+void MainWindow::updateHeatmap(cv::Mat *mat)
+{
+    data_lock->lock();
+    currentHeatmap = *mat;
+    data_lock->unlock();
+    updateView(imageScene4, imageView4, currentHeatmap);
+}
+
+void MainWindow::updateMemoryLevel(int level)
+{
+    updateStatusBar("Memory", level == memory_governor::NORMAL ? QString("")
+                    : "Memory: " + memory_governor::levelName(memory_governor::Level(level)));
+    if (level < memory_governor::NO_DISPLAY_COPIES)
+        return;
+
+    // the capturer stopped sending them, let the last ones go as well.
+    data_lock->lock();
+    currentFgMask.release();
+    currentBgImage.release();
+    currentHeatmap.release();
+    data_lock->unlock();
+    imageScene2->clear();
+    imageScene2->addText("Paused, memory budget");
+    imageScene3->clear();
+    imageScene3->addText("Paused, memory budget");
+    imageScene4->clear();
+    imageScene4->addText("Paused, memory budget");
+}
+
 void MainWindow::updateView(QGraphicsScene *scene, QGraphicsView *view, cv::Mat &image)
 {
     QImage frame(
@@ -466,8 +609,14 @@ void MainWindow::updateVideoRecordStatus(int status, QString saved_video_name)
 
 }
 
-void MainWindow::closeCapturer(bool)
+void MainWindow::closeCapturer(bool opened)
 {
+    if (!opened)
+    {
+        QMessageBox::information(this, "Information", "Failed to open " + capturer->camName());
+        isCameraOpen = false;
+        toggleHideActions(false);
+    }
 
     delete capturer;
     capturer = nullptr;
@@ -489,6 +638,7 @@ void MainWindow::updateMonitorStatus(int checked)
     {
         connect(capturer, &capture_thread::fgMaskCaptured, this, &MainWindow::updateFgMask);
         connect(capturer, &capture_thread::bgImageCaptured, this, &MainWindow::updateBackgroundImage);
+        connect(capturer, &capture_thread::heatmapCaptured, this, &MainWindow::updateHeatmap);
         capturer->setMotionDetectingStatus(true);
     }
 
@@ -517,3 +667,136 @@ void MainWindow::togglePlayPause(bool clicked)
         capturer->setPause(true);
     }
 }
+
+void MainWindow::toggleStreaming()
+{
+    if (streamServer->isListening())
+    {
+        streamServer->stop();
+        updateStatusBar("Stream", "");
+    }
+    else if (streamServer->start(pipelineConfig->cameraConfig("").stream_port))
+    {
+        updateStatusBar("Stream", QString("Streaming @:%1").arg(streamServer->port()));
+    }
+    streamAction->setChecked(streamServer->isListening());
+}
+
+void MainWindow::streamingInfo()
+{
+    QMessageBox::information(this, "Stream Info", streamServer->statsReport());
+}
+
+void MainWindow::recordingInfo()
+{
+    if (capturer == nullptr)
+        return;
+
+    QMessageBox::information(this, "Recording Info", capturer->recordingStats());
+}
+
+void MainWindow::toggleTileStorage()
+{
+    if (capturer == nullptr)
+        return;
+
+    capturer->setTileStorage(tileStorageAction->isChecked());
+}
+
+void MainWindow::exportTileRecording()
+{
+    QString path = QFileDialog::getOpenFileName(this, "Tile Recording", utilities::getDataPath(), "Tile recordings (*.tiles)");
+    if (path.isEmpty())
+        return;
+
+    // rebuild full frames into an avi next to the tile file, off the gui
+    // thread : a long recording takes a while to decode twice.
+    QString avi_path = path.left(path.lastIndexOf('.')) + ".export.avi";
+    exportTilesAction->setEnabled(false);
+    updateStatusBar("Export", "Exporting " + QFileInfo(path).fileName());
+
+    QFutureWatcher<QString> *watcher = new QFutureWatcher<QString>(this);
+    connect(watcher, &QFutureWatcher<QString>::finished, this, [this, watcher, path]() {
+        exportTilesAction->setEnabled(true);
+        updateStatusBar("Export", "");
+        QString result = watcher->result();
+        watcher->deleteLater();
+        if (result.isEmpty())
+            QMessageBox::information(this, "Information", "Failed to export " + path);
+        else
+            QMessageBox::information(this, "Tile Recording", result);
+    });
+    watcher->setFuture(QtConcurrent::run([path, avi_path]() {
+        tile_player player;
+        if (!player.open(path) || !player.exportVideo(avi_path))
+            return QString();
+        return "Exported to " + avi_path + "\n\n" + tile_player::benchmark(path);
+    }));
+}
+
+void MainWindow::reloadConfig()
+{
+    QStringList errors = pipelineConfig->validationErrors();
+    updateStatusBar("Config", errors.isEmpty() ? "" : QString("Config: %1 error(s)").arg(errors.size()));
+    alertDispatcher->setConfig(pipelineConfig->alertConfig());
+    objectDetector->setConfig(pipelineConfig->detectorConfig());
+    thread_tuning::setConfig(pipelineConfig->threadsConfig());
+    memory_governor::setConfig(pipelineConfig->memoryConfig());
+
+    if (capturer == nullptr)
+        return;
+
+    // applied between two frames, capture and background model keep running.
+    camera_config config = pipelineConfig->cameraConfig(capturer->camName());
+    capturer->applyConfig(config);
+    tileStorageAction->setChecked(config.tile_storage);
+}
+
+void MainWindow::pipelineInfo()
+{
+    QString info = QString("config file : %1\n").arg(pipeline_config::configPath());
+
+    QStringList errors = pipelineConfig->validationErrors();
+    if (!errors.isEmpty())
+        info += "validation errors :\n  " + errors.join("\n  ") + "\n";
+
+    if (capturer != nullptr)
+    {
+        info += QString("\nactive config (%1) :\n").arg(capturer->camName());
+        info += QJsonDocument(capturer->activeConfig().toJson()).toJson();
+        info += "\n" + mainStatusLabel->text() + "\n";
+        info += "\n" + capturer->startupStats();
+        info += "\n" + capturer->sceneStats();
+        info += "\n" + capturer->zoneStats();
+        info += "\n" + capturer->compositorStats();
+        info += "\n" + capturer->frameBusStats();
+        info += "\n" + capturer->pipelineStats();
+        info += "\n" + capturer->recordingStats();
+    }
+    info += "\n" + streamServer->statsReport();
+    info += "\n" + alertDispatcher->statsReport();
+    info += "\n" + objectDetector->statsReport();
+    info += "\n" + eventJournal->statsReport();
+    info += "\n" + thread_tuning::report();
+    info += "\n" + memory_governor::report();
+    foreach(journal_event event, eventJournal->tail(5))
+    {
+        double dwell_s = 0;
+        for (size_t i=0; i<event.tracks.size(); i++)
+            dwell_s = qMax(dwell_s, (event.tracks[i].last_ms - event.tracks[i].first_ms) / 1000.0);
+        info += QString("  %1 %2 %3 %4s, score %5, %6 blobs, %7 tracks (longest %8s)\n")
+                .arg(QDateTime::fromMSecsSinceEpoch(event.start_ms).toString("yyyy-MM-dd HH:mm:ss"))
+                .arg(event.camname)
+                .arg(event.kind)
+                .arg((event.end_ms - event.start_ms) / 1000.0, 0, 'f', 1)
+                .arg(event.motion_score, 0, 'f', 3)
+                .arg(event.blobs.size())
+                .arg(event.tracks.size())
+                .arg(dwell_s, 0, 'f', 1);
+    }
+
+    QMessageBox msgBox;
+    msgBox.setText("Pipeline Info");
+    msgBox.setDetailedText(info);
+    msgBox.exec();
+}
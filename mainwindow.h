@@ -16,6 +16,14 @@
 #include <QMutex>
 #include <string>
 #include "capture_thread.h"
+#include "mjpeg_server.h"
+#include "pipeline_config.h"
+#include "alert_dispatcher.h"
+#include "event_journal.h"
+#include "object_detector.h"
+#include "recordings_panel.h"
+#include "camera_probe.h"
+#include <QFuture>
 #include <opencv2/opencv.hpp>
 
 class MainWindow: public QMainWindow
@@ -47,6 +55,8 @@ private slots:
     void updateFrame(cv::Mat *mat);
     void updateFgMask(cv::Mat *mat);
     void updateBackgroundImage(cv::Mat *mat);
+    void updateHeatmap(cv::Mat *mat);
+    void updateMemoryLevel(int level);
     void updateFPS(float fps, int width, int height);
     void recordingStartStop();
     void updateVideoRecordStatus(int, QString );
@@ -54,6 +64,13 @@ private slots:
     void updateMonitorStatus(int);
     void updateView(QGraphicsScene *scene, QGraphicsView *view, cv::Mat &image);
     void togglePlayPause(bool);
+    void toggleStreaming();
+    void streamingInfo();
+    void recordingInfo();
+    void toggleTileStorage();
+    void exportTileRecording();
+    void reloadConfig();
+    void pipelineInfo();
 private:
     //------------------------
     // initial UI variables
@@ -71,6 +88,12 @@ private:
     QAction *stopCameraAction;
     QAction *fpsCalculationAction;
     QAction *cameraMirrorAction;
+    QAction *streamAction;
+    QAction *streamInfoAction;
+    QAction *recordInfoAction;
+    QAction *tileStorageAction;
+    QAction *exportTilesAction;
+    QAction *pipelineInfoAction;
     bool isCameraOpen = false;
 
     // graphic scene and view needed as image handling
@@ -105,14 +128,21 @@ private:
     QList<QString> *recordButtonText;
     QList<QString> *playPauseButtonText;
     bool clickedRecord=false;
-    QListView *saved_list;
+    recordings_panel *recordingsPanel;
 
     cv::Mat currentframe;
     cv::Mat currentFgMask;
     cv::Mat currentBgImage;
+    cv::Mat currentHeatmap;
 
     QMutex *data_lock;
     capture_thread *capturer;
+    mjpeg_server *streamServer;
+    pipeline_config *pipelineConfig;
+    alert_dispatcher *alertDispatcher;
+    event_journal *eventJournal;
+    object_detector *objectDetector;
+    QFuture<QList<probe_result>> cameraProbe;
 
 };
 
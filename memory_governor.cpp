@@ -0,0 +1,155 @@
+#include "memory_governor.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QMutexLocker>
+#include <unistd.h>
+
+QMutex memory_governor::lock;
+memory_config memory_governor::config;
+QMap<QString, QMap<QString, qint64>> memory_governor::cameras;
+QAtomicInt memory_governor::current_level(memory_governor::NORMAL);
+qint64 memory_governor::last_check_ms = 0;
+qint64 memory_governor::below_since_ms = 0;
+qint64 memory_governor::resident = 0;
+qint64 memory_governor::resident_peak = 0;
+int memory_governor::steps_up = 0;
+int memory_governor::steps_down = 0;
+
+static double toMb(qint64 bytes)
+{
+    return bytes / 1048576.0;
+}
+
+void memory_governor::setConfig(memory_config new_config)
+{
+    QMutexLocker locker(&lock);
+    config = new_config;
+
+    // without a budget nothing is held back.
+    if (config.budget_mb == 0 && current_level.loadAcquire() != NORMAL)
+    {
+        current_level.storeRelease(NORMAL);
+        qDebug() << "memory : no budget, back to" << levelName(NORMAL);
+    }
+}
+
+memory_governor::Level memory_governor::level()
+{
+    return Level(current_level.loadAcquire());
+}
+
+QString memory_governor::levelName(Level level)
+{
+    switch (level)
+    {
+    case NO_DISPLAY_COPIES: return "no display copies";
+    case REDUCED_ANALYSIS: return "reduced analysis";
+    case SMALL_BUFFERS: return "small buffers";
+    default: return "normal";
+    }
+}
+
+qint64 memory_governor::residentBytes()
+{
+    // "size resident shared ..." in pages.
+    QFile file("/proc/self/statm");
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    QList<QByteArray> fields = file.readAll().split(' ');
+    return fields.value(1).toLongLong() * sysconf(_SC_PAGESIZE);
+}
+
+memory_governor::Level memory_governor::poll()
+{
+    // the other cameras keep going while one of them checks.
+    if (!lock.tryLock())
+        return level();
+
+    qint64 now_ms = QDateTime::currentMSecsSinceEpoch();
+    if (now_ms - last_check_ms < config.check_interval_ms)
+    {
+        lock.unlock();
+        return level();
+    }
+    last_check_ms = now_ms;
+    resident = residentBytes();
+    resident_peak = qMax(resident_peak, resident);
+
+    int current = current_level.loadAcquire();
+    qint64 budget = qint64(config.budget_mb) * 1048576;
+    if (budget == 0 || resident == 0)
+        below_since_ms = 0;
+
+    // one step per interval, the cameras need a frame or two to let go.
+    else if (resident > budget)
+    {
+        below_since_ms = 0;
+        if (current < SMALL_BUFFERS)
+        {
+            current_level.storeRelease(++current);
+            steps_up++;
+            qDebug().noquote() << QString("memory : %1 MB resident, budget %2 MB, %3")
+                                  .arg(toMb(resident), 0, 'f', 0).arg(config.budget_mb).arg(levelName(Level(current)));
+        }
+    }
+    else if (resident < budget * config.recover_ratio && current > NORMAL)
+    {
+        if (below_since_ms == 0)
+            below_since_ms = now_ms;
+        else if (now_ms - below_since_ms >= config.recover_ms)
+        {
+            current_level.storeRelease(--current);
+            steps_down++;
+            below_since_ms = now_ms;
+            qDebug().noquote() << QString("memory : %1 MB resident, back to %2")
+                                  .arg(toMb(resident), 0, 'f', 0).arg(levelName(Level(current)));
+        }
+    }
+    else
+        below_since_ms = 0;
+
+    lock.unlock();
+    return Level(current);
+}
+
+void memory_governor::account(QString camera, QMap<QString, qint64> bytes)
+{
+    QMutexLocker locker(&lock);
+    cameras.insert(camera, bytes);
+}
+
+void memory_governor::remove(QString camera)
+{
+    QMutexLocker locker(&lock);
+    cameras.remove(camera);
+}
+
+QString memory_governor::report()
+{
+    QMutexLocker locker(&lock);
+    if (resident == 0)
+        resident = residentBytes();
+
+    QString report = QString("memory : %1 MB resident (peak %2), budget %3, %4, %5 steps up, %6 down\n")
+            .arg(toMb(resident), 0, 'f', 0).arg(toMb(resident_peak), 0, 'f', 0)
+            .arg(config.budget_mb > 0 ? QString("%1 MB").arg(config.budget_mb) : QString("off"))
+            .arg(levelName(Level(current_level.loadAcquire()))).arg(steps_up).arg(steps_down);
+
+    qint64 accounted = 0;
+    for (QMap<QString, QMap<QString, qint64>>::iterator it = cameras.begin(); it != cameras.end(); ++it)
+    {
+        QStringList parts;
+        qint64 total = 0;
+        for (QMap<QString, qint64>::iterator part = it->begin(); part != it->end(); ++part)
+        {
+            parts.append(QString("%1 %2").arg(part.key()).arg(toMb(part.value()), 0, 'f', 1));
+            total += part.value();
+        }
+        accounted += total;
+        report += QString("  %1 : %2 MB (%3)\n").arg(it.key()).arg(toMb(total), 0, 'f', 1).arg(parts.join(", "));
+    }
+    report += QString("  cameras %1 MB, rest of the process %2 MB\n")
+            .arg(toMb(accounted), 0, 'f', 0).arg(toMb(qMax(qint64(0), resident - accounted)), 0, 'f', 0);
+    return report;
+}
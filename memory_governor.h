@@ -0,0 +1,63 @@
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include <QString>
+#include <QMap>
+#include <QMutex>
+#include <QAtomicInt>
+#include "pipeline_config.h"
+
+/*
+ * keeps the resident size of the process under memory_config.budget_mb
+ * (linux), for small boxes with many cameras.
+ *
+ * every capture thread calls poll() once per frame, one of them reads
+ * /proc/self/statm every check_interval_ms. over budget the level goes
+ * one step up, and every camera applies it before its next frame :
+ *   NO_DISPLAY_COPIES  : no mask, background and heatmap images for the gui
+ *   REDUCED_ANALYSIS   : the background model runs on half size frames
+ *   SMALL_BUFFERS      : pipeline queues of one, no spare packets, two
+ *                        frame bus slots
+ * below recover_ratio of the budget for recover_ms it steps down again.
+ *
+ * the cameras account() what they hold per subsystem (capture, analysis,
+ * display, buffers), report() lists it against the resident size, the
+ * rest is the process itself : libraries, codecs, the gui, the heap.
+ */
+class memory_governor
+{
+public:
+    enum Level{
+        NORMAL,
+        NO_DISPLAY_COPIES,
+        REDUCED_ANALYSIS,
+        SMALL_BUFFERS
+    };
+
+    static void setConfig(memory_config config);
+    static Level poll();
+    static Level level();
+    static QString levelName(Level level);
+
+    // bytes per subsystem of a camera, replaces what it accounted before.
+    static void account(QString camera, QMap<QString, qint64> bytes);
+    static void remove(QString camera);
+
+    static QString report();
+
+private:
+    static qint64 residentBytes();
+
+    static QMutex lock;
+    static memory_config config;
+    static QMap<QString, QMap<QString, qint64>> cameras;
+    static QAtomicInt current_level;
+    static qint64 last_check_ms;
+    static qint64 below_since_ms;
+    static qint64 resident;
+    static qint64 resident_peak;
+    static int steps_up;
+    static int steps_down;
+};
+
+#endif // MEMORY_GOVERNOR_H
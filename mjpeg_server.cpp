@@ -0,0 +1,236 @@
+#include "mjpeg_server.h"
+#include <QDebug>
+#include <QHostAddress>
+
+static const QByteArray boundary = "frame";
+
+mjpeg_server::mjpeg_server(QObject *parent):
+    QObject(parent)
+{
+    server = new QTcpServer(this);
+    connect(server, &QTcpServer::newConnection, this, &mjpeg_server::onNewConnection);
+}
+
+mjpeg_server::~mjpeg_server()
+{
+    stop();
+}
+
+QStringList mjpeg_server::streamNames()
+{
+    return QStringList({"live", "overlay"});
+}
+
+bool mjpeg_server::start(quint16 port)
+{
+    if (server->isListening())
+        return true;
+
+    if (!server->listen(QHostAddress::Any, port))
+    {
+        qDebug() << "mjpeg server failed to listen : " << server->errorString();
+        return false;
+    }
+    qDebug() << QString("mjpeg server listening on port %1").arg(server->serverPort());
+    return true;
+}
+
+void mjpeg_server::stop()
+{
+    server->close();
+
+    // drop every client, demand goes to zero for all streams.
+    foreach(client_info *client, clients)
+    {
+        client->socket->disconnect(this);
+        client->socket->abort();
+        client->socket->deleteLater();
+        delete client;
+    }
+    clients.clear();
+
+    foreach(QString stream, streamNames())
+        emit streamDemandChanged(stream, false);
+}
+
+bool mjpeg_server::isListening(){return server->isListening();}
+
+quint16 mjpeg_server::port(){return server->serverPort();}
+
+void mjpeg_server::onNewConnection()
+{
+    while (server->hasPendingConnections())
+    {
+        client_info *client = new client_info();
+        client->socket = server->nextPendingConnection();
+        client->connected.start();
+        clients.append(client);
+
+        connect(client->socket, &QTcpSocket::readyRead, this, &mjpeg_server::onReadyRead);
+        connect(client->socket, &QTcpSocket::disconnected, this, &mjpeg_server::onDisconnected);
+    }
+}
+
+void mjpeg_server::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    foreach(client_info *client, clients)
+    {
+        if (client->socket != socket)
+            continue;
+
+        // only the request head matters, anything after it is ignored.
+        if (client->streaming)
+        {
+            socket->readAll();
+            return;
+        }
+
+        client->request += socket->readAll();
+        if (client->request.contains("\r\n\r\n"))
+            handleRequest(client);
+
+        // refuse oversized heads.
+        else if (client->request.size() > 8192)
+            socket->disconnectFromHost();
+        return;
+    }
+}
+
+void mjpeg_server::handleRequest(client_info *client)
+{
+    // request line : GET /live HTTP/1.1
+    QList<QByteArray> request_line = client->request.left(client->request.indexOf("\r\n")).split(' ');
+    QString path = request_line.size() > 1 ? QString(request_line.at(1)) : "";
+    QString stream = path.mid(1);
+
+    if (stream == "stats")
+    {
+        sendStats(client->socket);
+        return;
+    }
+
+    if (request_line.at(0) != "GET" || !streamNames().contains(stream))
+    {
+        client->socket->write("HTTP/1.0 404 Not Found\r\nConnection: close\r\n\r\n");
+        client->socket->disconnectFromHost();
+        return;
+    }
+
+    client->socket->write("HTTP/1.0 200 OK\r\n"
+                          "Cache-Control: no-cache\r\n"
+                          "Connection: close\r\n"
+                          "Content-Type: multipart/x-mixed-replace; boundary=" + boundary + "\r\n\r\n");
+
+    client->stream = stream;
+    client->streaming = true;
+    client->connected.restart();
+
+    if (clientCount(stream) == 1)
+        emit streamDemandChanged(stream, true);
+}
+
+void mjpeg_server::sendStats(QTcpSocket *socket)
+{
+    QByteArray body = statsReport().toUtf8();
+    socket->write("HTTP/1.0 200 OK\r\nConnection: close\r\nContent-Type: text/plain\r\n");
+    socket->write(QString("Content-Length: %1\r\n\r\n").arg(body.size()).toUtf8());
+    socket->write(body);
+    socket->disconnectFromHost();
+}
+
+void mjpeg_server::onDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    for (int i=0; i<clients.size(); i++)
+    {
+        client_info *client = clients.at(i);
+        if (client->socket != socket)
+            continue;
+
+        clients.removeAt(i);
+        QString stream = client->stream;
+        bool was_streaming = client->streaming;
+        socket->deleteLater();
+        delete client;
+
+        if (was_streaming && clientCount(stream) == 0)
+            emit streamDemandChanged(stream, false);
+        return;
+    }
+}
+
+int mjpeg_server::clientCount(QString stream)
+{
+    int count = 0;
+    foreach(client_info *client, clients)
+    {
+        if (client->streaming && client->stream == stream)
+            count++;
+    }
+    return count;
+}
+
+void mjpeg_server::publishFrame(QString stream, QByteArray jpeg, double encode_ms)
+{
+    stream_stats &stream_stat = stats[stream];
+    stream_stat.frames_encoded++;
+    stream_stat.encode_ms_total += encode_ms;
+    stream_stat.last_frame_bytes = jpeg.size();
+
+    QByteArray part_header = QString("--%1\r\nContent-Type: image/jpeg\r\nContent-Length: %2\r\n\r\n")
+            .arg(QString(boundary)).arg(jpeg.size()).toUtf8();
+
+    foreach(client_info *client, clients)
+    {
+        if (!client->streaming || client->stream != stream)
+            continue;
+
+        // slow client, still busy with an older frame : drop this one.
+        if (client->socket->bytesToWrite() > jpeg.size())
+        {
+            client->frames_dropped++;
+            continue;
+        }
+
+        client->socket->write(part_header);
+        client->socket->write(jpeg);
+        client->socket->write("\r\n");
+        client->bytes_sent += part_header.size() + jpeg.size() + 2;
+        client->frames_sent++;
+    }
+}
+
+QString mjpeg_server::statsReport()
+{
+    QString report = QString("mjpeg server : %1\n").arg(
+                server->isListening() ? QString("port %1").arg(server->serverPort()) : QString("stopped"));
+
+    foreach(QString stream, stats.keys())
+    {
+        stream_stats stream_stat = stats.value(stream);
+        double avg_ms = stream_stat.frames_encoded ? stream_stat.encode_ms_total / stream_stat.frames_encoded : 0.0;
+        report += QString("stream /%1 : %2 frames encoded, %3 ms/frame, %4 KB last frame, %5 clients\n")
+                .arg(stream)
+                .arg(stream_stat.frames_encoded)
+                .arg(avg_ms, 0, 'f', 2)
+                .arg(stream_stat.last_frame_bytes / 1024.0, 0, 'f', 1)
+                .arg(clientCount(stream));
+    }
+
+    foreach(client_info *client, clients)
+    {
+        if (!client->streaming)
+            continue;
+
+        double seconds = client->connected.elapsed() / 1000.0;
+        double kbps = seconds > 0 ? client->bytes_sent * 8 / 1000.0 / seconds : 0.0;
+        report += QString("  %1 /%2 : %3 kbit/s, %4 sent, %5 dropped\n")
+                .arg(client->socket->peerAddress().toString())
+                .arg(client->stream)
+                .arg(kbps, 0, 'f', 1)
+                .arg(client->frames_sent)
+                .arg(client->frames_dropped);
+    }
+    return report;
+}
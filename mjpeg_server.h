@@ -0,0 +1,83 @@
+#ifndef MJPEG_SERVER_H
+#define MJPEG_SERVER_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+/*
+ * serves the encoded camera streams as MJPEG over HTTP.
+ *
+ *  GET /live     -> multipart jpeg stream of the camera frames
+ *  GET /overlay  -> same frames with the foreground mask painted in red
+ *  GET /stats    -> plain text report of clients and encode cost
+ *
+ * every frame is encoded once by the capture thread and the same
+ * QByteArray is handed to all clients of the stream. the sockets still
+ * copy it into their own write buffers, so each client costs a memcpy of
+ * the jpeg but never another encode. a client whose socket still holds
+ * more than a frame of unsent data is skipped, so a slow viewer drops
+ * frames instead of growing buffers.
+ */
+class mjpeg_server : public QObject
+{
+    Q_OBJECT;
+
+public:
+    explicit mjpeg_server(QObject *parent=nullptr);
+    ~mjpeg_server();
+
+    bool start(quint16 port);
+    void stop();
+    bool isListening();
+    quint16 port();
+    QString statsReport();
+    int clientCount(QString stream);
+
+    // streams served by this server
+    static QStringList streamNames();
+
+public slots:
+    void publishFrame(QString stream, QByteArray jpeg, double encode_ms);
+
+signals:
+    // emitted whenever a stream gains its first or loses its last client.
+    void streamDemandChanged(QString stream, bool wanted);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    struct client_info{
+        QTcpSocket *socket;
+        QString stream;
+        QByteArray request;
+        bool streaming=false;
+        qint64 bytes_sent=0;
+        int frames_sent=0;
+        int frames_dropped=0;
+        QElapsedTimer connected;
+    };
+
+    struct stream_stats{
+        int frames_encoded=0;
+        double encode_ms_total=0.0;
+        qint64 last_frame_bytes=0;
+    };
+
+    void handleRequest(client_info *client);
+    void sendStats(QTcpSocket *socket);
+
+    QTcpServer *server;
+    QList<client_info*> clients;
+    QMap<QString, stream_stats> stats;
+};
+
+#endif // MJPEG_SERVER_H
@@ -0,0 +1,297 @@
+#include "object_detector.h"
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+#include <QMutexLocker>
+#include "thread_tuning.h"
+
+object_detector *object_detector::current = nullptr;
+
+object_detector::object_detector()
+{
+    // set before start() so an early setRunning(false) is never lost.
+    running = true;
+    clock.start();
+    current = this;
+}
+
+object_detector::~object_detector()
+{
+    if (current == this)
+        current = nullptr;
+}
+
+object_detector *object_detector::instance(){return current;}
+
+void object_detector::setRunning(bool run)
+{
+    lock.lock();
+    running = run;
+    wake.wakeAll();
+    lock.unlock();
+}
+
+void object_detector::setConfig(detector_config new_config)
+{
+    // only a new model or label file is loaded again.
+    lock.lock();
+    if (new_config.model != config.model || new_config.labels != config.labels || !ready)
+        model_dirty = true;
+    config = new_config;
+    wake.wakeAll();
+    lock.unlock();
+}
+
+bool object_detector::isReady()
+{
+    QMutexLocker locker(&lock);
+    return ready;
+}
+
+bool object_detector::submit(QString camname, qint64 id, std::vector<cv::Mat> crops, std::vector<cv::Rect> boxes)
+{
+    QMutexLocker locker(&lock);
+    requests++;
+    if (!ready || queued_crops + int(crops.size()) > config.max_queue)
+    {
+        skipped++;
+        return false;
+    }
+
+    request item;
+    item.camname = camname;
+    item.id = id;
+    item.submitted_ms = clock.elapsed();
+    item.crops = crops;
+    item.boxes = boxes;
+    queue.append(item);
+    queued_crops += crops.size();
+    wake.wakeOne();
+    return true;
+}
+
+bool object_detector::takeResult(QString camname, detection_result &result)
+{
+    QMutexLocker locker(&lock);
+    if (!results.contains(camname))
+        return false;
+    result = results.take(camname);
+    return true;
+}
+
+void object_detector::loadModel(detector_config new_config)
+{
+    model_config = new_config;
+    labels.clear();
+    net = cv::dnn::Net();
+    bool loaded = false;
+    QString error;
+
+    if (!new_config.model.isEmpty())
+    {
+        try
+        {
+            net = cv::dnn::readNet(new_config.model.toStdString());
+            net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+            net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+            loaded = !net.empty();
+        }
+        catch (const cv::Exception &e)
+        {
+            error = QString("failed to load %1 : %2").arg(new_config.model, e.what());
+            qDebug() << error;
+        }
+
+        QFile file(new_config.labels);
+        if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            QTextStream in(&file);
+            while (!in.atEnd())
+                labels.append(in.readLine().trimmed());
+        }
+    }
+
+    lock.lock();
+    ready = loaded;
+    last_error = error;
+    lock.unlock();
+}
+
+cv::Mat object_detector::forward(const std::vector<cv::Mat> &images)
+{
+    cv::Size size(model_config.input_size, model_config.input_size);
+    cv::Scalar mean = cv::Scalar::all(model_config.mean);
+
+    // one pass for the whole batch, one row of scores per crop.
+    try
+    {
+        net.setInput(cv::dnn::blobFromImages(images, model_config.scale, size, mean, model_config.swap_rb, false));
+        return net.forward().reshape(1, int(images.size())).clone();
+    }
+    catch (const cv::Exception &)
+    {
+        if (images.size() == 1)
+            throw;
+    }
+
+    // models exported with a fixed batch of one take the crops one by one.
+    cv::Mat scores;
+    for (size_t i=0; i<images.size(); i++)
+    {
+        net.setInput(cv::dnn::blobFromImage(images[i], model_config.scale, size, mean, model_config.swap_rb, false));
+        scores.push_back(net.forward().reshape(1, 1));
+    }
+    return scores;
+}
+
+void object_detector::classify(QList<request> &batch)
+{
+    std::vector<cv::Mat> images;
+    foreach(request item, batch)
+        images.insert(images.end(), item.crops.begin(), item.crops.end());
+
+    QElapsedTimer timer;
+    timer.start();
+    cv::Mat scores;
+    try
+    {
+        scores = forward(images);
+    }
+    catch (const cv::Exception &e)
+    {
+        QMutexLocker locker(&lock);
+        last_error = e.what();
+        foreach(request item, batch)
+        {
+            detection_result result;
+            result.id = item.id;
+            result.skipped = true;
+            results[item.camname] = result;
+            skipped++;
+        }
+        return;
+    }
+    double batch_ms = timer.nsecsElapsed() / 1e6;
+
+    int row = 0;
+    QList<detection_result> batch_results;
+    foreach(request item, batch)
+    {
+        detection_result result;
+        result.id = item.id;
+        for (size_t i=0; i<item.crops.size(); i++, row++)
+        {
+            cv::Mat crop_scores;
+            scores.row(row).convertTo(crop_scores, CV_32F);
+
+            // raw logits are turned into probabilities first.
+            double sum = cv::sum(crop_scores)[0];
+            double min_score;
+            cv::minMaxLoc(crop_scores, &min_score);
+            if (min_score < 0 || std::abs(sum - 1) > 0.01)
+            {
+                double max_score;
+                cv::minMaxLoc(crop_scores, nullptr, &max_score);
+                cv::exp(crop_scores - max_score, crop_scores);
+                crop_scores /= cv::sum(crop_scores)[0];
+            }
+
+            cv::Point best;
+            double confidence;
+            cv::minMaxLoc(crop_scores, nullptr, &confidence, nullptr, &best);
+            if (confidence < model_config.min_confidence)
+                continue;
+
+            detection found;
+            found.box = item.boxes[i];
+            found.confidence = confidence;
+            found.label = best.x < labels.size() ? labels.at(best.x) : QString::number(best.x);
+            result.detections.append(found);
+        }
+        batch_results.append(result);
+    }
+
+    QMutexLocker locker(&lock);
+    for (int i=0; i<batch.size(); i++)
+        results[batch.at(i).camname] = batch_results.at(i);
+    crops_classified += images.size();
+    batches++;
+    batch_ms_total += batch_ms;
+    batch_ms_max = qMax(batch_ms_max, batch_ms);
+}
+
+void object_detector::run()
+{
+    thread_tuning::registerThread("analysis", "detector");
+    while (true)
+    {
+        lock.lock();
+        if (queue.isEmpty() && running && !model_dirty)
+            wake.wait(&lock, 200);
+        if (!running)
+        {
+            lock.unlock();
+            break;
+        }
+
+        if (model_dirty)
+        {
+            detector_config new_config = config;
+            model_dirty = false;
+            lock.unlock();
+            loadModel(new_config);
+            lock.lock();
+        }
+        model_config.min_confidence = config.min_confidence;
+
+        // take what fits one batch, skip what waited too long.
+        qint64 now_ms = clock.elapsed();
+        QList<request> batch;
+        int batch_crops = 0;
+        while (!queue.isEmpty())
+        {
+            const request &next = queue.first();
+            if (!ready || now_ms - next.submitted_ms > config.max_age_ms)
+            {
+                detection_result result;
+                result.id = next.id;
+                result.skipped = true;
+                results[next.camname] = result;
+                queued_crops -= next.crops.size();
+                skipped++;
+                queue.removeFirst();
+                continue;
+            }
+            if (batch_crops > 0 && batch_crops + int(next.crops.size()) > config.max_batch)
+                break;
+            batch_crops += next.crops.size();
+            queued_crops -= next.crops.size();
+            batch.append(queue.takeFirst());
+        }
+        lock.unlock();
+
+        if (!batch.isEmpty())
+            classify(batch);
+    }
+
+    thread_tuning::unregisterThread();
+    qDebug() << "object detector stopped.";
+}
+
+QString object_detector::statsReport()
+{
+    QMutexLocker locker(&lock);
+    if (!ready)
+        return QString("object detector : off%1\n").arg(config.model.isEmpty() ? "" : ", " + last_error);
+
+    QString report = QString("object detector : %1, %2 crops waiting\n").arg(config.model).arg(queued_crops);
+    report += QString("  %1 requests, %2 skipped, %3 crops in %4 batches\n")
+            .arg(requests).arg(skipped).arg(crops_classified).arg(batches);
+    report += QString("  %1 ms/batch (max %2), %3 ms/crop\n")
+            .arg(batches ? batch_ms_total / batches : 0.0, 0, 'f', 1)
+            .arg(batch_ms_max, 0, 'f', 1)
+            .arg(crops_classified ? batch_ms_total / crops_classified : 0.0, 0, 'f', 2);
+    if (!last_error.isEmpty())
+        report += "  last error : " + last_error + "\n";
+    return report;
+}
@@ -0,0 +1,107 @@
+#ifndef OBJECT_DETECTOR_H
+#define OBJECT_DETECTOR_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMap>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+#include "pipeline_config.h"
+
+struct detection
+{
+    cv::Rect box;               // in frame coordinates
+    QString label;
+    float confidence=0;
+};
+
+struct detection_result
+{
+    qint64 id=0;                // as passed to submit()
+    bool skipped=false;         // dropped under load, nothing was classified
+    QList<detection> detections;
+};
+
+/*
+ * classifies motion blob crops with a small cpu dnn model.
+ *
+ * capture threads submit() the crops of one frame and poll takeResult()
+ * on later frames; nothing blocks the capture loop. the detector thread
+ * gathers the waiting crops of all cameras into one batch per forward
+ * pass. under load it skips instead of falling behind : a submit beyond
+ * max_queue crops is refused, and requests older than max_age_ms come
+ * back as skipped, so the camera can fall back to plain motion.
+ */
+class object_detector : public QThread
+{
+    Q_OBJECT;
+
+public:
+    object_detector();
+    ~object_detector();
+
+    // the detector capture threads feed, may be null.
+    static object_detector *instance();
+
+    void setConfig(detector_config config);
+    void setRunning(bool);
+    bool isReady();
+
+    // false when the request was skipped right away.
+    bool submit(QString camname, qint64 id, std::vector<cv::Mat> crops, std::vector<cv::Rect> boxes);
+    bool takeResult(QString camname, detection_result &result);
+
+    QString statsReport();
+
+protected:
+    void run() override;
+
+private:
+    struct request{
+        QString camname;
+        qint64 id;
+        qint64 submitted_ms;
+        std::vector<cv::Mat> crops;
+        std::vector<cv::Rect> boxes;
+    };
+
+    void loadModel(detector_config new_config);
+    cv::Mat forward(const std::vector<cv::Mat> &images);
+    void classify(QList<request> &batch);
+
+    static object_detector *current;
+
+    QMutex lock;
+    QWaitCondition wake;
+    bool running=false;
+    bool model_dirty=false;
+    bool ready=false;
+    detector_config config;
+    QElapsedTimer clock;
+
+    QList<request> queue;
+    int queued_crops=0;
+    QMap<QString, detection_result> results;
+
+    // only touched by the detector thread
+    cv::dnn::Net net;
+    QStringList labels;
+    detector_config model_config;
+
+    // metrics
+    qint64 requests=0;
+    qint64 crops_classified=0;
+    qint64 batches=0;
+    qint64 skipped=0;
+    double batch_ms_total=0;
+    double batch_ms_max=0;
+    QString last_error;
+};
+
+#endif // OBJECT_DETECTOR_H
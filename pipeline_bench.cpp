@@ -0,0 +1,437 @@
+#include "pipeline_bench.h"
+#include "capture_thread.h"
+#include "utilities.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QThread>
+#include <QThreadPool>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+// rough memory of one camera per pixel, mostly the MOG2 mixtures.
+static const qint64 bytes_per_pixel = 150;
+static const int sample_ms = 50;
+static const double clip_fps = 30;
+
+// heap allocations, counted while a run is measured.
+static std::atomic<bool> counting(false);
+static std::atomic<qint64> allocations(0);
+static std::atomic<qint64> allocated_bytes(0);
+
+static inline void countAllocation(size_t size)
+{
+    if (!counting.load(std::memory_order_relaxed))
+        return;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+#if defined(BENCH) && defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+// only the bench binary (bench.pro) replaces the allocator, the software
+// keeps whatever malloc it is linked or preloaded with. the executable's
+// malloc wins over libc's for every library, so opencv and qt allocations
+// are counted too. the real work stays in glibc.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+
+void *malloc(size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment % sizeof(void*) != 0)
+        return EINVAL;
+    countAllocation(size);
+    void *memory = __libc_memalign(alignment, size);
+    if (memory == nullptr)
+        return ENOMEM;
+    *ptr = memory;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *valloc(size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_valloc(size);
+}
+
+void *pvalloc(size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_pvalloc(size);
+}
+}
+#endif
+
+static QString option(const QStringList &arguments, QString name, QString fallback)
+{
+    int index = arguments.indexOf(name);
+    if (index < 0 || index + 1 >= arguments.size())
+        return fallback;
+    return arguments[index + 1];
+}
+
+qint64 pipeline_bench::readMemInfo(QString path, QString key)
+{
+    // "VmRSS:    123456 kB", in bytes.
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    foreach(QString line, QString::fromLatin1(file.readAll()).split('\n'))
+    {
+        if (line.startsWith(key + ":"))
+            return line.section(':', 1).trimmed().section(' ', 0, 0).toLongLong() * 1024;
+    }
+    return 0;
+}
+
+double pipeline_bench::percentile(const std::vector<float> &sorted, double q)
+{
+    if (sorted.empty())
+        return 0;
+    size_t index = std::min(sorted.size() - 1, size_t(q * (sorted.size() - 1) + 0.5));
+    return sorted[index];
+}
+
+bool pipeline_bench::generateClip(QString path, int width, int height, int frames)
+{
+    cv::VideoWriter writer(path.toStdString(), cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), clip_fps, cv::Size(width, height));
+    if (!writer.isOpened())
+        return false;
+
+    // a smooth random background, the same for every run.
+    cv::RNG rng(20210128);
+    cv::Mat coarse(height / 16, width / 16, CV_8UC3), background;
+    rng.fill(coarse, cv::RNG::UNIFORM, 40, 200);
+    cv::resize(coarse, background, cv::Size(width, height), 0, 0, cv::INTER_CUBIC);
+
+    // three objects crossing the scene from frame 10, bouncing at the edges.
+    struct mover{ cv::Point2f position, speed; cv::Size size; cv::Scalar color; };
+    float unit = width / 1280.0f;
+    std::vector<mover> movers = {
+        {{0.1f * width, 0.3f * height}, {5 * unit, 2 * unit}, cv::Size(80 * unit, 160 * unit), cv::Scalar(30, 30, 220)},
+        {{0.7f * width, 0.6f * height}, {-4 * unit, -1 * unit}, cv::Size(200 * unit, 90 * unit), cv::Scalar(220, 60, 30)},
+        {{0.4f * width, 0.1f * height}, {2 * unit, 4 * unit}, cv::Size(60 * unit, 60 * unit), cv::Scalar(40, 200, 40)}};
+
+    cv::Mat frame;
+    for (int i=0; i<frames; i++)
+    {
+        background.copyTo(frame);
+        for (mover &m : movers)
+        {
+            if (i < 10)
+                continue;
+            m.position += m.speed;
+            if (m.position.x < 0 || m.position.x + m.size.width > width)
+                m.speed.x = -m.speed.x;
+            if (m.position.y < 0 || m.position.y + m.size.height > height)
+                m.speed.y = -m.speed.y;
+            cv::rectangle(frame, cv::Rect(cv::Point(m.position), m.size), m.color, cv::FILLED);
+        }
+        writer.write(frame);
+    }
+    writer.release();
+    return true;
+}
+
+QString pipeline_bench::clipPath(const run_spec &spec, QString clips_dir, QString work_dir, int frames)
+{
+    QString bundled = QString("%1/%2.avi").arg(clips_dir, spec.size_name);
+    if (!clips_dir.isEmpty() && QFileInfo::exists(bundled))
+        return bundled;
+
+    // generated clips are kept, the frame count is part of the name.
+    QString generated = QString("%1/clips/%2_%3.avi").arg(work_dir, spec.size_name).arg(frames);
+    if (QFileInfo::exists(generated))
+        return generated;
+    QDir().mkpath(work_dir + "/clips");
+    qInfo().noquote() << QString("generating %1 ...").arg(generated);
+    if (!generateClip(generated, spec.width, spec.height, frames))
+        return QString();
+    return generated;
+}
+
+QJsonObject pipeline_bench::runOnce(const run_spec &spec, QString clip, QString work_dir, bool keep)
+{
+    QString name = QString("%1 x%2").arg(spec.size_name).arg(spec.cameras);
+    QJsonObject result;
+    result["name"] = name;
+    result["width"] = spec.width;
+    result["height"] = spec.height;
+    result["cameras"] = spec.cameras;
+
+    qint64 needed = qint64(spec.cameras) * spec.width * spec.height * bytes_per_pixel;
+    qint64 available = readMemInfo("/proc/meminfo", "MemAvailable");
+    if (available > 0 && needed > available)
+    {
+        result["skipped"] = QString("needs about %1 MB, %2 MB available").arg(needed >> 20).arg(available >> 20);
+        return result;
+    }
+
+    // recordings of this run only, the cameras apart by their prefix.
+    QString run_dir = QString("%1/run_%2_x%3").arg(work_dir, spec.size_name).arg(spec.cameras);
+    QDir(run_dir).removeRecursively();
+    utilities::setDataPath(run_dir);
+
+    camera_config config;
+    config.frame_width = spec.width;
+    config.frame_height = spec.height;
+    config.warm_start = false;
+
+    QList<QMutex*> locks;
+    QList<capture_thread*> cameras;
+    for (int i=0; i<spec.cameras; i++)
+    {
+        QMutex *lock = new QMutex();
+        capture_thread *camera = new capture_thread(clip.toStdString(), lock);
+        camera->applyConfig(config);
+        camera->setMotionDetectingStatus(true);
+        camera->setPause(false);
+        camera->setRecordingPrefix(QString("cam%1_").arg(i, 2, 10, QChar('0')));
+        locks.append(lock);
+        cameras.append(camera);
+    }
+
+    qint64 rss_before = readMemInfo("/proc/self/status", "VmRSS");
+    qint64 rss_peak = rss_before;
+    allocations = 0;
+    allocated_bytes = 0;
+    counting = true;
+
+    QElapsedTimer timer;
+    timer.start();
+    foreach(capture_thread *camera, cameras)
+        camera->start();
+
+    std::vector<float> latencies;
+    bool running = true;
+    while (running)
+    {
+        QThread::msleep(sample_ms);
+        running = false;
+        foreach(capture_thread *camera, cameras)
+        {
+            std::vector<float> taken = camera->takeFrameLatencies();
+            latencies.insert(latencies.end(), taken.begin(), taken.end());
+            running = running || camera->isRunning();
+        }
+        rss_peak = std::max(rss_peak, readMemInfo("/proc/self/status", "VmRSS"));
+    }
+    double seconds = timer.nsecsElapsed() / 1e9;
+
+    // the last segments are renamed and synced on the pool.
+    QThreadPool::globalInstance()->waitForDone();
+    counting = false;
+    foreach(capture_thread *camera, cameras)
+    {
+        std::vector<float> taken = camera->takeFrameLatencies();
+        latencies.insert(latencies.end(), taken.begin(), taken.end());
+        delete camera;
+    }
+    qDeleteAll(locks);
+
+    qint64 bytes_written = 0;
+    QDirIterator files(run_dir, QDir::Files, QDirIterator::Subdirectories);
+    while (files.hasNext())
+    {
+        files.next();
+        bytes_written += files.fileInfo().size();
+    }
+    if (!keep)
+        QDir(run_dir).removeRecursively();
+
+    std::sort(latencies.begin(), latencies.end());
+    qint64 frames = latencies.size();
+    if (frames == 0)
+    {
+        result["skipped"] = QString("no frames, could not open %1").arg(clip);
+        return result;
+    }
+
+    QJsonObject latency;
+    latency["p50"] = percentile(latencies, 0.50);
+    latency["p95"] = percentile(latencies, 0.95);
+    latency["p99"] = percentile(latencies, 0.99);
+    latency["max"] = latencies.back();
+
+    result["frames"] = frames;
+    result["seconds"] = seconds;
+    result["fps_total"] = frames / seconds;
+    result["fps_per_camera"] = frames / seconds / spec.cameras;
+    result["latency_ms"] = latency;
+    result["rss_peak_mb"] = rss_peak / 1048576.0;
+    result["rss_growth_mb"] = (rss_peak - rss_before) / 1048576.0;
+    result["allocations"] = double(allocations.load());
+    result["allocations_per_frame"] = double(allocations.load()) / frames;
+    result["allocated_mb"] = allocated_bytes.load() / 1048576.0;
+    result["bytes_written"] = double(bytes_written);
+    return result;
+}
+
+QStringList pipeline_bench::compare(const QJsonObject &report, const QJsonObject &baseline, double tolerance)
+{
+    QMap<QString, QJsonObject> old_runs;
+    foreach(QJsonValue value, baseline.value("runs").toArray())
+        old_runs.insert(value.toObject().value("name").toString(), value.toObject());
+
+    QStringList regressions;
+    foreach(QJsonValue value, report.value("runs").toArray())
+    {
+        QJsonObject run = value.toObject();
+        QString name = run.value("name").toString();
+        if (run.contains("skipped") || !old_runs.contains(name) || old_runs[name].contains("skipped"))
+            continue;
+        QJsonObject old = old_runs[name];
+
+        double fps = run.value("fps_total").toDouble();
+        double old_fps = old.value("fps_total").toDouble();
+        if (fps < old_fps * (1 - tolerance))
+            regressions.append(QString("%1 : fps %2, baseline %3").arg(name).arg(fps, 0, 'f', 1).arg(old_fps, 0, 'f', 1));
+
+        double p95 = run.value("latency_ms").toObject().value("p95").toDouble();
+        double old_p95 = old.value("latency_ms").toObject().value("p95").toDouble();
+        if (p95 > old_p95 * (1 + tolerance))
+            regressions.append(QString("%1 : p95 latency %2 ms, baseline %3 ms").arg(name).arg(p95, 0, 'f', 2).arg(old_p95, 0, 'f', 2));
+
+        double rss = run.value("rss_peak_mb").toDouble();
+        double old_rss = old.value("rss_peak_mb").toDouble();
+        if (rss > old_rss * (1 + tolerance))
+            regressions.append(QString("%1 : peak rss %2 MB, baseline %3 MB").arg(name).arg(rss, 0, 'f', 0).arg(old_rss, 0, 'f', 0));
+    }
+    return regressions;
+}
+
+int pipeline_bench::run(QStringList arguments)
+{
+    QStringList sizes = option(arguments, "--sizes", "720p,1080p,4k").split(',');
+    QStringList camera_counts = option(arguments, "--cameras", "1,4,16").split(',');
+    int frames = option(arguments, "--frames", "300").toInt();
+    QString output = option(arguments, "--output", "bench.json");
+    QString baseline_path = option(arguments, "--baseline", "");
+    double tolerance = option(arguments, "--tolerance", "0.1").toDouble();
+    QString work_dir = option(arguments, "--work", QDir::temp().absoluteFilePath("software-bench"));
+    QString clips_dir = option(arguments, "--clips", "");
+    bool keep = arguments.contains("--keep");
+
+    QMap<QString, cv::Size> known_sizes;
+    known_sizes.insert("720p", cv::Size(1280, 720));
+    known_sizes.insert("1080p", cv::Size(1920, 1080));
+    known_sizes.insert("4k", cv::Size(3840, 2160));
+
+    QJsonArray runs;
+    foreach(QString size_name, sizes)
+    {
+        if (!known_sizes.contains(size_name))
+        {
+            qWarning().noquote() << QString("unknown size %1, expected 720p, 1080p or 4k").arg(size_name);
+            return 2;
+        }
+        foreach(QString count, camera_counts)
+        {
+            run_spec spec{size_name, known_sizes[size_name].width, known_sizes[size_name].height, qMax(1, count.toInt())};
+            QString clip = clipPath(spec, clips_dir, work_dir, frames);
+            if (clip.isEmpty())
+            {
+                qWarning().noquote() << QString("could not write a %1 clip, no MJPG encoder?").arg(size_name);
+                return 2;
+            }
+
+            QJsonObject result = runOnce(spec, clip, work_dir, keep);
+            runs.append(result);
+            if (result.contains("skipped"))
+                qInfo().noquote() << QString("%1 : skipped, %2").arg(result["name"].toString(), result["skipped"].toString());
+            else
+                qInfo().noquote() << QString("%1 : %2 fps (%3 per camera), latency p50 %4 / p99 %5 ms, rss %6 MB, %7 allocs/frame")
+                                     .arg(result["name"].toString())
+                                     .arg(result["fps_total"].toDouble(), 0, 'f', 1)
+                                     .arg(result["fps_per_camera"].toDouble(), 0, 'f', 1)
+                                     .arg(result["latency_ms"].toObject()["p50"].toDouble(), 0, 'f', 2)
+                                     .arg(result["latency_ms"].toObject()["p99"].toDouble(), 0, 'f', 2)
+                                     .arg(result["rss_peak_mb"].toDouble(), 0, 'f', 0)
+                                     .arg(result["allocations_per_frame"].toDouble(), 0, 'f', 0);
+        }
+    }
+
+    QJsonObject host;
+    host["cpus"] = int(sysconf(_SC_NPROCESSORS_ONLN));
+    host["opencv"] = QString(CV_VERSION);
+    host["qt"] = QString(qVersion());
+    host["opencv_threads"] = cv::getNumThreads();
+
+    QJsonObject report;
+    report["version"] = 1;
+    report["date"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    report["host"] = host;
+    report["frames_per_clip"] = frames;
+    report["runs"] = runs;
+
+    QStringList regressions;
+    if (!baseline_path.isEmpty())
+    {
+        QFile file(baseline_path);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qWarning().noquote() << "could not read the baseline " + baseline_path;
+            return 2;
+        }
+        regressions = compare(report, QJsonDocument::fromJson(file.readAll()).object(), tolerance);
+        report["baseline"] = baseline_path;
+        report["tolerance"] = tolerance;
+        report["regressions"] = QJsonArray::fromStringList(regressions);
+        foreach(QString regression, regressions)
+            qWarning().noquote() << "regression " + regression;
+    }
+
+    QFile file(output);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning().noquote() << "could not write " + output;
+        return 2;
+    }
+    file.write(QJsonDocument(report).toJson());
+    qInfo().noquote() << "report written to " + output;
+    return regressions.isEmpty() ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#ifndef PIPELINE_BENCH_H
+#define PIPELINE_BENCH_H
+
+#include <QString>
+#include <QStringList>
+#include <QJsonObject>
+#include <vector>
+
+/*
+ * end to end benchmark of the capture pipeline, "make bench" or
+ * "qmake bench.pro && make && ./bench --bench". only the bench binary has
+ * it, built with BENCH and the heap counting allocator.
+ *
+ * every run starts a number of capture_threads on a generated clip, so
+ * each simulated camera decodes, detects and tracks motion, records the
+ * motion and composes the display frame exactly like a live camera does,
+ * only as fast as it can. the clips are generated once per size with a
+ * fixed seed (or taken from --clips <dir>/<size>.avi) and are reused.
+ *
+ *   --sizes 720p,1080p,4k   --cameras 1,4,16   --frames 300
+ *   --output bench.json     --baseline old.json   --tolerance 0.1
+ *   --work <dir>            --clips <dir>          --keep
+ *
+ * the report has fps, latency percentiles (frame read to display),
+ * peak RSS, heap allocations and bytes written per run. with a baseline
+ * every run is compared by name and slower fps, higher p95 latency or
+ * RSS beyond the tolerance is listed as a regression, the exit code is
+ * then 1. runs that would not fit into the available memory are skipped.
+ */
+class pipeline_bench
+{
+public:
+    static int run(QStringList arguments);
+
+private:
+    struct run_spec{
+        QString size_name;
+        int width;
+        int height;
+        int cameras;
+    };
+
+    static QString clipPath(const run_spec &spec, QString clips_dir, QString work_dir, int frames);
+    static bool generateClip(QString path, int width, int height, int frames);
+    static QJsonObject runOnce(const run_spec &spec, QString clip, QString work_dir, bool keep);
+    static QStringList compare(const QJsonObject &report, const QJsonObject &baseline, double tolerance);
+    static double percentile(const std::vector<float> &sorted, double q);
+    static qint64 readMemInfo(QString path, QString key);
+};
+
+#endif // PIPELINE_BENCH_H
@@ -0,0 +1,677 @@
+#include "pipeline_config.h"
+#include "utilities.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonValue>
+#include <QJsonArray>
+#include <QDebug>
+#include <QRegularExpression>
+
+static void readInt(const QJsonObject &json, QString key, int &value, int min, int max, QString section, QStringList &errors)
+{
+    if (!json.contains(key))
+        return;
+
+    QJsonValue json_value = json.value(key);
+    double number = json_value.toDouble();
+    if (!json_value.isDouble() || number != int(number) || number < min || number > max)
+    {
+        errors.append(QString("%1.%2 : expected an integer in [%3, %4]").arg(section, key).arg(min).arg(max));
+        return;
+    }
+    value = int(number);
+}
+
+static void readDouble(const QJsonObject &json, QString key, double &value, double min, double max, QString section, QStringList &errors)
+{
+    if (!json.contains(key))
+        return;
+
+    QJsonValue json_value = json.value(key);
+    if (!json_value.isDouble() || json_value.toDouble() < min || json_value.toDouble() > max)
+    {
+        errors.append(QString("%1.%2 : expected a number in [%3, %4]").arg(section, key).arg(min).arg(max));
+        return;
+    }
+    value = json_value.toDouble();
+}
+
+static void readBool(const QJsonObject &json, QString key, bool &value, QString section, QStringList &errors)
+{
+    if (!json.contains(key))
+        return;
+
+    if (!json.value(key).isBool())
+    {
+        errors.append(QString("%1.%2 : expected true or false").arg(section, key));
+        return;
+    }
+    value = json.value(key).toBool();
+}
+
+static void readString(const QJsonObject &json, QString key, QString &value, QString section, QStringList &errors)
+{
+    if (!json.contains(key))
+        return;
+
+    if (!json.value(key).isString())
+    {
+        errors.append(QString("%1.%2 : expected a string").arg(section, key));
+        return;
+    }
+    value = json.value(key).toString();
+}
+
+QJsonObject camera_config::toJson() const
+{
+    QJsonObject json;
+    json["frame_width"] = frame_width;
+    json["frame_height"] = frame_height;
+    json["default_fps"] = default_fps;
+    json["fps_frames"] = fps_frames;
+    json["open_timeout_ms"] = open_timeout_ms;
+    json["mog2_history"] = mog2_history;
+    json["mog2_var_threshold"] = mog2_var_threshold;
+    json["mog2_detect_shadows"] = mog2_detect_shadows;
+    json["warm_start"] = warm_start;
+    json["fg_threshold"] = fg_threshold;
+    json["noise_size"] = noise_size;
+    json["dilate_iterations"] = dilate_iterations;
+    json["tamper_detection"] = tamper_detection;
+    json["tamper_fg_ratio"] = tamper_fg_ratio;
+    json["tamper_hist_shift"] = tamper_hist_shift;
+    json["tamper_sharpness_drop"] = tamper_sharpness_drop;
+    json["tamper_settle_frames"] = tamper_settle_frames;
+    json["track_iou"] = track_iou;
+    json["track_min_hits"] = track_min_hits;
+    json["track_max_misses"] = track_max_misses;
+    json["fourcc"] = fourcc;
+    json["main_quality"] = main_quality;
+    json["sub_scale"] = sub_scale;
+    json["sub_fps_divisor"] = sub_fps_divisor;
+    json["sub_quality"] = sub_quality;
+    json["segment_seconds"] = segment_seconds;
+    json["tile_storage"] = tile_storage;
+    json["privacy_masks"] = privacy_masks;
+    json["overlay_timestamp"] = overlay_timestamp;
+    json["overlay_label"] = overlay_label;
+    json["overlay_scale"] = overlay_scale;
+    QJsonArray zone_list;
+    foreach(zone_config zone, zones)
+        zone_list.append(zone.toJson());
+    json["zones"] = zone_list;
+    json["heatmap"] = heatmap;
+    json["heatmap_half_life_s"] = heatmap_half_life_s;
+    json["detect_classes"] = detect_classes;
+    json["detect_max_crops"] = detect_max_crops;
+    json["detect_min_size"] = detect_min_size;
+    json["frame_bus"] = frame_bus;
+    json["frame_bus_slots"] = frame_bus_slots;
+    json["stream_port"] = stream_port;
+    json["stream_quality"] = stream_quality;
+    return json;
+}
+
+camera_config camera_config::fromJson(const QJsonObject &json, const camera_config &base, QString section, QStringList &errors)
+{
+    camera_config config = base;
+
+    readInt(json, "frame_width", config.frame_width, 16, 7680, section, errors);
+    readInt(json, "frame_height", config.frame_height, 16, 4320, section, errors);
+    readDouble(json, "default_fps", config.default_fps, 1, 240, section, errors);
+    readInt(json, "fps_frames", config.fps_frames, 2, 1000, section, errors);
+    readInt(json, "open_timeout_ms", config.open_timeout_ms, 100, 60000, section, errors);
+    readInt(json, "mog2_history", config.mog2_history, 1, 100000, section, errors);
+    readDouble(json, "mog2_var_threshold", config.mog2_var_threshold, 1, 1000, section, errors);
+    readBool(json, "mog2_detect_shadows", config.mog2_detect_shadows, section, errors);
+    readBool(json, "warm_start", config.warm_start, section, errors);
+    readInt(json, "fg_threshold", config.fg_threshold, 0, 254, section, errors);
+    readInt(json, "noise_size", config.noise_size, 1, 63, section, errors);
+    readInt(json, "dilate_iterations", config.dilate_iterations, 0, 20, section, errors);
+    readBool(json, "tamper_detection", config.tamper_detection, section, errors);
+    readDouble(json, "tamper_fg_ratio", config.tamper_fg_ratio, 0.05, 1, section, errors);
+    readDouble(json, "tamper_hist_shift", config.tamper_hist_shift, 0.01, 1, section, errors);
+    readDouble(json, "tamper_sharpness_drop", config.tamper_sharpness_drop, 0.01, 1, section, errors);
+    readInt(json, "tamper_settle_frames", config.tamper_settle_frames, 0, 1000, section, errors);
+    readDouble(json, "track_iou", config.track_iou, 0.01, 1, section, errors);
+    readInt(json, "track_min_hits", config.track_min_hits, 1, 100, section, errors);
+    readInt(json, "track_max_misses", config.track_max_misses, 0, 1000, section, errors);
+    readInt(json, "main_quality", config.main_quality, 1, 100, section, errors);
+    readDouble(json, "sub_scale", config.sub_scale, 0, 1, section, errors);
+    readInt(json, "sub_fps_divisor", config.sub_fps_divisor, 1, 100, section, errors);
+    readInt(json, "sub_quality", config.sub_quality, 1, 100, section, errors);
+    readDouble(json, "segment_seconds", config.segment_seconds, 0, 86400, section, errors);
+    readBool(json, "tile_storage", config.tile_storage, section, errors);
+    readBool(json, "overlay_timestamp", config.overlay_timestamp, section, errors);
+    readString(json, "overlay_label", config.overlay_label, section, errors);
+    readDouble(json, "overlay_scale", config.overlay_scale, 0.2, 4, section, errors);
+    readBool(json, "heatmap", config.heatmap, section, errors);
+    readDouble(json, "heatmap_half_life_s", config.heatmap_half_life_s, 1, 30 * 86400, section, errors);
+    readString(json, "detect_classes", config.detect_classes, section, errors);
+    readInt(json, "detect_max_crops", config.detect_max_crops, 1, 64, section, errors);
+    readInt(json, "detect_min_size", config.detect_min_size, 1, 4096, section, errors);
+    readBool(json, "frame_bus", config.frame_bus, section, errors);
+    readInt(json, "frame_bus_slots", config.frame_bus_slots, 2, 64, section, errors);
+    readInt(json, "stream_port", config.stream_port, 1, 65535, section, errors);
+    readInt(json, "stream_quality", config.stream_quality, 1, 100, section, errors);
+
+    if (json.contains("fourcc"))
+    {
+        QString fourcc = json.value("fourcc").toString();
+        if (fourcc.size() != 4)
+            errors.append(QString("%1.fourcc : expected four characters, like \"MJPG\"").arg(section));
+        else
+            config.fourcc = fourcc;
+    }
+
+    QString masks = config.privacy_masks;
+    readString(json, "privacy_masks", masks, section, errors);
+    if (masks != config.privacy_masks)
+    {
+        QList<QPolygon> polygons;
+        QString error;
+        if (!parsePolygons(masks, polygons, error))
+            errors.append(QString("%1.privacy_masks : %2").arg(section, error));
+        else
+            config.privacy_masks = masks;
+    }
+
+    // all zones or none, a half applied list would arm the wrong regions.
+    if (json.contains("zones"))
+    {
+        QStringList zone_errors;
+        QList<zone_config> zones;
+        QStringList names;
+        if (!json.value("zones").isArray())
+            zone_errors.append(QString("%1.zones : expected an array of zones").arg(section));
+        QJsonArray zone_list = json.value("zones").toArray();
+        if (zone_list.size() > 254)
+            zone_errors.append(QString("%1.zones : 254 zones at most").arg(section));
+        for (int i=0; i<zone_list.size(); i++)
+        {
+            QString zone_section = QString("%1.zones[%2]").arg(section).arg(i);
+            zone_config zone = zone_config::fromJson(zone_list.at(i).toObject(), zone_section, zone_errors);
+            if (names.contains(zone.name))
+                zone_errors.append(QString("%1.name : \"%2\" is used twice").arg(zone_section, zone.name));
+            names.append(zone.name);
+            zones.append(zone);
+        }
+        if (zone_errors.isEmpty())
+            config.zones = zones;
+        errors += zone_errors;
+    }
+
+    // catch typos, they would silently fall back to the defaults.
+    QJsonObject known = config.toJson();
+    foreach(QString key, json.keys())
+    {
+        if (!known.contains(key))
+            errors.append(QString("%1.%2 : unknown setting").arg(section, key));
+    }
+    return config;
+}
+
+QJsonObject zone_config::toJson() const
+{
+    QJsonObject json;
+    json["name"] = name;
+    json["polygon"] = polygon;
+    json["fg_threshold"] = fg_threshold;
+    json["min_area"] = min_area;
+    json["schedule"] = schedule;
+    return json;
+}
+
+zone_config zone_config::fromJson(const QJsonObject &json, QString section, QStringList &errors)
+{
+    zone_config config;
+    readString(json, "name", config.name, section, errors);
+    readString(json, "polygon", config.polygon, section, errors);
+    readInt(json, "fg_threshold", config.fg_threshold, 0, 254, section, errors);
+    readInt(json, "min_area", config.min_area, 0, 100000000, section, errors);
+    readString(json, "schedule", config.schedule, section, errors);
+
+    if (config.name.trimmed().isEmpty())
+        errors.append(QString("%1.name : a zone needs a name").arg(section));
+
+    QList<QPolygon> polygons;
+    QString error;
+    if (!camera_config::parsePolygons(config.polygon, polygons, error))
+        errors.append(QString("%1.polygon : %2").arg(section, error));
+    else if (polygons.size() != 1)
+        errors.append(QString("%1.polygon : expected one polygon, \"x,y x,y x,y\"").arg(section));
+
+    QList<arm_window> windows;
+    if (!parseSchedule(config.schedule, windows, error))
+        errors.append(QString("%1.schedule : %2").arg(section, error));
+
+    QJsonObject known = config.toJson();
+    foreach(QString key, json.keys())
+    {
+        if (!known.contains(key))
+            errors.append(QString("%1.%2 : unknown setting").arg(section, key));
+    }
+    return config;
+}
+
+static int parseDays(QString text)
+{
+    static const QStringList names = {"mon", "tue", "wed", "thu", "fri", "sat", "sun"};
+    int days = 0;
+    foreach(QString part, text.split(','))
+    {
+        QStringList range = part.trimmed().toLower().split('-');
+        int first = names.indexOf(range.value(0));
+        int last = range.size() == 2 ? names.indexOf(range.value(1)) : first;
+        if (range.size() > 2 || first < 0 || last < 0)
+            return 0;
+
+        // "fri-mon" wraps over the weekend.
+        for (int day=first; ; day=(day + 1) % 7)
+        {
+            days |= 1 << day;
+            if (day == last)
+                break;
+        }
+    }
+    return days;
+}
+
+static int parseMinutes(QString text)
+{
+    QStringList hm = text.split(':');
+    bool h_ok = false, m_ok = false;
+    int hours = hm.value(0).toInt(&h_ok);
+    int minutes = hm.value(1).toInt(&m_ok);
+    if (hm.size() != 2 || !h_ok || !m_ok || hours < 0 || minutes < 0 || minutes > 59 || hours * 60 + minutes > 24 * 60)
+        return -1;
+    return hours * 60 + minutes;
+}
+
+bool zone_config::parseSchedule(QString text, QList<arm_window> &windows, QString &error)
+{
+    windows.clear();
+    foreach(QString part, text.split(';'))
+    {
+        if (part.trimmed().isEmpty())
+            continue;
+
+        // "[days] HH:MM-HH:MM", without days every day.
+        QStringList words = part.trimmed().split(QRegularExpression("\\s+"));
+        arm_window window;
+        if (words.size() == 2)
+            window.days = parseDays(words.takeFirst());
+        QStringList times = words.value(0).split('-');
+        window.start_min = parseMinutes(times.value(0));
+        window.end_min = parseMinutes(times.value(1));
+        if (words.size() != 1 || times.size() != 2 || window.days == 0 || window.start_min < 0 || window.end_min < 0)
+        {
+            error = QString("\"%1\" is not a time range, expected \"mon-fri 08:00-18:00\"").arg(part.trimmed());
+            return false;
+        }
+        windows.append(window);
+    }
+    return true;
+}
+
+bool camera_config::parsePolygons(QString text, QList<QPolygon> &polygons, QString &error)
+{
+    polygons.clear();
+    foreach(QString part, text.split(';'))
+    {
+        if (part.trimmed().isEmpty())
+            continue;
+        QPolygon polygon;
+        foreach(QString pair, part.trimmed().split(QRegularExpression("\\s+")))
+        {
+            QStringList xy = pair.split(',');
+            bool x_ok = false, y_ok = false;
+            int x = xy.value(0).toInt(&x_ok);
+            int y = xy.value(1).toInt(&y_ok);
+            if (xy.size() != 2 || !x_ok || !y_ok || x < 0 || y < 0)
+            {
+                error = QString("\"%1\" is not a point, expected \"x,y\"").arg(pair);
+                return false;
+            }
+            polygon.append(QPoint(x, y));
+        }
+        if (polygon.size() < 3)
+        {
+            error = QString("\"%1\" needs three points at least").arg(part.trimmed());
+            return false;
+        }
+        polygons.append(polygon);
+    }
+    return true;
+}
+
+QJsonObject alert_config::toJson() const
+{
+    QJsonObject json;
+    json["webhook_url"] = webhook_url;
+    json["mqtt_host"] = mqtt_host;
+    json["mqtt_port"] = mqtt_port;
+    json["mqtt_topic"] = mqtt_topic;
+    json["script"] = script;
+    json["min_interval_s"] = min_interval_s;
+    json["max_batch"] = max_batch;
+    json["max_queue"] = max_queue;
+    json["max_attempts"] = max_attempts;
+    json["timeout_s"] = timeout_s;
+    return json;
+}
+
+alert_config alert_config::fromJson(const QJsonObject &json, QStringList &errors)
+{
+    alert_config config;
+    QString section = "alerts";
+
+    readString(json, "webhook_url", config.webhook_url, section, errors);
+    readString(json, "mqtt_host", config.mqtt_host, section, errors);
+    readInt(json, "mqtt_port", config.mqtt_port, 1, 65535, section, errors);
+    readString(json, "mqtt_topic", config.mqtt_topic, section, errors);
+    readString(json, "script", config.script, section, errors);
+    readDouble(json, "min_interval_s", config.min_interval_s, 0, 86400, section, errors);
+    readInt(json, "max_batch", config.max_batch, 1, 1000, section, errors);
+    readInt(json, "max_queue", config.max_queue, 1, 100000, section, errors);
+    readInt(json, "max_attempts", config.max_attempts, 1, 100, section, errors);
+    readDouble(json, "timeout_s", config.timeout_s, 0.1, 600, section, errors);
+
+    QJsonObject known = config.toJson();
+    foreach(QString key, json.keys())
+    {
+        if (!known.contains(key))
+            errors.append(QString("%1.%2 : unknown setting").arg(section, key));
+    }
+    return config;
+}
+
+QJsonObject detector_config::toJson() const
+{
+    QJsonObject json;
+    json["model"] = model;
+    json["labels"] = labels;
+    json["input_size"] = input_size;
+    json["scale"] = scale;
+    json["mean"] = mean;
+    json["swap_rb"] = swap_rb;
+    json["min_confidence"] = min_confidence;
+    json["max_batch"] = max_batch;
+    json["max_queue"] = max_queue;
+    json["max_age_ms"] = max_age_ms;
+    return json;
+}
+
+detector_config detector_config::fromJson(const QJsonObject &json, QStringList &errors)
+{
+    detector_config config;
+    QString section = "detector";
+
+    readString(json, "model", config.model, section, errors);
+    readString(json, "labels", config.labels, section, errors);
+    readInt(json, "input_size", config.input_size, 8, 1024, section, errors);
+    readDouble(json, "scale", config.scale, 0, 10, section, errors);
+    readDouble(json, "mean", config.mean, 0, 255, section, errors);
+    readBool(json, "swap_rb", config.swap_rb, section, errors);
+    readDouble(json, "min_confidence", config.min_confidence, 0, 1, section, errors);
+    readInt(json, "max_batch", config.max_batch, 1, 256, section, errors);
+    readInt(json, "max_queue", config.max_queue, 1, 10000, section, errors);
+    readInt(json, "max_age_ms", config.max_age_ms, 10, 60000, section, errors);
+
+    QJsonObject known = config.toJson();
+    foreach(QString key, json.keys())
+    {
+        if (!known.contains(key))
+            errors.append(QString("%1.%2 : unknown setting").arg(section, key));
+    }
+    return config;
+}
+
+QJsonObject stage_config::toJson() const
+{
+    QJsonObject json;
+    json["cpus"] = cpus;
+    json["nice"] = nice;
+    json["realtime_priority"] = realtime_priority;
+    return json;
+}
+
+stage_config stage_config::fromJson(const QJsonObject &json, QString section, QStringList &errors)
+{
+    stage_config config;
+    readString(json, "cpus", config.cpus, section, errors);
+    readInt(json, "nice", config.nice, -20, 19, section, errors);
+    readInt(json, "realtime_priority", config.realtime_priority, 0, 99, section, errors);
+
+    QRegularExpression cpu_list("^(\\d+(-\\d+)?)(,\\d+(-\\d+)?)*$");
+    if (!config.cpus.isEmpty() && !cpu_list.match(config.cpus).hasMatch())
+    {
+        errors.append(QString("%1.cpus : expected a list like 0,2-3").arg(section));
+        config.cpus.clear();
+    }
+
+    QJsonObject known = config.toJson();
+    foreach(QString key, json.keys())
+    {
+        if (!known.contains(key))
+            errors.append(QString("%1.%2 : unknown setting").arg(section, key));
+    }
+    return config;
+}
+
+QJsonObject threads_config::toJson() const
+{
+    QJsonObject json;
+    json["capture"] = capture.toJson();
+    json["analysis"] = analysis.toJson();
+    json["io"] = io.toJson();
+    json["max_workers"] = max_workers;
+    json["opencv_threads"] = opencv_threads;
+    return json;
+}
+
+threads_config threads_config::fromJson(const QJsonObject &json, QStringList &errors)
+{
+    threads_config config;
+    QString section = "threads";
+
+    config.capture = stage_config::fromJson(json.value("capture").toObject(), "threads.capture", errors);
+    config.analysis = stage_config::fromJson(json.value("analysis").toObject(), "threads.analysis", errors);
+    config.io = stage_config::fromJson(json.value("io").toObject(), "threads.io", errors);
+    readInt(json, "max_workers", config.max_workers, 0, 256, section, errors);
+    readInt(json, "opencv_threads", config.opencv_threads, 0, 256, section, errors);
+
+    QJsonObject known = config.toJson();
+    foreach(QString key, json.keys())
+    {
+        if (!known.contains(key))
+            errors.append(QString("%1.%2 : unknown setting").arg(section, key));
+    }
+    return config;
+}
+
+QJsonObject memory_config::toJson() const
+{
+    QJsonObject json;
+    json["budget_mb"] = budget_mb;
+    json["recover_ratio"] = recover_ratio;
+    json["check_interval_ms"] = check_interval_ms;
+    json["recover_ms"] = recover_ms;
+    return json;
+}
+
+memory_config memory_config::fromJson(const QJsonObject &json, QStringList &errors)
+{
+    memory_config config;
+    QString section = "memory";
+
+    readInt(json, "budget_mb", config.budget_mb, 0, 1048576, section, errors);
+    readDouble(json, "recover_ratio", config.recover_ratio, 0.1, 0.99, section, errors);
+    readInt(json, "check_interval_ms", config.check_interval_ms, 100, 60000, section, errors);
+    readInt(json, "recover_ms", config.recover_ms, 0, 3600000, section, errors);
+
+    QJsonObject known = config.toJson();
+    foreach(QString key, json.keys())
+    {
+        if (!known.contains(key))
+            errors.append(QString("%1.%2 : unknown setting").arg(section, key));
+    }
+    return config;
+}
+
+pipeline_config::pipeline_config(QObject *parent):
+    QObject(parent)
+{
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, &QFileSystemWatcher::fileChanged, this, &pipeline_config::fileChanged);
+
+    // polls for the file while it is gone, see fileChanged.
+    watch_retry = new QTimer(this);
+    watch_retry->setInterval(500);
+    connect(watch_retry, &QTimer::timeout, this, &pipeline_config::watchAgain);
+
+    if (!QFile::exists(configPath()))
+        writeDefaults();
+
+    watcher->addPath(configPath());
+    reload();
+}
+
+QString pipeline_config::configPath()
+{
+    return QString("%1/config.json").arg(utilities::getDataPath());
+}
+
+void pipeline_config::writeDefaults()
+{
+    QJsonObject defaults;
+    defaults["default"] = camera_config().toJson();
+    defaults["cameras"] = QJsonObject();
+    defaults["alerts"] = alert_config().toJson();
+    defaults["detector"] = detector_config().toJson();
+    defaults["threads"] = threads_config().toJson();
+    defaults["memory"] = memory_config().toJson();
+
+    QFile file(configPath());
+    if (file.open(QIODevice::WriteOnly))
+        file.write(QJsonDocument(defaults).toJson());
+}
+
+void pipeline_config::fileChanged(QString path)
+{
+    // editors save by replacing the file, which drops it from the watcher.
+    // deleted and not written again yet, wait for it to come back.
+    if (!QFile::exists(path))
+    {
+        watch_retry->start();
+        return;
+    }
+    if (!watcher->files().contains(path))
+        watcher->addPath(path);
+    reload();
+}
+
+void pipeline_config::watchAgain()
+{
+    if (!QFile::exists(configPath()))
+        return;
+
+    watch_retry->stop();
+    if (!watcher->files().contains(configPath()))
+        watcher->addPath(configPath());
+    reload();
+}
+
+void pipeline_config::reload()
+{
+    QStringList new_errors;
+    QJsonObject new_root;
+
+    QFile file(configPath());
+    if (!file.open(QIODevice::ReadOnly))
+        new_errors.append(QString("config.json : %1").arg(file.errorString()));
+    else
+    {
+        QJsonParseError parse_error;
+        QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parse_error);
+        if (parse_error.error != QJsonParseError::NoError)
+            new_errors.append(QString("config.json : %1 at offset %2").arg(parse_error.errorString()).arg(parse_error.offset));
+        else
+            new_root = document.object();
+    }
+
+    // validate every section now so errors show up without a camera open.
+    camera_config defaults = camera_config::fromJson(new_root.value("default").toObject(), camera_config(), "default", new_errors);
+    QJsonObject cameras = new_root.value("cameras").toObject();
+    foreach(QString camname, cameras.keys())
+        camera_config::fromJson(cameras.value(camname).toObject(), defaults, camname, new_errors);
+    alert_config::fromJson(new_root.value("alerts").toObject(), new_errors);
+    detector_config::fromJson(new_root.value("detector").toObject(), new_errors);
+    threads_config::fromJson(new_root.value("threads").toObject(), new_errors);
+    memory_config::fromJson(new_root.value("memory").toObject(), new_errors);
+
+    // a file that cannot be read or parsed keeps the last good configuration.
+    lock.lock();
+    if (new_errors.isEmpty() || !new_root.isEmpty())
+        root = new_root;
+    errors = new_errors;
+    lock.unlock();
+
+    foreach(QString error, new_errors)
+        qDebug() << "config error : " << error;
+    emit configReloaded();
+}
+
+camera_config pipeline_config::cameraConfig(QString camname)
+{
+    QStringList ignored;
+    lock.lock();
+    QJsonObject current = root;
+    lock.unlock();
+
+    camera_config defaults = camera_config::fromJson(current.value("default").toObject(), camera_config(), "default", ignored);
+    return camera_config::fromJson(current.value("cameras").toObject().value(camname).toObject(), defaults, camname, ignored);
+}
+
+alert_config pipeline_config::alertConfig()
+{
+    QStringList ignored;
+    lock.lock();
+    QJsonObject alerts = root.value("alerts").toObject();
+    lock.unlock();
+    return alert_config::fromJson(alerts, ignored);
+}
+
+detector_config pipeline_config::detectorConfig()
+{
+    QStringList ignored;
+    lock.lock();
+    QJsonObject detector = root.value("detector").toObject();
+    lock.unlock();
+    return detector_config::fromJson(detector, ignored);
+}
+
+threads_config pipeline_config::threadsConfig()
+{
+    QStringList ignored;
+    lock.lock();
+    QJsonObject threads = root.value("threads").toObject();
+    lock.unlock();
+    return threads_config::fromJson(threads, ignored);
+}
+
+memory_config pipeline_config::memoryConfig()
+{
+    QStringList ignored;
+    lock.lock();
+    QJsonObject memory = root.value("memory").toObject();
+    lock.unlock();
+    return memory_config::fromJson(memory, ignored);
+}
+
+QStringList pipeline_config::validationErrors()
+{
+    QMutexLocker locker(&lock);
+    return errors;
+}
@@ -0,0 +1,259 @@
+#ifndef PIPELINE_CONFIG_H
+#define PIPELINE_CONFIG_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QJsonObject>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QMutex>
+#include <QPolygon>
+
+/*
+ * a named region of a camera with its own motion rules, see zone_map.
+ * a camera with zones only sees motion inside the ones armed right now.
+ */
+struct zone_config
+{
+    QString name;
+    QString polygon;                // captured frame pixels, "x,y x,y x,y"
+    int fg_threshold=25;            // like camera_config.fg_threshold, lower is more sensitive
+    int min_area=0;                 // foreground pixels of a blob inside the zone
+    QString schedule;               // e.g. "mon-fri 08:00-18:00; sat,sun 22:00-06:00", empty for always
+
+    // a daily time range, minutes since midnight. one that ends before it
+    // starts runs past midnight into the next day.
+    struct arm_window{
+        int days=0x7f;              // bit 0 monday ... bit 6 sunday
+        int start_min=0;
+        int end_min=24 * 60;
+    };
+
+    QJsonObject toJson() const;
+    static zone_config fromJson(const QJsonObject &json, QString section, QStringList &errors);
+
+    // false with error set on a malformed schedule.
+    static bool parseSchedule(QString text, QList<arm_window> &windows, QString &error);
+};
+
+/*
+ * every tuning knob of a camera pipeline.
+ * the defaults are the values the pipeline was written with.
+ */
+struct camera_config
+{
+    // capture
+    int frame_width=1920;
+    int frame_height=1080;
+    double default_fps=30;          // used for recording until fps is measured
+    int fps_frames=30;              // frames averaged by the fps calculation
+    int open_timeout_ms=5000;       // device open, also bounds the startup probe
+
+    // background segmentor (MOG2)
+    int mog2_history=500;
+    double mog2_var_threshold=16;
+    bool mog2_detect_shadows=true;
+    bool warm_start=true;           // restore the background saved at the last stop
+
+    // foreground mask cleanup
+    int fg_threshold=25;
+    int noise_size=9;
+    int dilate_iterations=3;
+
+    // global scene changes, see scene_monitor
+    bool tamper_detection=true;
+    double tamper_fg_ratio=0.6;     // foreground share of a global change
+    double tamper_hist_shift=0.3;   // bhattacharyya distance of a lighting change
+    double tamper_sharpness_drop=0.35;  // remaining sharpness of a covered lens
+    int tamper_settle_frames=15;    // frames the model relearns after a change
+
+    // blob tracking, see blob_tracker
+    double track_iou=0.3;
+    int track_min_hits=3;           // frames before a track counts as motion
+    int track_max_misses=10;        // frames a lost track is kept
+
+    // recording
+    QString fourcc="MJPG";
+    int main_quality=95;
+    double sub_scale=1.0 / 3;       // 0 disables the sub stream
+    int sub_fps_divisor=3;
+    int sub_quality=70;
+    double segment_seconds=60;
+    bool tile_storage=false;        // motion tiles instead of the main stream
+
+    // burned into recordings, streams and the screen, see frame_compositor.
+    // privacy masks are polygons in captured frame pixels, "x,y x,y x,y; x,y ...".
+    QString privacy_masks;
+    bool overlay_timestamp=true;
+    QString overlay_label;          // empty shows the camera name
+    double overlay_scale=0.6;
+
+    // motion rules per region, a json array of zone_config. the label map
+    // of the zones is built once, a blob is tested against it in O(its pixels).
+    QList<zone_config> zones;
+
+    // activity heatmap, see activity_heatmap. the foreground of every frame
+    // is added and fades out with this half life.
+    bool heatmap=true;
+    double heatmap_half_life_s=600;
+
+    // object classes that start a recording and an alert, e.g. "person,vehicle".
+    // empty records on any motion, the detector then only labels events.
+    QString detect_classes;
+    int detect_max_crops=4;         // largest blobs classified per request
+    int detect_min_size=32;         // smaller blobs are never classified
+
+    // frames for other local processes, see frame_bus
+    bool frame_bus=false;
+    int frame_bus_slots=4;
+
+    // network streaming
+    int stream_port=8080;
+    int stream_quality=80;
+
+    QJsonObject toJson() const;
+
+    // overlays the keys of json on base, invalid keys keep the base value.
+    static camera_config fromJson(const QJsonObject &json, const camera_config &base, QString section, QStringList &errors);
+
+    // false with error set on a malformed list.
+    static bool parsePolygons(QString text, QList<QPolygon> &polygons, QString &error);
+};
+
+/*
+ * motion alert delivery, shared by all cameras. empty sinks are disabled.
+ */
+struct alert_config
+{
+    QString webhook_url;            // POSTed a json batch of events
+    QString mqtt_host;
+    int mqtt_port=1883;
+    QString mqtt_topic="software/alerts";
+    QString script;                 // run with the camera name, json on stdin
+
+    double min_interval_s=30;       // per camera, events in between are batched
+    int max_batch=20;
+    int max_queue=200;              // per camera, oldest events are dropped
+    int max_attempts=5;
+    double timeout_s=5;
+
+    QJsonObject toJson() const;
+    static alert_config fromJson(const QJsonObject &json, QStringList &errors);
+};
+
+/*
+ * cpu object classifier for motion blob crops, shared by all cameras.
+ * an empty model disables it. the model takes a square rgb crop and
+ * outputs one score per line of the labels file.
+ */
+struct detector_config
+{
+    QString model;                  // onnx, caffe, tensorflow ... as cv::dnn::readNet takes
+    QString labels;                 // text file, one class name per line
+    int input_size=224;
+    double scale=1.0 / 255;
+    double mean=0;
+    bool swap_rb=true;
+    double min_confidence=0.5;
+    int max_batch=16;               // crops per forward pass, across cameras
+    int max_queue=32;               // crops waiting, beyond that requests are skipped
+    int max_age_ms=500;             // requests older than this are skipped
+
+    QJsonObject toJson() const;
+    static detector_config fromJson(const QJsonObject &json, QStringList &errors);
+};
+
+/*
+ * scheduling of one kind of thread, see thread_tuning.
+ * the defaults leave placement and priority to the os.
+ */
+struct stage_config
+{
+    QString cpus;                   // affinity, e.g. "2-3" or "0,4", empty keeps the launch one
+    int nice=0;                     // -20..19, below 0 needs CAP_SYS_NICE, 0 keeps the launch one
+    int realtime_priority=0;        // 1..99 runs SCHED_FIFO, 0 keeps the launch policy
+
+    QJsonObject toJson() const;
+    static stage_config fromJson(const QJsonObject &json, QString section, QStringList &errors);
+};
+
+struct threads_config
+{
+    stage_config capture;           // frame grab, motion detection, encoding
+    stage_config analysis;          // object detector
+    stage_config io;                // event journal, alert dispatcher
+    int max_workers=0;              // global pool and pipeline executor size, 0 keeps the default
+    int opencv_threads=0;           // opencv parallel_for threads, 0 keeps the default
+
+    QJsonObject toJson() const;
+    static threads_config fromJson(const QJsonObject &json, QStringList &errors);
+};
+
+/*
+ * resident memory budget of the process, see memory_governor.
+ * a budget of 0 turns the governor off.
+ */
+struct memory_config
+{
+    int budget_mb=0;
+    double recover_ratio=0.85;      // a step is undone below this share of the budget
+    int check_interval_ms=2000;     // at most one step up or down per interval
+    int recover_ms=10000;           // time below the recover share before a step down
+
+    QJsonObject toJson() const;
+    static memory_config fromJson(const QJsonObject &json, QStringList &errors);
+};
+
+/*
+ * loads camera_config from <data path>/config.json :
+ *
+ *   {
+ *     "default" : { "fg_threshold" : 25, ... },
+ *     "cameras" : { "/dev/video0" : { "noise_size" : 5 } },
+ *     "alerts"  : { "webhook_url" : "http://...", ... },
+ *     "detector" : { "model" : "/path/classes.onnx", ... },
+ *     "threads" : { "capture" : { "cpus" : "2-3", "nice" : -5 }, ... },
+ *     "memory" : { "budget_mb" : 1200 }
+ *   }
+ *
+ * a camera gets the "default" section overlaid with its own section.
+ * the file is watched and configReloaded() is emitted on every change,
+ * validation errors are kept and reported instead of applied.
+ */
+class pipeline_config : public QObject
+{
+    Q_OBJECT;
+
+public:
+    explicit pipeline_config(QObject *parent=nullptr);
+
+    static QString configPath();
+    camera_config cameraConfig(QString camname);
+    alert_config alertConfig();
+    detector_config detectorConfig();
+    threads_config threadsConfig();
+    memory_config memoryConfig();
+    QStringList validationErrors();
+
+public slots:
+    void reload();
+
+signals:
+    void configReloaded();
+
+private slots:
+    void fileChanged(QString path);
+    void watchAgain();
+
+private:
+    void writeDefaults();
+
+    QFileSystemWatcher *watcher;
+    QTimer *watch_retry;
+    QJsonObject root;
+    QStringList errors;
+    QMutex lock;
+};
+
+#endif // PIPELINE_CONFIG_H
@@ -0,0 +1,331 @@
+#include "pipeline_graph.h"
+#include "thread_tuning.h"
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QThread>
+#include <algorithm>
+
+// packets kept for reuse, more than the queues of a graph ever hold.
+static const size_t default_free_packets = 32;
+
+// the nodes of every live graph, they size the shared executor.
+static QMutex executor_lock;
+static int live_nodes = 0;
+static int blocking_nodes = 0;          // nodes that push into a BLOCK queue
+static int worker_cap = 0;              // threads.max_workers, 0 for none
+
+static const char *kindName(pipeline_node::Kind kind)
+{
+    switch (kind)
+    {
+    case pipeline_node::SOURCE: return "source";
+    case pipeline_node::TRANSFORM: return "transform";
+    case pipeline_node::DETECTOR: return "detector";
+    default: return "sink";
+    }
+}
+
+struct executor_thread
+{
+    executor_thread()
+    {
+        static QAtomicInt count;
+        thread_tuning::registerThread("capture", QString("pipeline %1").arg(count.fetchAndAddRelaxed(1)));
+    }
+    ~executor_thread()
+    {
+        thread_tuning::unregisterThread();
+    }
+};
+
+// drains the queue of one node on an executor thread.
+class node_task : public QRunnable
+{
+public:
+    explicit node_task(pipeline_node *node) : node(node) {}
+
+    void run() override
+    {
+        // registered once per executor thread, until the pool expires it.
+        static thread_local executor_thread registration;
+        Q_UNUSED(registration);
+        node->drain();
+    }
+
+private:
+    pipeline_node *node;
+};
+
+pipeline_node::pipeline_node(pipeline_graph *graph, QString name, Kind kind, process_fn process, int capacity, Overflow overflow):
+    graph(graph), node_name(name), node_kind(kind), process(process), capacity(qMax(1, capacity)), overflow(overflow)
+{
+
+}
+
+QString pipeline_node::name(){return node_name;}
+
+pipeline_node::Kind pipeline_node::kind(){return node_kind;}
+
+int pipeline_node::limit()
+{
+    return capacity_limit > 0 ? qMin(capacity, capacity_limit) : capacity;
+}
+
+void pipeline_node::enqueue(packet_ptr packet)
+{
+    QMutexLocker locker(&lock);
+    if (int(queue.size()) >= limit())
+    {
+        if (overflow == BLOCK)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            while (int(queue.size()) >= limit())
+                space.wait(&lock);
+            blocked_us_total += timer.nsecsElapsed() / 1e3;
+        }
+        else
+        {
+            while (int(queue.size()) >= limit())
+            {
+                queue.pop_front();
+                dropped++;
+            }
+        }
+    }
+
+    queue.push_back(packet);
+    enqueued++;
+    occupancy_total += queue.size();
+    occupancy_max = qMax(occupancy_max, int(queue.size()));
+
+    if (!scheduled)
+    {
+        scheduled = true;
+        pipeline_graph::executor()->start(new node_task(this));
+    }
+}
+
+void pipeline_node::drain()
+{
+    while (true)
+    {
+        lock.lock();
+        if (queue.empty())
+        {
+            scheduled = false;
+            idle.wakeAll();
+            lock.unlock();
+            return;
+        }
+        packet_ptr packet = queue.front();
+        queue.pop_front();
+        space.wakeOne();
+        lock.unlock();
+
+        QElapsedTimer timer;
+        timer.start();
+        bool pass = process(*packet);
+        record(timer.nsecsElapsed() / 1e3);
+
+        if (pass)
+        {
+            foreach(pipeline_node *next, successors)
+                next->enqueue(packet);
+        }
+    }
+}
+
+void pipeline_node::waitIdle()
+{
+    QMutexLocker locker(&lock);
+    while (scheduled)
+        idle.wait(&lock);
+}
+
+void pipeline_node::record(double work_us)
+{
+    QMutexLocker locker(&lock);
+    processed++;
+    work_us_total += work_us;
+    work_us_max = std::max(work_us_max, work_us);
+}
+
+QString pipeline_node::report()
+{
+    QMutexLocker locker(&lock);
+    QString report = QString("  %1 (%2) : %3 packets, %4 us/packet (max %5)")
+            .arg(node_name, kindName(node_kind)).arg(processed)
+            .arg(processed ? work_us_total / processed : 0.0, 0, 'f', 0)
+            .arg(work_us_max, 0, 'f', 0);
+    if (node_kind != SOURCE)
+        report += QString(", queue %1 now, %2 avg, %3 max of %4")
+                .arg(queue.size())
+                .arg(enqueued ? double(occupancy_total) / enqueued : 0.0, 0, 'f', 1)
+                .arg(occupancy_max).arg(limit());
+    if (dropped > 0)
+        report += QString(", %1 dropped").arg(dropped);
+    if (blocked_us_total > 0)
+        report += QString(", pushers blocked %1 ms").arg(blocked_us_total / 1e3, 0, 'f', 0);
+    return report + "\n";
+}
+
+pipeline_graph::pipeline_graph(QString name):
+    graph_name(name), max_free_packets(default_free_packets)
+{
+
+}
+
+pipeline_graph::~pipeline_graph()
+{
+    waitIdle();
+
+    executor_lock.lock();
+    foreach(pipeline_node *node, nodes)
+    {
+        if (node->kind() != pipeline_node::SOURCE)
+            live_nodes--;
+        if (node->pushes_blocking)
+            blocking_nodes--;
+    }
+    resizeExecutor();
+    executor_lock.unlock();
+
+    qDeleteAll(nodes);
+    for (frame_packet *packet : free_packets)
+        delete packet;
+}
+
+QThreadPool *pipeline_graph::executor()
+{
+    static QThreadPool pool;
+    return &pool;
+}
+
+void pipeline_graph::setWorkerCap(int max_workers)
+{
+    QMutexLocker locker(&executor_lock);
+    worker_cap = max_workers;
+    resizeExecutor();
+}
+
+void pipeline_graph::resizeExecutor()
+{
+    // a thread for every node, unless max_workers caps it. a node blocked
+    // on a full BLOCK queue holds its thread, one more than those can
+    // always drain the queue, the cap never goes below that.
+    int threads = qMax(QThread::idealThreadCount(), live_nodes);
+    if (worker_cap > 0)
+        threads = qMax(worker_cap, blocking_nodes + 1);
+    executor()->setMaxThreadCount(threads);
+}
+
+pipeline_node *pipeline_graph::addSource(QString name)
+{
+    return addNode(name, pipeline_node::SOURCE, nullptr, 1, pipeline_node::DROP_OLDEST);
+}
+
+pipeline_node *pipeline_graph::addNode(QString name, pipeline_node::Kind kind, pipeline_node::process_fn process,
+                                       int capacity, pipeline_node::Overflow overflow)
+{
+    pipeline_node *node = new pipeline_node(this, name, kind, process, capacity, overflow);
+    nodes.append(node);
+
+    if (kind != pipeline_node::SOURCE)
+    {
+        QMutexLocker locker(&executor_lock);
+        live_nodes++;
+        resizeExecutor();
+    }
+    return node;
+}
+
+void pipeline_graph::connect(pipeline_node *from, pipeline_node *to)
+{
+    from->successors.append(to);
+
+    // the source pushes from its own thread, it never holds an executor thread.
+    if (to->overflow == pipeline_node::BLOCK && from->kind() != pipeline_node::SOURCE && !from->pushes_blocking)
+    {
+        QMutexLocker locker(&executor_lock);
+        from->pushes_blocking = true;
+        blocking_nodes++;
+        resizeExecutor();
+    }
+}
+
+packet_ptr pipeline_graph::newPacket()
+{
+    frame_packet *packet = nullptr;
+    pool_lock.lock();
+    if (!free_packets.empty())
+    {
+        packet = free_packets.back();
+        free_packets.pop_back();
+    }
+    else
+        allocated++;
+    pool_lock.unlock();
+    if (packet == nullptr)
+        packet = new frame_packet();
+
+    // back to the pool once the last node is done with it.
+    return packet_ptr(packet, [this](frame_packet *done) {
+        QMutexLocker locker(&pool_lock);
+        if (free_packets.size() < max_free_packets)
+            free_packets.push_back(done);
+        else
+        {
+            delete done;
+            allocated--;
+        }
+    });
+}
+
+void pipeline_graph::setLimits(int limit, size_t pool_limit)
+{
+    foreach(pipeline_node *node, nodes)
+    {
+        QMutexLocker locker(&node->lock);
+        node->capacity_limit = limit;
+    }
+
+    QMutexLocker locker(&pool_lock);
+    max_free_packets = pool_limit;
+    while (free_packets.size() > max_free_packets)
+    {
+        delete free_packets.back();
+        free_packets.pop_back();
+        allocated--;
+    }
+}
+
+int pipeline_graph::packetCount()
+{
+    QMutexLocker locker(&pool_lock);
+    return allocated;
+}
+
+void pipeline_graph::push(pipeline_node *source, packet_ptr packet, double work_us)
+{
+    source->record(work_us);
+    foreach(pipeline_node *next, source->successors)
+        next->enqueue(packet);
+}
+
+void pipeline_graph::waitIdle()
+{
+    // in dataflow order, a drained node can not feed an earlier one again.
+    foreach(pipeline_node *node, nodes)
+        node->waitIdle();
+}
+
+QString pipeline_graph::statsReport()
+{
+    QString report = QString("pipeline %1 : %2 nodes, executor %3 threads\n")
+            .arg(graph_name).arg(nodes.size()).arg(executor()->maxThreadCount());
+    foreach(pipeline_node *node, nodes)
+        report += node->report();
+    return report;
+}
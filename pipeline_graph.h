@@ -0,0 +1,165 @@
+#ifndef PIPELINE_GRAPH_H
+#define PIPELINE_GRAPH_H
+
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <opencv2/core.hpp>
+
+/*
+ * one captured frame on its way through a pipeline_graph. nodes fill in
+ * what they produce, the ones after them read it.
+ */
+struct frame_packet
+{
+    qint64 sequence=0;
+    QElapsedTimer clock;            // started when the frame was read
+    qint64 timestamp_us=0;          // capture time, unix epoch
+    cv::Mat frame;                  // as captured, BGR
+    cv::Mat bgr;                    // composed, for the recorder and the streams
+    cv::Mat rgb;                    // composed, for the screen
+    cv::Mat fg_mask;                // lined up with the composed frame
+    cv::Mat background;
+    cv::Mat clean;                  // mirror and privacy masks only
+    cv::Rect caption;               // band of the caption in bgr
+    std::vector<cv::Rect> blobs;    // composed frame coordinates
+    bool motion=false;
+};
+
+typedef std::shared_ptr<frame_packet> packet_ptr;
+
+class pipeline_graph;
+
+/*
+ * a stage of a pipeline_graph with a bounded input queue.
+ *
+ * a full queue either drops its oldest packet (display, detection : only
+ * the newest frame matters) or blocks whoever pushes (recording : every
+ * frame counts, the camera has to wait). process() returns false to stop
+ * the packet here, otherwise it goes on to every successor.
+ */
+class pipeline_node
+{
+public:
+    enum Kind{
+        SOURCE,
+        TRANSFORM,
+        DETECTOR,
+        SINK
+    };
+
+    enum Overflow{
+        DROP_OLDEST,
+        BLOCK
+    };
+
+    typedef std::function<bool(frame_packet &packet)> process_fn;
+
+    QString name();
+    Kind kind();
+    QString report();
+
+private:
+    friend class pipeline_graph;
+    friend class node_task;
+
+    pipeline_node(pipeline_graph *graph, QString name, Kind kind, process_fn process, int capacity, Overflow overflow);
+
+    void enqueue(packet_ptr packet);
+    void drain();
+    void waitIdle();
+    void record(double work_us);
+    int limit();
+
+    pipeline_graph *graph;
+    QString node_name;
+    Kind node_kind;
+    process_fn process;
+    int capacity;
+    int capacity_limit=0;           // under lock, 0 for none
+    Overflow overflow;
+    QList<pipeline_node*> successors;
+    bool pushes_blocking=false;     // a successor blocks, see pipeline_graph::resizeExecutor
+
+    QMutex lock;
+    QWaitCondition space;
+    QWaitCondition idle;
+    std::deque<packet_ptr> queue;
+    bool scheduled=false;
+
+    // metrics, under lock
+    qint64 processed=0;
+    qint64 dropped=0;
+    double work_us_total=0;
+    double work_us_max=0;
+    qint64 enqueued=0;
+    qint64 occupancy_total=0;
+    int occupancy_max=0;
+    double blocked_us_total=0;
+};
+
+/*
+ * a small dataflow graph : a source pushes packets, the nodes after it
+ * run as tasks on one executor shared by every graph, so independent
+ * branches (detection, display, recording) run at the same time. a node
+ * is never run twice at once, it sees its packets in order.
+ *
+ *   pipeline_graph graph("cam");
+ *   pipeline_node *source = graph.addSource("capture");
+ *   pipeline_node *sink = graph.addNode("display", pipeline_node::SINK, show, 1);
+ *   graph.connect(source, sink);
+ *   graph.push(source, packet, read_us);
+ *
+ * nodes are added in dataflow order, waitIdle() relies on it.
+ */
+class pipeline_graph
+{
+public:
+    explicit pipeline_graph(QString name);
+    ~pipeline_graph();
+
+    pipeline_node *addSource(QString name);
+    pipeline_node *addNode(QString name, pipeline_node::Kind kind, pipeline_node::process_fn process,
+                           int capacity=2, pipeline_node::Overflow overflow=pipeline_node::DROP_OLDEST);
+    void connect(pipeline_node *from, pipeline_node *to);
+
+    // a recycled packet, its mats keep their buffers.
+    packet_ptr newPacket();
+    void push(pipeline_node *source, packet_ptr packet, double work_us);
+
+    // until every queue is empty and no node runs, the source must not push meanwhile.
+    void waitIdle();
+
+    // low memory : every queue holds at most limit packets (0 for their
+    // own capacity), at most pool_limit spare packets are kept.
+    void setLimits(int limit, size_t pool_limit);
+    // packets allocated, in flight or spare.
+    int packetCount();
+
+    QString statsReport();
+    static QThreadPool *executor();
+    // threads.max_workers, see thread_tuning.
+    static void setWorkerCap(int max_workers);
+
+private:
+    friend class pipeline_node;
+
+    static void resizeExecutor();
+
+    QString graph_name;
+    QList<pipeline_node*> nodes;
+
+    QMutex pool_lock;
+    std::vector<frame_packet*> free_packets;
+    size_t max_free_packets;
+    int allocated=0;
+};
+
+#endif // PIPELINE_GRAPH_H
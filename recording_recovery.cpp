@@ -0,0 +1,119 @@
+#include "recording_recovery.h"
+#include "avi_mjpeg_reader.h"
+#include "avi_mjpeg_writer.h"
+#include "tile_player.h"
+#include "utilities.h"
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <opencv2/imgcodecs.hpp>
+
+QStringList recording_recovery::recoverAll(QString dir)
+{
+    QStringList report;
+    QDir data_dir(dir);
+    QStringList partial = data_dir.entryList(QStringList({"*.inprogress.avi", "*.inprogress.tiles"}), QDir::Files);
+
+    foreach(QString name, partial)
+    {
+        QString path = data_dir.absoluteFilePath(name);
+        bool recovered = name.endsWith(".avi") ? recoverVideo(path) : recoverTiles(path);
+        if (recovered)
+            report.append("recovered " + utilities::finishedPath(name));
+        else
+            report.append(QString("%1 %2").arg(QFile::exists(path) ? "left as is" : "dropped", name));
+    }
+    return report;
+}
+
+bool recording_recovery::recoverVideo(QString path)
+{
+    QString finished = utilities::finishedPath(path);
+    avi_mjpeg_reader reader;
+
+    // nothing usable was written before the crash. a file that could not
+    // be read is left for the next start instead.
+    if (!reader.open(path))
+    {
+        QString error = reader.errorString();
+        reader.close();
+        if (error.isEmpty())
+            QFile::remove(path);
+        else
+            qDebug() << "can not read, left as is : " << path << error;
+        return false;
+    }
+
+    // closed but not yet renamed : the file is complete.
+    if (!reader.isDamaged())
+    {
+        reader.close();
+        QFile::rename(path, finished);
+        return utilities::syncFile(finished);
+    }
+
+    // only jpeg packets can be re-muxed, other codecs keep their packets
+    // as they are. without a header the first packet tells.
+    QByteArray jpeg;
+    QByteArray fourcc = reader.fourcc().toUpper();
+    bool is_mjpg = fourcc.isEmpty() ? reader.readPacket(0, jpeg) && jpeg.startsWith("\xFF\xD8")
+                                    : fourcc == "MJPG";
+    if (!is_mjpg)
+    {
+        reader.close();
+        QFile::rename(path, finished);
+        return utilities::syncFile(finished);
+    }
+
+    // the header may have been cut as well, take the size from a frame.
+    cv::Size frame_size = reader.frameSize();
+    if (frame_size.area() == 0 && reader.readPacket(0, jpeg))
+    {
+        cv::Mat first = cv::imdecode(std::vector<uchar>(jpeg.begin(), jpeg.end()), cv::IMREAD_COLOR);
+        frame_size = first.size();
+    }
+    if (frame_size.area() == 0)
+    {
+        qDebug() << "no frame size, left as is : " << path;
+        return false;
+    }
+
+    avi_mjpeg_writer writer;
+    if (!writer.open(finished, frame_size, reader.fps() > 0 ? reader.fps() : 30))
+        return false;
+
+    for (int i=0; i<reader.packetCount(); i++)
+    {
+        if (reader.readPacket(i, jpeg))
+            writer.writePacket(jpeg);
+    }
+    writer.close();
+    reader.close();
+
+    utilities::syncFile(finished);
+    QFile::remove(path);
+    return true;
+}
+
+bool recording_recovery::recoverTiles(QString path)
+{
+    QString finished = utilities::finishedPath(path);
+    tile_player player;
+    if (!player.open(path))
+    {
+        QFile::remove(path);
+        return false;
+    }
+
+    // find the end of the last frame that can be rebuilt.
+    cv::Mat frame;
+    qint64 time_ms;
+    qint64 valid_length = player.position();
+    while (player.readFrame(frame, time_ms))
+        valid_length = player.position();
+    player.close();
+
+    QFile::resize(path, valid_length);
+    QFile::rename(path, finished);
+    return utilities::syncFile(finished);
+}
@@ -0,0 +1,28 @@
+#ifndef RECORDING_RECOVERY_H
+#define RECORDING_RECOVERY_H
+
+#include <QString>
+#include <QStringList>
+
+/*
+ * repairs the segments left behind as *.inprogress.* by a crash.
+ *
+ *  - avi   : MJPG packets are re-muxed (no decoding) into a new avi with
+ *            a valid index. other codecs are only renamed, a player
+ *            reads them without the index.
+ *  - tiles : the file is cut after its last complete record.
+ *
+ * the repaired file gets the final segment name, the partial one is removed.
+ * a file that cannot be repaired is left as it is.
+ */
+class recording_recovery
+{
+public:
+    // repairs every in progress file of dir, one report line per file.
+    static QStringList recoverAll(QString dir);
+
+    static bool recoverVideo(QString path);
+    static bool recoverTiles(QString path);
+};
+
+#endif // RECORDING_RECOVERY_H
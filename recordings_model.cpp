@@ -0,0 +1,247 @@
+#include "recordings_model.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QRunnable>
+#include <QDebug>
+#include <QtConcurrent>
+#include <algorithm>
+
+// decodes one cover at thumbnail size and hands it back to the model.
+class thumbnail_task : public QRunnable
+{
+public:
+    thumbnail_task(QObject *model, QString cover_path, QSize size):
+        model(model), cover_path(cover_path), size(size) {}
+
+    void run() override
+    {
+        QImageReader reader(cover_path);
+        QSize full_size = reader.size();
+        if (full_size.isValid())
+            reader.setScaledSize(full_size.scaled(size, Qt::KeepAspectRatio));
+        QImage image = reader.read();
+        QMetaObject::invokeMethod(model, "thumbnailReady", Qt::QueuedConnection,
+                                  Q_ARG(QString, cover_path), Q_ARG(QImage, image));
+    }
+
+private:
+    QObject *model;
+    QString cover_path;
+    QSize size;
+};
+
+static const QString name_format = "yyyy-MM-dd+HH:mm:ss";
+static const int max_pending_thumbnails = 64;
+
+recordings_model::recordings_model(QString dir, QObject *parent):
+    QAbstractListModel(parent), dir(dir), thumbnail_size(160, 90)
+{
+    decode_pool = new QThreadPool(this);
+    decode_pool->setMaxThreadCount(2);
+    setCacheSize(cache_count);
+
+    placeholder = QPixmap(thumbnail_size);
+    placeholder.fill(Qt::darkGray);
+
+    connect(&scan_watcher, &QFutureWatcher<QVector<recording_entry>>::finished, this, &recordings_model::scanFinished);
+
+    // rescan a second after the folder settles, recordings change it often.
+    rescan_timer.setSingleShot(true);
+    rescan_timer.setInterval(1000);
+    connect(&rescan_timer, &QTimer::timeout, this, &recordings_model::rescan);
+    dir_watcher = new QFileSystemWatcher(QStringList({dir}), this);
+    connect(dir_watcher, &QFileSystemWatcher::directoryChanged, &rescan_timer, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+    rescan();
+}
+
+recordings_model::~recordings_model()
+{
+    // no task may post back to a deleted model.
+    decode_pool->clear();
+    decode_pool->waitForDone();
+    qDeleteAll(pending);
+}
+
+void recordings_model::setThumbnailSize(QSize size)
+{
+    thumbnail_size = size;
+    placeholder = QPixmap(size);
+    placeholder.fill(Qt::darkGray);
+    thumbnails.clear();
+    setCacheSize(cache_count);
+}
+
+void recordings_model::setCacheSize(int count)
+{
+    // cost is counted in KB of pixmap data.
+    cache_count = count;
+    int kb_per_thumbnail = thumbnail_size.width() * thumbnail_size.height() * 4 / 1024;
+    thumbnails.setMaxCost(count * qMax(1, kb_per_thumbnail));
+}
+
+QVector<recording_entry> recordings_model::scanDirectory(QString dir)
+{
+    // every recording has one cover jpg named after its start time, so name
+    // order is time order. one listing of the folder, no stat per recording.
+    QDir data_dir(dir);
+    QStringList files = data_dir.entryList(QDir::Files, QDir::Name | QDir::Reversed);
+    QSet<QString> names = QSet<QString>::fromList(files);
+
+    QVector<recording_entry> found;
+    foreach(QString file, files)
+    {
+        if (!file.endsWith(".jpg"))
+            continue;
+        QString name = file.left(file.size() - 4);
+        QDateTime time = QDateTime::fromString(name, name_format);
+        if (!time.isValid())
+            continue;
+
+        // motion tile recordings have no avi.
+        recording_entry entry;
+        entry.name = name;
+        entry.time = time;
+        entry.cover_path = data_dir.absoluteFilePath(file);
+        entry.video_path = data_dir.absoluteFilePath(names.contains(name + ".avi") ? name + ".avi" : name + ".tiles");
+        found.append(entry);
+    }
+    return found;
+}
+
+void recordings_model::rescan()
+{
+    if (scan_watcher.isRunning())
+    {
+        rescan_timer.start();
+        return;
+    }
+
+    scan_started_ms = QDateTime::currentMSecsSinceEpoch();
+    scan_watcher.setFuture(QtConcurrent::run(&recordings_model::scanDirectory, dir));
+}
+
+void recordings_model::scanFinished()
+{
+    QVector<recording_entry> found = scan_watcher.result();
+    int added = found.size() - entries.size();
+
+    // new recordings only add rows at the top, keep the view where it is.
+    if (added >= 0 && (entries.isEmpty() || found.at(added).name == entries.first().name))
+    {
+        if (added > 0)
+        {
+            beginInsertRows(QModelIndex(), 0, added - 1);
+            entries = found;
+            endInsertRows();
+        }
+    }
+    else
+    {
+        beginResetModel();
+        entries = found;
+        endResetModel();
+    }
+
+    emit scanned(entries.size(), QDateTime::currentMSecsSinceEpoch() - scan_started_ms);
+}
+
+int recordings_model::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : entries.size();
+}
+
+recording_entry recordings_model::entry(int row) const
+{
+    return entries.value(row);
+}
+
+int recordings_model::rowAt(QDateTime time) const
+{
+    if (entries.isEmpty())
+        return -1;
+
+    // entries are sorted newest first.
+    QVector<recording_entry>::const_iterator it = std::lower_bound(
+                entries.constBegin(), entries.constEnd(), time,
+                [](const recording_entry &entry, const QDateTime &t) { return entry.time > t; });
+    int row = it - entries.constBegin();
+    return qMin(row, entries.size() - 1);
+}
+
+QVariant recordings_model::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= entries.size())
+        return QVariant();
+
+    const recording_entry &entry = entries.at(index.row());
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        return entry.time.toString("yyyy-MM-dd HH:mm:ss");
+
+    case Qt::ToolTipRole:
+    case Qt::UserRole:
+        return entry.video_path;
+
+    case Qt::DecorationRole:
+    {
+        // only rows that are painted ever get decoded.
+        QPixmap *thumbnail = thumbnails.object(entry.cover_path);
+        if (thumbnail != nullptr)
+            return *thumbnail;
+        requestThumbnail(entry.cover_path);
+        return placeholder;
+    }
+    }
+    return QVariant();
+}
+
+void recordings_model::requestThumbnail(const QString &cover_path) const
+{
+    if (pending.contains(cover_path))
+        return;
+
+    // a fast scroll asks for many rows, only the latest are still on screen.
+    // a task that already runs is left to finish.
+    while (pending_order.size() >= max_pending_thumbnails)
+    {
+        QString stale = pending_order.takeFirst();
+        QRunnable *task = pending.value(stale);
+        if (decode_pool->tryTake(task))
+        {
+            pending.remove(stale);
+            delete task;
+        }
+    }
+
+    // later requests are the rows scrolled to last, run them first.
+    QRunnable *task = new thumbnail_task(const_cast<recordings_model*>(this), cover_path, thumbnail_size);
+    task->setAutoDelete(false);
+    pending.insert(cover_path, task);
+    pending_order.append(cover_path);
+    decode_pool->start(task, ++request_priority);
+}
+
+void recordings_model::thumbnailReady(QString cover_path, QImage image)
+{
+    delete pending.take(cover_path);
+    pending_order.removeOne(cover_path);
+    if (image.isNull())
+        return;
+
+    QPixmap *thumbnail = new QPixmap(QPixmap::fromImage(image));
+    thumbnails.insert(cover_path, thumbnail, qMax(1, image.byteCount() / 1024));
+
+    // find the row by its name, entries are sorted newest first.
+    QString name = QFileInfo(cover_path).completeBaseName();
+    QVector<recording_entry>::const_iterator it = std::lower_bound(
+                entries.constBegin(), entries.constEnd(), name,
+                [](const recording_entry &entry, const QString &n) { return entry.name > n; });
+    if (it != entries.constEnd() && it->name == name)
+    {
+        QModelIndex changed = index(it - entries.constBegin());
+        emit dataChanged(changed, changed, QVector<int>({Qt::DecorationRole}));
+    }
+}
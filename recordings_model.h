@@ -0,0 +1,89 @@
+#ifndef RECORDINGS_MODEL_H
+#define RECORDINGS_MODEL_H
+
+#include <QAbstractListModel>
+#include <QDateTime>
+#include <QString>
+#include <QVector>
+#include <QCache>
+#include <QSet>
+#include <QHash>
+#include <QList>
+#include <QPixmap>
+#include <QImage>
+#include <QThreadPool>
+#include <QFutureWatcher>
+#include <QFileSystemWatcher>
+#include <QTimer>
+
+struct recording_entry
+{
+    QString name;               // e.g. 2021-01-28+21:36:40
+    QDateTime time;
+    QString video_path;
+    QString cover_path;
+};
+
+/*
+ * list of the saved recordings, newest first.
+ *
+ * the directory is scanned on a background thread, so opening a folder of
+ * 100k clips does not block the gui. thumbnails are decoded from the cover
+ * jpgs only when a row is painted, at thumbnail size, on a small private
+ * pool; the latest request runs first and only the latest few wait, older
+ * ones are rows scrolled past and are dropped. decoded thumbnails live in
+ * a bounded LRU cache.
+ */
+class recordings_model : public QAbstractListModel
+{
+    Q_OBJECT;
+
+public:
+    explicit recordings_model(QString dir, QObject *parent=nullptr);
+    ~recordings_model();
+
+    int rowCount(const QModelIndex &parent=QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role=Qt::DisplayRole) const override;
+
+    recording_entry entry(int row) const;
+    // row of the recording closest to time.
+    int rowAt(QDateTime time) const;
+
+    void setThumbnailSize(QSize size);
+    void setCacheSize(int thumbnails);
+
+public slots:
+    void rescan();
+
+signals:
+    void scanned(int count, qint64 scan_ms);
+
+private slots:
+    void scanFinished();
+    void thumbnailReady(QString cover_path, QImage image);
+
+private:
+    static QVector<recording_entry> scanDirectory(QString dir);
+    void requestThumbnail(const QString &cover_path) const;
+
+    QString dir;
+    QVector<recording_entry> entries;
+
+    QFutureWatcher<QVector<recording_entry>> scan_watcher;
+    QFileSystemWatcher *dir_watcher;
+    QTimer rescan_timer;
+    qint64 scan_started_ms=0;
+
+    // lazily filled from data(), which is const for the views.
+    mutable QCache<QString, QPixmap> thumbnails;
+    // requested decodes by cover path, owned here, and their order.
+    mutable QHash<QString, QRunnable*> pending;
+    mutable QList<QString> pending_order;
+    mutable int request_priority=0;
+    QThreadPool *decode_pool;
+    QSize thumbnail_size;
+    int cache_count=500;
+    QPixmap placeholder;
+};
+
+#endif // RECORDINGS_MODEL_H
@@ -0,0 +1,101 @@
+#include "recordings_panel.h"
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QDesktopServices>
+#include <QUrl>
+
+recordings_panel::recordings_panel(QString dir, QWidget *parent):
+    QWidget(parent)
+{
+    recordings = new recordings_model(dir, this);
+
+    // uniform items let the view lay out 100k rows without asking each one.
+    list = new QListView(this);
+    list->setModel(recordings);
+    list->setFlow(QListView::LeftToRight);
+    list->setWrapping(false);
+    list->setUniformItemSizes(true);
+    list->setIconSize(QSize(160, 90));
+    list->setSelectionMode(QAbstractItemView::SingleSelection);
+    list->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
+    list->setMaximumHeight(140);
+
+    timeline = new QSlider(Qt::Horizontal, this);
+    timeline->setEnabled(false);
+    info = new QLabel("scanning recordings ...", this);
+
+    QHBoxLayout *timeline_layout = new QHBoxLayout();
+    timeline_layout->addWidget(info);
+    timeline_layout->addWidget(timeline, 1);
+
+    QVBoxLayout *layout = new QVBoxLayout();
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addLayout(timeline_layout);
+    layout->addWidget(list);
+    setLayout(layout);
+
+    connect(recordings, SIGNAL(scanned(int,qint64)), this, SLOT(updateTimeline(int,qint64)));
+    connect(timeline, SIGNAL(valueChanged(int)), this, SLOT(scrubTo(int)));
+    connect(list->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)), this, SLOT(currentChanged(QModelIndex)));
+    connect(list, SIGNAL(activated(QModelIndex)), this, SLOT(openRecording(QModelIndex)));
+}
+
+recordings_model *recordings_panel::model(){return recordings;}
+
+void recordings_panel::updateTimeline(int count, qint64 scan_ms)
+{
+    info->setText(QString("%1 recordings (%2 ms)").arg(count).arg(scan_ms));
+    if (count == 0)
+    {
+        timeline->setEnabled(false);
+        return;
+    }
+
+    // slider values are seconds since the oldest recording.
+    QDateTime newest = recordings->entry(0).time;
+    QDateTime oldest = recordings->entry(count - 1).time;
+    scrubbing = true;
+    origin = oldest;
+    timeline->setRange(0, int(qMax<qint64>(1, oldest.secsTo(newest))));
+    scrubbing = false;
+    timeline->setEnabled(true);
+}
+
+void recordings_panel::scrubTo(int seconds)
+{
+    if (scrubbing)
+        return;
+
+    QDateTime time = origin.addSecs(seconds);
+    int row = recordings->rowAt(time);
+    if (row < 0)
+        return;
+
+    scrubbing = true;
+    QModelIndex index = recordings->index(row);
+    list->setCurrentIndex(index);
+    list->scrollTo(index, QAbstractItemView::PositionAtCenter);
+    scrubbing = false;
+}
+
+void recordings_panel::currentChanged(const QModelIndex &current)
+{
+    if (!current.isValid())
+        return;
+
+    recording_entry entry = recordings->entry(current.row());
+    info->setText(entry.time.toString("yyyy-MM-dd HH:mm:ss"));
+
+    // keep the slider on the selected recording without scrubbing back.
+    if (!scrubbing)
+    {
+        scrubbing = true;
+        timeline->setValue(origin.secsTo(entry.time));
+        scrubbing = false;
+    }
+}
+
+void recordings_panel::openRecording(const QModelIndex &index)
+{
+    QDesktopServices::openUrl(QUrl::fromLocalFile(recordings->entry(index.row()).video_path));
+}
@@ -0,0 +1,42 @@
+#ifndef RECORDINGS_PANEL_H
+#define RECORDINGS_PANEL_H
+
+#include <QWidget>
+#include <QListView>
+#include <QSlider>
+#include <QLabel>
+#include "recordings_model.h"
+
+/*
+ * browser for the saved recordings.
+ *
+ * a horizontal strip of thumbnails, newest on the left, and a timeline
+ * slider from the oldest to the newest recording. dragging the slider
+ * scrubs the strip to the recording closest to that time. double click
+ * opens the recording with the default player.
+ */
+class recordings_panel : public QWidget
+{
+    Q_OBJECT;
+
+public:
+    explicit recordings_panel(QString dir, QWidget *parent=nullptr);
+
+    recordings_model *model();
+
+private slots:
+    void updateTimeline(int count, qint64 scan_ms);
+    void scrubTo(int seconds);
+    void currentChanged(const QModelIndex &current);
+    void openRecording(const QModelIndex &index);
+
+private:
+    recordings_model *recordings;
+    QListView *list;
+    QSlider *timeline;
+    QLabel *info;
+    QDateTime origin;           // time of the oldest recording
+    bool scrubbing=false;
+};
+
+#endif // RECORDINGS_PANEL_H
@@ -0,0 +1,135 @@
+#include "scene_monitor.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <opencv2/imgproc.hpp>
+
+// the checks run on a copy this small, a few hundred microseconds at most.
+static const cv::Size check_size(320, 180);
+static const int hist_bins = 32;
+// frames of lost sharpness without foreground before a slow cover counts.
+static const int blurred_limit = 30;
+// weight of a normal frame in the references.
+static const double reference_rate = 0.05;
+
+scene_monitor::scene_monitor()
+{
+
+}
+
+void scene_monitor::setParameters(double fg_ratio, double hist_shift, double drop)
+{
+    fg_ratio_limit = fg_ratio;
+    hist_shift_limit = hist_shift;
+    sharpness_drop = drop;
+}
+
+void scene_monitor::rebase()
+{
+    reference_hist.release();
+    reference_sharpness = 0;
+    blurred_frames = 0;
+}
+
+float scene_monitor::lastFgRatio(){return last_fg_ratio;}
+
+QString scene_monitor::changeName(SceneChange change)
+{
+    switch (change)
+    {
+    case LIGHTING: return "lighting change";
+    case MOVED: return "camera moved";
+    case COVERED: return "camera covered or defocused";
+    default: return "none";
+    }
+}
+
+scene_monitor::SceneChange scene_monitor::check(const cv::Mat &frame, const cv::Mat &raw_fg_mask)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // nearest neighbour reads only the pixels it keeps.
+    cv::resize(frame, small, check_size, 0, 0, cv::INTER_NEAREST);
+    cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+    cv::resize(raw_fg_mask, small_mask, check_size, 0, 0, cv::INTER_NEAREST);
+
+    // shadows are marked 127 by MOG2, only real foreground counts.
+    cv::threshold(small_mask, small_mask, 200, 255, cv::THRESH_BINARY);
+    last_fg_ratio = float(cv::countNonZero(small_mask)) / small_mask.total();
+
+    int channels[] = {0};
+    int bins[] = {hist_bins};
+    float range[] = {0, 256};
+    const float *ranges[] = {range};
+    cv::calcHist(&gray, 1, channels, cv::Mat(), hist, 1, bins, ranges);
+    cv::normalize(hist, hist, 1, 0, cv::NORM_L1);
+
+    cv::Laplacian(gray, laplacian, CV_16S);
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(laplacian, mean, stddev);
+    double sharpness = stddev[0] * stddev[0];
+
+    SceneChange change = NONE;
+    if (reference_hist.empty())
+    {
+        reference_hist = hist.clone();
+        reference_sharpness = sharpness;
+    }
+    else
+    {
+        double shift = cv::compareHist(hist, reference_hist, cv::HISTCMP_BHATTACHARYYA);
+        bool blurred = sharpness < reference_sharpness * sharpness_drop;
+        blurred_frames = blurred ? blurred_frames + 1 : 0;
+
+        if (last_fg_ratio > fg_ratio_limit)
+        {
+            if (blurred)
+                change = COVERED;
+            else if (shift > hist_shift_limit)
+                change = LIGHTING;
+            else
+                change = MOVED;
+        }
+        else if (blurred_frames > blurred_limit)
+            change = COVERED;
+
+        if (change != NONE)
+            rebase();
+        else if (!blurred)
+        {
+            // references follow slow drift, dusk does not count as a change.
+            // a blurred frame does not, or a slow covering becomes the reference.
+            cv::addWeighted(reference_hist, 1 - reference_rate, hist, reference_rate, 0, reference_hist);
+            reference_sharpness += reference_rate * (sharpness - reference_sharpness);
+        }
+    }
+
+    double check_us = timer.nsecsElapsed() / 1e3;
+    QMutexLocker locker(&stats_lock);
+    frames++;
+    check_us_total += check_us;
+    check_us_max = qMax(check_us_max, check_us);
+    if (change != NONE)
+    {
+        changes[change]++;
+        last_change = QString("%1 at %2 (foreground %3%)").arg(changeName(change))
+                .arg(QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm:ss"))
+                .arg(last_fg_ratio * 100, 0, 'f', 0);
+    }
+    return change;
+}
+
+QString scene_monitor::statsReport()
+{
+    QMutexLocker locker(&stats_lock);
+    QString report = QString("scene monitor : %1 frames, %2 us/frame (max %3)\n")
+            .arg(frames)
+            .arg(frames ? check_us_total / frames : 0.0, 0, 'f', 0)
+            .arg(check_us_max, 0, 'f', 0);
+    report += QString("  %1 lighting changes, %2 camera moved, %3 covered\n")
+            .arg(changes[LIGHTING]).arg(changes[MOVED]).arg(changes[COVERED]);
+    if (!last_change.isEmpty())
+        report += "  last : " + last_change + "\n";
+    return report;
+}
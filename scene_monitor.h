@@ -0,0 +1,61 @@
+#ifndef SCENE_MONITOR_H
+#define SCENE_MONITOR_H
+
+#include <QString>
+#include <QMutex>
+#include <opencv2/core.hpp>
+
+/*
+ * tells a change of the whole scene from motion in it.
+ *
+ * a light switched on, a bumped camera or a covered lens make most of the
+ * frame foreground at once. check() looks at a small copy of every frame :
+ *   - the foreground ratio of the raw segmentor mask,
+ *   - the shift of the grey histogram against a slowly updated reference,
+ *   - the sharpness (laplacian variance) against its reference.
+ * a high foreground ratio with a shifted histogram is a lighting change,
+ * with lost sharpness a covered or defocused lens, otherwise the camera
+ * moved. sharpness lost for a while without any foreground is also a
+ * covered lens. after a change the next frame becomes the new reference.
+ */
+class scene_monitor
+{
+public:
+    enum SceneChange{
+        NONE,
+        LIGHTING,
+        MOVED,
+        COVERED
+    };
+
+    scene_monitor();
+
+    void setParameters(double fg_ratio, double hist_shift, double sharpness_drop);
+    SceneChange check(const cv::Mat &frame, const cv::Mat &raw_fg_mask);
+    void rebase();
+
+    float lastFgRatio();
+    static QString changeName(SceneChange change);
+    QString statsReport();
+
+private:
+    double fg_ratio_limit=0.6;
+    double hist_shift_limit=0.3;
+    double sharpness_drop=0.35;
+
+    cv::Mat small, gray, small_mask, laplacian;
+    cv::Mat hist, reference_hist;
+    double reference_sharpness=0;
+    int blurred_frames=0;
+    float last_fg_ratio=0;
+
+    // metrics, read from the gui thread
+    QMutex stats_lock;
+    qint64 frames=0;
+    double check_us_total=0;
+    double check_us_max=0;
+    int changes[4]={0, 0, 0, 0};
+    QString last_change;
+};
+
+#endif // SCENE_MONITOR_H
@@ -19,18 +19,75 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 # Input
 SOURCES += main.cpp \
+    activity_heatmap.cpp \
+    alert_dispatcher.cpp \
+    avi_mjpeg_reader.cpp \
+    avi_mjpeg_writer.cpp \
+    blob_tracker.cpp \
+    camera_probe.cpp \
     capture_thread.cpp \
+    clip_export.cpp \
+    event_journal.cpp \
+    frame_bus.cpp \
+    frame_compositor.cpp \
     mainwindow.cpp \
-    utilities.cpp
+    memory_governor.cpp \
+    mjpeg_server.cpp \
+    object_detector.cpp \
+    pipeline_config.cpp \
+    pipeline_graph.cpp \
+    recording_recovery.cpp \
+    recordings_model.cpp \
+    recordings_panel.cpp \
+    scene_monitor.cpp \
+    thread_tuning.cpp \
+    tile_player.cpp \
+    tile_recorder.cpp \
+    utilities.cpp \
+    video_recorder.cpp \
+    zone_map.cpp
 QT += widgets multimedia core gui network concurrent
 
 HEADERS += \
+    activity_heatmap.h \
+    alert_dispatcher.h \
+    avi_mjpeg_reader.h \
+    avi_mjpeg_writer.h \
+    blob_tracker.h \
+    camera_probe.h \
     capture_thread.h \
+    clip_export.h \
+    event_journal.h \
+    frame_bus.h \
+    frame_bus_layout.h \
+    frame_compositor.h \
     mainwindow.h \
-    utilities.h
+    memory_governor.h \
+    mjpeg_server.h \
+    object_detector.h \
+    pipeline_config.h \
+    pipeline_graph.h \
+    recording_recovery.h \
+    recordings_model.h \
+    recordings_panel.h \
+    scene_monitor.h \
+    thread_tuning.h \
+    tile_player.h \
+    tile_recorder.h \
+    utilities.h \
+    video_recorder.h \
+    zone_map.h
 
 
 unix: !mac{
     INCLUDEPATH += /usr/local/include/opencv4
-    LIBS += -L/usr/local/lib -lopencv_core -lopencv_imgproc -lopencv_imgcodecs -lopencv_video -lopencv_videoio -lopencv_highgui
+    LIBS += -L/usr/local/lib -lopencv_core -lopencv_imgproc -lopencv_imgcodecs -lopencv_video -lopencv_videoio -lopencv_highgui -lopencv_dnn -lrt
+}
+
+# "make bench" builds the bench binary (bench.pro) and runs the pipeline
+# benchmark, see pipeline_bench.h
+# compare with an earlier report : make bench BENCH_ARGS="--baseline bench_baseline.json"
+!contains(DEFINES, BENCH){
+    bench.commands = $(QMAKE) $$PWD/bench.pro -o Makefile.bench && $(MAKE) -f Makefile.bench && ./bench --bench --output bench.json $(BENCH_ARGS)
+    QMAKE_EXTRA_TARGETS += bench
 }
@@ -0,0 +1,203 @@
+#include "thread_tuning.h"
+#include "pipeline_graph.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QThreadPool>
+#include <QMutexLocker>
+#include <opencv2/core/utility.hpp>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+QMutex thread_tuning::lock;
+threads_config thread_tuning::config;
+QMap<long, thread_tuning::thread_entry> thread_tuning::threads;
+int thread_tuning::launch_workers = -1;
+int thread_tuning::launch_opencv_threads = -1;
+
+static long currentTid()
+{
+    return syscall(SYS_gettid);
+}
+
+static bool parseCpus(QString cpus, cpu_set_t &set)
+{
+    // "0,2-3" -> cpus 0, 2 and 3.
+    CPU_ZERO(&set);
+    foreach(QString part, cpus.split(','))
+    {
+        QStringList range = part.split('-');
+        int first = range.first().toInt();
+        int last = range.last().toInt();
+        for (int cpu=first; cpu<=last && cpu<CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &set);
+    }
+    return CPU_COUNT(&set) > 0;
+}
+
+QString thread_tuning::apply(long tid, thread_entry &entry, const stage_config &stage)
+{
+    QStringList errors;
+    const stage_config &applied = entry.applied;
+
+    // an empty list gives the thread its launch affinity back.
+    cpu_set_t set;
+    if (!stage.cpus.isEmpty() && parseCpus(stage.cpus, set))
+    {
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0)
+            errors.append(QString("affinity %1 : %2").arg(stage.cpus, strerror(errno)));
+    }
+    else if (!applied.cpus.isEmpty())
+        sched_setaffinity(tid, sizeof(entry.launch_cpus), &entry.launch_cpus);
+
+    if (stage.realtime_priority > 0)
+    {
+        sched_param param;
+        param.sched_priority = stage.realtime_priority;
+        if (sched_setscheduler(tid, SCHED_FIFO, &param) != 0)
+            errors.append(QString("realtime %1 : %2").arg(stage.realtime_priority).arg(strerror(errno)));
+    }
+    else if (applied.realtime_priority > 0)
+        sched_setscheduler(tid, entry.launch_policy, &entry.launch_param);
+
+    // on linux the nice value belongs to the thread, not the process.
+    if (stage.realtime_priority == 0)
+    {
+        if (stage.nice != 0)
+        {
+            if (setpriority(PRIO_PROCESS, tid, stage.nice) != 0)
+                errors.append(QString("nice %1 : %2").arg(stage.nice).arg(strerror(errno)));
+        }
+        else if (applied.nice != 0)
+            setpriority(PRIO_PROCESS, tid, entry.launch_nice);
+    }
+
+    entry.applied = stage;
+    return errors.join(", ");
+}
+
+stage_config thread_tuning::stageConfig(QString stage)
+{
+    if (stage == "capture")
+        return config.capture;
+    if (stage == "analysis")
+        return config.analysis;
+    return config.io;
+}
+
+void thread_tuning::setConfig(threads_config new_config)
+{
+    QMutexLocker locker(&lock);
+    if (launch_workers < 0)
+    {
+        launch_workers = QThreadPool::globalInstance()->maxThreadCount();
+        launch_opencv_threads = cv::getNumThreads();
+    }
+
+    if (new_config.max_workers > 0)
+        QThreadPool::globalInstance()->setMaxThreadCount(new_config.max_workers);
+    else if (config.max_workers > 0)
+        QThreadPool::globalInstance()->setMaxThreadCount(launch_workers);
+    pipeline_graph::setWorkerCap(new_config.max_workers);
+
+    if (new_config.opencv_threads > 0)
+        cv::setNumThreads(new_config.opencv_threads);
+    else if (config.opencv_threads > 0)
+        cv::setNumThreads(launch_opencv_threads);
+    config = new_config;
+
+    for (QMap<long, thread_entry>::iterator it = threads.begin(); it != threads.end(); ++it)
+        it->error = apply(it.key(), it.value(), stageConfig(it->stage));
+}
+
+void thread_tuning::registerThread(QString stage, QString name)
+{
+    long tid = currentTid();
+
+    // the name shows up in top -H and gdb, 15 characters at most.
+    pthread_setname_np(pthread_self(), name.left(15).toLocal8Bit().constData());
+
+    QMutexLocker locker(&lock);
+    thread_entry entry;
+    entry.stage = stage;
+    entry.name = name;
+
+    // what the launch gave this thread, inherited from the one that started it.
+    sched_getaffinity(tid, sizeof(entry.launch_cpus), &entry.launch_cpus);
+    entry.launch_policy = sched_getscheduler(tid);
+    sched_getparam(tid, &entry.launch_param);
+    errno = 0;
+    int launch_nice = getpriority(PRIO_PROCESS, tid);
+    if (errno == 0)
+        entry.launch_nice = launch_nice;
+
+    entry.error = apply(tid, entry, stageConfig(stage));
+    threads.insert(tid, entry);
+    if (!entry.error.isEmpty())
+        qDebug() << QString("thread %1 (%2) : %3").arg(name, stage, entry.error);
+}
+
+void thread_tuning::unregisterThread()
+{
+    QMutexLocker locker(&lock);
+    threads.remove(currentTid());
+}
+
+QString thread_tuning::report()
+{
+    QMutexLocker locker(&lock);
+    long ticks_per_s = sysconf(_SC_CLK_TCK);
+    qint64 now_ms = QDateTime::currentMSecsSinceEpoch();
+
+    QString report = QString("threads : %1 registered, pool %2 workers\n")
+            .arg(threads.size()).arg(QThreadPool::globalInstance()->maxThreadCount());
+    for (QMap<long, thread_entry>::iterator it = threads.begin(); it != threads.end(); ++it)
+    {
+        QString task = QString("/proc/self/task/%1/").arg(it.key());
+
+        // utime and stime are fields 14 and 15, counted after the ")" of the name.
+        QFile stat_file(task + "stat");
+        if (!stat_file.open(QIODevice::ReadOnly))
+            continue;
+        QString stat = QString::fromLatin1(stat_file.readAll());
+        QStringList fields = stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+        qint64 ticks = fields.value(11).toLongLong() + fields.value(12).toLongLong();
+        int cpu = fields.value(36).toInt();
+
+        QString switches, allowed;
+        QFile status_file(task + "status");
+        if (status_file.open(QIODevice::ReadOnly))
+        {
+            foreach(QString line, QString::fromLatin1(status_file.readAll()).split('\n'))
+            {
+                if (line.startsWith("voluntary_ctxt_switches:"))
+                    switches = line.section(':', 1).trimmed();
+                else if (line.startsWith("nonvoluntary_ctxt_switches:"))
+                    switches += " / " + line.section(':', 1).trimmed();
+                else if (line.startsWith("Cpus_allowed_list:"))
+                    allowed = line.section(':', 1).trimmed();
+            }
+        }
+
+        // cpu use since the last report, 0 on the first one.
+        double cpu_percent = 0;
+        if (it->last_sample_ms > 0 && now_ms > it->last_sample_ms)
+            cpu_percent = 100.0 * (ticks - it->last_ticks) / ticks_per_s / ((now_ms - it->last_sample_ms) / 1000.0);
+        it->last_ticks = ticks;
+        it->last_sample_ms = now_ms;
+
+        report += QString("  %1 [%2] tid %3 : %4% cpu, %5 s total, on cpu %6 of %7, switches %8 (vol / invol)\n")
+                .arg(it->name, it->stage).arg(it.key())
+                .arg(cpu_percent, 0, 'f', 1)
+                .arg(double(ticks) / ticks_per_s, 0, 'f', 1)
+                .arg(cpu).arg(allowed, switches);
+        if (!it->error.isEmpty())
+            report += "    not applied : " + it->error + "\n";
+    }
+    return report;
+}
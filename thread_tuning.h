@@ -0,0 +1,60 @@
+#ifndef THREAD_TUNING_H
+#define THREAD_TUNING_H
+
+#include <QString>
+#include <QMap>
+#include <QMutex>
+#include <sched.h>
+#include "pipeline_config.h"
+
+/*
+ * cpu affinity, priority and accounting of the pipeline threads (linux).
+ *
+ * every long running thread calls registerThread() with its stage name
+ * first thing in run(), and unregisterThread() before it returns. the
+ * stage settings of the current threads_config are applied right away,
+ * and again to every registered thread on setConfig(), so a config
+ * reload re-pins running threads. report() reads cpu time and context
+ * switches of each registered thread from /proc/self/task.
+ *
+ * only configured settings are applied, the defaults leave what the thread
+ * had at launch (taskset, nice, chrt of the process). a reload back to the
+ * default restores that launch value, the same goes for max_workers and
+ * opencv_threads.
+ */
+class thread_tuning
+{
+public:
+    static void setConfig(threads_config config);
+    static void registerThread(QString stage, QString name);
+    static void unregisterThread();
+    static QString report();
+
+private:
+    struct thread_entry{
+        QString stage;
+        QString name;
+        QString error;          // what could not be applied
+        qint64 last_ticks=0;
+        qint64 last_sample_ms=0;
+
+        // as launched, restored when a setting goes back to its default.
+        cpu_set_t launch_cpus=cpu_set_t();
+        int launch_policy=SCHED_OTHER;
+        sched_param launch_param=sched_param();
+        int launch_nice=0;
+        stage_config applied;   // settings in effect, defaults until configured
+    };
+
+    static QString apply(long tid, thread_entry &entry, const stage_config &stage);
+    static stage_config stageConfig(QString stage);
+
+    static QMutex lock;
+    static threads_config config;
+    static QMap<long, thread_entry> threads;
+    // pool sizes before the first config, restored by a reload back to 0.
+    static int launch_workers;
+    static int launch_opencv_threads;
+};
+
+#endif // THREAD_TUNING_H
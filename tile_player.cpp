@@ -0,0 +1,194 @@
+#include "tile_player.h"
+#include "tile_recorder.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <cmath>
+#include <cstring>
+
+tile_player::tile_player()
+{
+
+}
+
+tile_player::~tile_player()
+{
+    close();
+}
+
+bool tile_player::open(QString path)
+{
+    close();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    in.setDevice(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    char header_magic[8];
+    qint32 width, height, tile;
+    if (in.readRawData(header_magic, 8) != 8 || memcmp(header_magic, tile_recorder::magic, 8) != 0)
+    {
+        qDebug() << "not a tile file : " << path;
+        close();
+        return false;
+    }
+    in >> width >> height >> tile >> frame_rate;
+    if (in.status() != QDataStream::Ok || width <= 0 || height <= 0 || width > 16384 || height > 16384 ||
+            tile <= 0 || tile > 1024)
+    {
+        qDebug() << "bad tile file header : " << path;
+        close();
+        return false;
+    }
+
+    frame_size = cv::Size(width, height);
+    tile_size = tile;
+    keyframe.release();
+    return in.status() == QDataStream::Ok;
+}
+
+void tile_player::close()
+{
+    in.setDevice(nullptr);
+    if (file.isOpen())
+        file.close();
+}
+
+cv::Size tile_player::frameSize(){return frame_size;}
+
+double tile_player::fps(){return frame_rate;}
+
+qint64 tile_player::position(){return file.pos();}
+
+bool tile_player::readFrame(cv::Mat &frame, qint64 &time_ms)
+{
+    // a damaged file ends playback at the first record that does not add up.
+    int grid_cols = (frame_size.width + tile_size - 1) / tile_size;
+    int grid_rows = (frame_size.height + tile_size - 1) / tile_size;
+    quint32 max_jpeg_size = quint32(frame_size.width) * frame_size.height * 3 + 65536;
+
+    while (file.isOpen() && !in.atEnd())
+    {
+        quint8 type;
+        quint32 n_tiles, jpeg_size;
+        in >> type >> time_ms;
+        if (in.status() != QDataStream::Ok)
+            return false;
+
+        if (type == tile_recorder::KEYFRAME)
+        {
+            in >> jpeg_size;
+            if (in.status() != QDataStream::Ok || jpeg_size > max_jpeg_size)
+                return corrupt("keyframe size");
+            jpeg.resize(jpeg_size);
+            if (in.readRawData(reinterpret_cast<char*>(jpeg.data()), jpeg_size) != int(jpeg_size))
+                return false;
+            keyframe = cv::imdecode(jpeg, cv::IMREAD_COLOR);
+            if (keyframe.size() != frame_size)
+                return corrupt("keyframe image");
+            continue;
+        }
+        if (type != tile_recorder::DELTA)
+            return corrupt(QString("record type %1").arg(type));
+
+        // a delta record : tile positions followed by their mosaic.
+        in >> n_tiles;
+        if (in.status() != QDataStream::Ok || n_tiles > quint32(grid_cols * grid_rows))
+            return corrupt("tile count");
+        tiles.resize(n_tiles);
+        for (quint32 i=0; i<n_tiles; i++)
+        {
+            quint16 tx, ty;
+            in >> tx >> ty;
+            if (tx >= grid_cols || ty >= grid_rows)
+                return corrupt("tile position");
+            tiles[i] = cv::Point(tx, ty);
+        }
+        in >> jpeg_size;
+        if (in.status() != QDataStream::Ok || jpeg_size > max_jpeg_size)
+            return corrupt("mosaic size");
+        jpeg.resize(jpeg_size);
+        if (in.readRawData(reinterpret_cast<char*>(jpeg.data()), jpeg_size) != int(jpeg_size))
+            return false;
+
+        // the recorder starts every file with a keyframe.
+        if (keyframe.empty())
+            return corrupt("delta before the first keyframe");
+
+        keyframe.copyTo(frame);
+        if (n_tiles == 0)
+            return true;
+
+        cv::imdecode(jpeg, cv::IMREAD_COLOR, &mosaic);
+        int mosaic_cols = std::ceil(std::sqrt(double(n_tiles)));
+        int mosaic_rows = (n_tiles + mosaic_cols - 1) / mosaic_cols;
+        if (mosaic.cols < mosaic_cols * tile_size || mosaic.rows < mosaic_rows * tile_size)
+            return corrupt("mosaic image");
+        for (quint32 i=0; i<n_tiles; i++)
+        {
+            cv::Rect dst(tiles[i].x * tile_size, tiles[i].y * tile_size, tile_size, tile_size);
+            dst &= cv::Rect(0, 0, frame.cols, frame.rows);
+            cv::Rect src((i % mosaic_cols) * tile_size, (i / mosaic_cols) * tile_size, dst.width, dst.height);
+            mosaic(src).copyTo(frame(dst));
+        }
+        return true;
+    }
+    return false;
+}
+
+bool tile_player::corrupt(QString what)
+{
+    qDebug() << QString("corrupt tile file %1 at %2 : %3").arg(file.fileName()).arg(file.pos()).arg(what);
+    close();
+    return false;
+}
+
+bool tile_player::exportVideo(QString avi_path)
+{
+    cv::VideoWriter writer(avi_path.toStdString(),
+                           cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
+                           frame_rate > 0 ? frame_rate : 30,
+                           frame_size);
+    if (!writer.isOpened())
+        return false;
+
+    cv::Mat frame;
+    qint64 time_ms;
+    while (readFrame(frame, time_ms))
+        writer.write(frame);
+    writer.release();
+    return true;
+}
+
+QString tile_player::benchmark(QString path)
+{
+    tile_player player;
+    if (!player.open(path))
+        return QString("can not open %1").arg(path);
+
+    cv::Mat frame;
+    qint64 time_ms;
+    int frames = 0;
+    QElapsedTimer timer;
+    timer.start();
+    while (player.readFrame(frame, time_ms))
+        frames++;
+    double seconds = timer.nsecsElapsed() / 1e9;
+
+    qint64 stored_bytes = QFileInfo(path).size();
+    double raw_bytes = double(frames) * player.frameSize().width * player.frameSize().height * 3;
+
+    return QString("%1\n%2 frames %3x%4, %5 MB stored\n"
+                   "compression %6x vs raw\n"
+                   "reconstruction %7 fps (%8 ms/frame)")
+            .arg(path)
+            .arg(frames).arg(player.frameSize().width).arg(player.frameSize().height)
+            .arg(stored_bytes / 1e6, 0, 'f', 2)
+            .arg(stored_bytes ? raw_bytes / stored_bytes : 0.0, 0, 'f', 1)
+            .arg(seconds > 0 ? frames / seconds : 0.0, 0, 'f', 1)
+            .arg(frames ? seconds * 1000 / frames : 0.0, 0, 'f', 2);
+}
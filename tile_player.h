@@ -0,0 +1,52 @@
+#ifndef TILE_PLAYER_H
+#define TILE_PLAYER_H
+
+#include <QString>
+#include <QFile>
+#include <QDataStream>
+#include <opencv2/opencv.hpp>
+
+/*
+ * reads .tiles files written by tile_recorder and rebuilds full frames :
+ * the last keyframe with the changed tiles of the frame pasted on top.
+ */
+class tile_player
+{
+public:
+    tile_player();
+    ~tile_player();
+
+    bool open(QString path);
+    void close();
+
+    // reconstructs the next frame, false at the end of the file.
+    bool readFrame(cv::Mat &frame, qint64 &time_ms);
+
+    cv::Size frameSize();
+    double fps();
+
+    // file offset just after the last record read.
+    qint64 position();
+
+    // re-encodes the whole file as a normal MJPG avi.
+    bool exportVideo(QString avi_path);
+
+    // decodes the whole file and reports compression and decode speed.
+    static QString benchmark(QString path);
+
+private:
+    bool corrupt(QString what);
+
+    QFile file;
+    QDataStream in;
+    cv::Size frame_size;
+    int tile_size=0;
+    float frame_rate=0;
+
+    cv::Mat keyframe;
+    cv::Mat mosaic;
+    std::vector<uchar> jpeg;
+    std::vector<cv::Point> tiles;
+};
+
+#endif // TILE_PLAYER_H
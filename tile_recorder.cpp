@@ -0,0 +1,177 @@
+#include "tile_recorder.h"
+#include <QDataStream>
+#include <QDebug>
+#include <cmath>
+
+const char tile_recorder::magic[9] = "HCSTILE1";
+
+tile_recorder::tile_recorder(int tile_size, double keyframe_interval_s, int quality, int replaced_quality):
+    tile_size(tile_size), keyframe_interval_s(keyframe_interval_s), quality(quality),
+    replaced_quality(replaced_quality)
+{
+
+}
+
+tile_recorder::~tile_recorder()
+{
+    release();
+}
+
+bool tile_recorder::open(QString path, cv::Size size, double fps)
+{
+    release();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "failed to open tile file : " << path;
+        return false;
+    }
+
+    frame_size = size;
+    frames_written = 0;
+    reference_bytes = 0;
+    reference_frames = 0;
+    last_keyframe_ms = -1;
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    out.writeRawData(magic, 8);
+    out << qint32(size.width) << qint32(size.height) << qint32(tile_size) << float(fps);
+    bytes_written = file.pos();
+
+    timer.start();
+    return true;
+}
+
+bool tile_recorder::isOpened(){return file.isOpen();}
+
+void tile_recorder::writeKeyframe(const cv::Mat &image, qint64 time_ms)
+{
+    cv::imencode(".jpg", image, jpeg, {cv::IMWRITE_JPEG_QUALITY, quality});
+
+    record.clear();
+    QDataStream out(&record, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << quint8(KEYFRAME) << qint64(time_ms) << quint32(jpeg.size());
+    out.writeRawData(reinterpret_cast<const char*>(jpeg.data()), jpeg.size());
+
+    bytes_written += file.write(record);
+    last_keyframe_ms = time_ms;
+}
+
+void tile_recorder::flagTiles(const cv::Mat &fg_mask, cv::Rect caption, std::vector<cv::Point> &changed)
+{
+    changed.clear();
+    int grid_cols = (frame_size.width + tile_size - 1) / tile_size;
+    int grid_rows = (frame_size.height + tile_size - 1) / tile_size;
+
+    for (int ty=0; ty<grid_rows; ty++)
+    {
+        for (int tx=0; tx<grid_cols; tx++)
+        {
+            // without a mask every tile counts as changed.
+            if (fg_mask.empty())
+            {
+                changed.push_back(cv::Point(tx, ty));
+                continue;
+            }
+
+            cv::Rect roi(tx * tile_size, ty * tile_size, tile_size, tile_size);
+            roi &= cv::Rect(0, 0, fg_mask.cols, fg_mask.rows);
+            if ((roi & caption).area() > 0 || cv::countNonZero(fg_mask(roi)) > 0)
+                changed.push_back(cv::Point(tx, ty));
+        }
+    }
+}
+
+void tile_recorder::packTiles(const cv::Mat &frame, const std::vector<cv::Point> &tiles,
+                              int tile_size, cv::Mat &mosaic)
+{
+    int n_tiles = tiles.size();
+    int mosaic_cols = std::ceil(std::sqrt(double(n_tiles)));
+    int mosaic_rows = (n_tiles + mosaic_cols - 1) / mosaic_cols;
+    // the unused cells of the last row and the clipped edge tiles stay black.
+    mosaic.create(mosaic_rows * tile_size, mosaic_cols * tile_size, frame.type());
+    mosaic.setTo(cv::Scalar::all(0));
+
+    for (int i=0; i<n_tiles; i++)
+    {
+        cv::Rect src(tiles[i].x * tile_size, tiles[i].y * tile_size, tile_size, tile_size);
+        src &= cv::Rect(0, 0, frame.cols, frame.rows);
+        cv::Rect dst((i % mosaic_cols) * tile_size, (i / mosaic_cols) * tile_size, src.width, src.height);
+        frame(src).copyTo(mosaic(dst));
+    }
+}
+
+void tile_recorder::write(cv::Mat &frame, const cv::Mat &fg_mask, const cv::Mat &background, cv::Rect caption)
+{
+    if (!file.isOpen())
+        return;
+
+    qint64 time_ms = timer.elapsed();
+
+    // refresh the background keyframe periodically.
+    if (last_keyframe_ms < 0 || time_ms - last_keyframe_ms >= keyframe_interval_s * 1000)
+    {
+        bool has_background = !background.empty() && background.size() == frame.size();
+        writeKeyframe(has_background ? background : frame, time_ms);
+
+        // what this frame costs in the main stream, one sample per keyframe.
+        cv::imencode(".jpg", frame, jpeg, {cv::IMWRITE_JPEG_QUALITY, replaced_quality});
+        reference_bytes += jpeg.size();
+        reference_frames++;
+    }
+
+    cv::Mat mask = fg_mask.size() == frame.size() ? fg_mask : cv::Mat();
+    flagTiles(mask, caption, tiles);
+
+    record.clear();
+    QDataStream out(&record, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << quint8(DELTA) << qint64(time_ms) << quint32(tiles.size());
+    for (size_t i=0; i<tiles.size(); i++)
+        out << quint16(tiles[i].x) << quint16(tiles[i].y);
+
+    if (tiles.empty())
+    {
+        out << quint32(0);
+    }
+    else
+    {
+        packTiles(frame, tiles, tile_size, mosaic);
+        cv::imencode(".jpg", mosaic, jpeg, {cv::IMWRITE_JPEG_QUALITY, quality});
+        out << quint32(jpeg.size());
+        out.writeRawData(reinterpret_cast<const char*>(jpeg.data()), jpeg.size());
+    }
+
+    bytes_written += file.write(record);
+    frames_written++;
+}
+
+void tile_recorder::release()
+{
+    if (!file.isOpen())
+        return;
+
+    file.close();
+    qDebug() << QString("tile storage %1 : %2 frames, %3 MB, %4x less than mjpg")
+                .arg(file.fileName())
+                .arg(frames_written)
+                .arg(bytes_written / 1e6, 0, 'f', 2)
+                .arg(compressionRatio(), 0, 'f', 1);
+}
+
+qint64 tile_recorder::bytesWritten(){return bytes_written;}
+
+qint64 tile_recorder::framesWritten(){return frames_written;}
+
+double tile_recorder::compressionRatio()
+{
+    if (bytes_written == 0 || reference_frames == 0)
+        return 0.0;
+
+    double replaced_bytes = double(frames_written) * reference_bytes / reference_frames;
+    return replaced_bytes / bytes_written;
+}
@@ -0,0 +1,82 @@
+#ifndef TILE_RECORDER_H
+#define TILE_RECORDER_H
+
+#include <QString>
+#include <QFile>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <opencv2/opencv.hpp>
+
+/*
+ * motion only storage (.tiles files).
+ *
+ * instead of re-encoding every full frame, the file holds a jpeg of the
+ * background model every few seconds (keyframe) and, per frame, only the
+ * tiles that the foreground mask flags as changed. the changed tiles are
+ * packed side by side into one mosaic and encoded as a single jpeg. the
+ * background carries no caption, so the tiles under the caption band go
+ * out with every frame and keep the timestamp current.
+ *
+ * layout (little endian) :
+ *   header   : "HCSTILE1", int32 width, int32 height, int32 tile_size, float fps
+ *   keyframe : uint8 0, int64 time_ms, uint32 jpeg_size, jpeg
+ *   delta    : uint8 1, int64 time_ms, uint32 n_tiles, n_tiles x (uint16 tx, uint16 ty),
+ *              uint32 jpeg_size, jpeg (mosaic of the tiles, row major)
+ *
+ * tile_player reads the format back into full frames.
+ */
+class tile_recorder
+{
+public:
+    enum RecordType{
+        KEYFRAME=0,
+        DELTA=1
+    };
+
+    tile_recorder(int tile_size=32, double keyframe_interval_s=10.0, int quality=90, int replaced_quality=95);
+    ~tile_recorder();
+
+    bool open(QString path, cv::Size frame_size, double fps);
+    void write(cv::Mat &frame, const cv::Mat &fg_mask, const cv::Mat &background, cv::Rect caption=cv::Rect());
+    void release();
+    bool isOpened();
+
+    qint64 bytesWritten();
+    qint64 framesWritten();
+    // against the full frame mjpg stream the tiles replace, estimated from a
+    // full frame encoded at replaced_quality with every keyframe.
+    double compressionRatio();
+
+    static const char magic[9];
+
+    // packs the given tiles of frame into one mosaic image.
+    static void packTiles(const cv::Mat &frame, const std::vector<cv::Point> &tiles,
+                          int tile_size, cv::Mat &mosaic);
+
+private:
+    void writeKeyframe(const cv::Mat &image, qint64 time_ms);
+    void flagTiles(const cv::Mat &fg_mask, cv::Rect caption, std::vector<cv::Point> &tiles);
+
+    QFile file;
+    cv::Size frame_size;
+    int tile_size;
+    double keyframe_interval_s;
+    int quality;
+    int replaced_quality;
+
+    QElapsedTimer timer;
+    qint64 last_keyframe_ms=-1;
+    qint64 frames_written=0;
+    qint64 bytes_written=0;
+    qint64 reference_bytes=0;       // of the sampled full frames
+    int reference_frames=0;
+
+    // reused between frames.
+    cv::Mat tile_grid;
+    cv::Mat mosaic;
+    std::vector<cv::Point> tiles;
+    std::vector<uchar> jpeg;
+    QByteArray record;
+};
+
+#endif // TILE_RECORDER_H
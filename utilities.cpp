@@ -1,11 +1,30 @@
 #include "utilities.h"
+#include "alert_dispatcher.h"
 #include <QStandardPaths>
 #include <QDir>
 #include <QDebug>
 #include <QDateTime>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <fcntl.h>
+#include <unistd.h>
+
+// set by the benchmark, empty uses the movies folder.
+static QString data_path_override;
+
+void utilities::setDataPath(QString path)
+{
+    data_path_override = path;
+}
 
 QString utilities::getDataPath()
 {
+    if (!data_path_override.isEmpty())
+    {
+        QDir().mkpath(data_path_override);
+        return data_path_override;
+    }
+
     // get the standard locations
     QString user_movie_path = QStandardPaths::standardLocations( QStandardPaths::MoviesLocation)[0];
 //    qDebug() <<QString("user movie path : " ) + user_movie_path;
@@ -29,3 +48,64 @@ QString utilities::getSavedVideoPath(QString name, QString postfix)
 {
     return QString("%1/%2.%3").arg(utilities::getDataPath(), name, postfix);
 }
+
+void utilities::notifyMobile(QString camname, QString message)
+{
+    // only queues the alert, delivery happens on the dispatcher thread.
+    alert_dispatcher *dispatcher = alert_dispatcher::instance();
+    if (dispatcher != nullptr)
+        dispatcher->enqueue(camname, message);
+}
+
+bool utilities::syncFile(QString path)
+{
+    // flush the file and its directory entry to disk.
+    int fd = ::open(path.toLocal8Bit().constData(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+
+    int dir_fd = ::open(QFileInfo(path).absolutePath().toLocal8Bit().constData(), O_RDONLY);
+    if (dir_fd >= 0)
+    {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+    return ok;
+}
+
+QString utilities::inProgressPath(QString path)
+{
+    // name.avi -> name.inprogress.avi, the extension keeps its meaning.
+    int dot = path.lastIndexOf('.');
+    return path.left(dot) + ".inprogress" + path.mid(dot);
+}
+
+QString utilities::finishedPath(QString in_progress_path)
+{
+    return QString(in_progress_path).replace(".inprogress.", ".");
+}
+
+// /dev/video0 -> dev_video0
+static QString fileSafeName(QString camname)
+{
+    QString name = camname;
+    name.replace(QRegularExpression("[^A-Za-z0-9_-]+"), "_");
+    name.remove(QRegularExpression("^_+"));
+    return name;
+}
+
+QString utilities::backgroundModelPath(QString camname)
+{
+    // one background image per camera, /dev/video0 -> models/dev_video0.png
+    QDir data_dir(getDataPath());
+    data_dir.mkpath("models");
+    return data_dir.absoluteFilePath("models/" + fileSafeName(camname) + ".png");
+}
+
+QString utilities::frameBusName(QString camname)
+{
+    // a shared memory name, /dev/video0 -> /software_dev_video0
+    return "/software_" + fileSafeName(camname);
+}
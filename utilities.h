@@ -6,9 +6,15 @@ class utilities
 {
 public:
     static QString getDataPath();
+    static void setDataPath(QString path);
     static QString newSavedVideoName();
     static QString getSavedVideoPath(QString name, QString postfix);
-    static void notifyMobile(QString camname);
+    static void notifyMobile(QString camname, QString message="motion detected");
+    static bool syncFile(QString path);
+    static QString inProgressPath(QString path);
+    static QString finishedPath(QString in_progress_path);
+    static QString backgroundModelPath(QString camname);
+    static QString frameBusName(QString camname);
 };
 
 #endif // UTILITIES_H
@@ -0,0 +1,290 @@
+#include "video_recorder.h"
+#include "utilities.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QtConcurrent>
+#include <cmath>
+
+video_recorder::video_recorder()
+{
+    configs = defaultStreams();
+}
+
+video_recorder::~video_recorder()
+{
+    release();
+}
+
+QList<video_recorder::stream_config> video_recorder::defaultStreams()
+{
+    // full resolution archive
+    stream_config main_stream;
+    main_stream.name = "main";
+
+    // a third of the size at a third of the frame rate for remote review.
+    stream_config sub_stream;
+    sub_stream.name = "sub";
+    sub_stream.scale = 1.0 / 3;
+    sub_stream.fps_divisor = 3;
+    sub_stream.quality = 70;
+
+    return QList<stream_config>({main_stream, sub_stream});
+}
+
+video_recorder::stream_config video_recorder::tileStream(int replaced_quality)
+{
+    // motion only storage in place of the full resolution main stream.
+    stream_config tile_stream;
+    tile_stream.name = "motion";
+    tile_stream.mode = TILES;
+    tile_stream.quality = 85;
+    tile_stream.replaced_quality = replaced_quality;
+    return tile_stream;
+}
+
+void video_recorder::setStreams(QList<stream_config> stream_configs)
+{
+    // takes effect with the next open().
+    configs = stream_configs;
+}
+
+void video_recorder::setSegmentSeconds(double seconds)
+{
+    segment_seconds = seconds;
+}
+
+bool video_recorder::open(QString name, cv::Size frame_size, double fps)
+{
+    release();
+
+    QMutexLocker locker(&stats_lock);
+    base_name = name;
+    input_fps = fps;
+    segment_index = 0;
+
+    foreach(stream_config config, configs)
+    {
+        stream_state stream;
+        stream.config = config;
+        stream.size = cv::Size(qRound(frame_size.width * config.scale) & ~1,
+                               qRound(frame_size.height * config.scale) & ~1);
+        if (openSegment(stream))
+            streams.append(stream);
+    }
+
+    frame_index = 0;
+    recorded_seconds = 0.0;
+    record_timer.start();
+    segment_start_ms = 0;
+    return !streams.isEmpty();
+}
+
+bool video_recorder::openSegment(stream_state &stream)
+{
+    stream_config &config = stream.config;
+    QString name = base_name;
+    if (segment_index > 0)
+        name += QString(".part%1").arg(segment_index, 3, 10, QChar('0'));
+    if (config.name != "main")
+        name += "." + config.name;
+
+    int divisor = qMax(1, config.fps_divisor);
+
+    if (config.mode == TILES)
+    {
+        stream.path = utilities::inProgressPath(utilities::getSavedVideoPath(name, "tiles"));
+        stream.tiles = new tile_recorder(32, 10.0, config.quality, config.replaced_quality);
+        if (!stream.tiles->open(stream.path, stream.size, input_fps / divisor))
+        {
+            delete stream.tiles;
+            stream.tiles = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    stream.path = utilities::inProgressPath(utilities::getSavedVideoPath(name, "avi"));
+    stream.writer = new cv::VideoWriter(stream.path.toStdString(), config.fourcc, input_fps / divisor, stream.size);
+    if (!stream.writer->isOpened())
+    {
+        qDebug() << "failed to open video stream : " << stream.path;
+        delete stream.writer;
+        stream.writer = nullptr;
+        return false;
+    }
+    stream.writer->set(cv::VIDEOWRITER_PROP_QUALITY, config.quality);
+    return true;
+}
+
+void video_recorder::closeSegment(stream_state &stream)
+{
+    if (stream.tiles != nullptr)
+    {
+        stream.tiles->release();
+        delete stream.tiles;
+        stream.tiles = nullptr;
+    }
+    else if (stream.writer != nullptr)
+    {
+        stream.writer->release();
+        delete stream.writer;
+        stream.writer = nullptr;
+    }
+    else
+        return;
+
+    stream.bytes_closed += QFileInfo(stream.path).size();
+
+    // one fsync per segment, done on the global pool so capture never waits.
+    QString path = stream.path;
+    stream.path.clear();
+    QtConcurrent::run([path]() {
+        utilities::syncFile(path);
+        QString finished = utilities::finishedPath(path);
+        QFile::rename(path, finished);
+        utilities::syncFile(finished);
+    });
+}
+
+void video_recorder::nextSegment()
+{
+    QMutexLocker locker(&stats_lock);
+    segment_index++;
+    for (int i=0; i<streams.size(); i++)
+    {
+        closeSegment(streams[i]);
+        openSegment(streams[i]);
+    }
+    segment_start_ms = record_timer.elapsed();
+}
+
+bool video_recorder::isOpened(){return !streams.isEmpty();}
+
+cv::Mat &video_recorder::scaledFrame(cv::Mat &frame, cv::Size size)
+{
+    if (size == frame.size())
+        return frame;
+
+    for (size_t i=0; i<scaled_count; i++)
+    {
+        if (scaled_cache[i].first == size)
+            return scaled_cache[i].second;
+    }
+
+    // fill the next slot, its buffer is reused from earlier frames.
+    if (scaled_count == scaled_cache.size())
+        scaled_cache.push_back(std::make_pair(size, cv::Mat()));
+    std::pair<cv::Size, cv::Mat> &entry = scaled_cache[scaled_count++];
+    entry.first = size;
+    cv::resize(frame, entry.second, size, 0, 0, cv::INTER_AREA);
+    return entry.second;
+}
+
+void video_recorder::write(cv::Mat &frame, const cv::Mat &fg_mask, const cv::Mat &background, cv::Rect caption)
+{
+    if (segment_seconds > 0 && record_timer.elapsed() - segment_start_ms >= segment_seconds * 1000)
+        nextSegment();
+
+    scaled_count = 0;
+    for (int i=0; i<streams.size(); i++)
+    {
+        stream_state &stream = streams[i];
+        if (frame_index % qMax(1, stream.config.fps_divisor) != 0)
+            continue;
+
+        // the segment failed to open, skip until the next one.
+        if (stream.writer == nullptr && stream.tiles == nullptr)
+            continue;
+
+        if (stream.tiles != nullptr)
+        {
+            // tiles need the mask and background at the same scale as the frame.
+            cv::Mat mask = fg_mask;
+            cv::Mat background_image = background;
+            cv::Rect caption_band = caption;
+            if (stream.size != frame.size())
+            {
+                if (!fg_mask.empty())
+                    cv::resize(fg_mask, mask, stream.size, 0, 0, cv::INTER_NEAREST);
+                if (!background.empty())
+                    cv::resize(background, background_image, stream.size, 0, 0, cv::INTER_AREA);
+                double sx = double(stream.size.width) / frame.cols;
+                double sy = double(stream.size.height) / frame.rows;
+                caption_band = cv::Rect(cv::Point(std::floor(caption.x * sx), std::floor(caption.y * sy)),
+                                        cv::Point(std::ceil(caption.br().x * sx), std::ceil(caption.br().y * sy)));
+            }
+            stream.tiles->write(scaledFrame(frame, stream.size), mask, background_image, caption_band);
+        }
+        else
+            stream.writer->write(scaledFrame(frame, stream.size));
+
+        // read by statsReport() on the gui thread.
+        stats_lock.lock();
+        stream.frames_written++;
+        stats_lock.unlock();
+    }
+
+    // refresh the byte counters about once per second of 30 fps video.
+    if (++frame_index % 30 == 0)
+        updateBytesWritten();
+}
+
+void video_recorder::updateBytesWritten()
+{
+    QMutexLocker locker(&stats_lock);
+    for (int i=0; i<streams.size(); i++)
+    {
+        streams[i].bytes_written = streams[i].bytes_closed + QFileInfo(streams[i].path).size();
+        if (streams[i].tiles != nullptr)
+            streams[i].compression = streams[i].tiles->compressionRatio();
+    }
+    recorded_seconds = record_timer.elapsed() / 1000.0;
+}
+
+void video_recorder::release()
+{
+    if (streams.isEmpty())
+        return;
+
+    for (int i=0; i<streams.size(); i++)
+        closeSegment(streams[i]);
+    updateBytesWritten();
+    QString report = statsReport();
+    qDebug().noquote() << report;
+
+    QMutexLocker locker(&stats_lock);
+    last_report = report;
+    streams.clear();
+}
+
+QStringList video_recorder::outputPaths()
+{
+    QMutexLocker locker(&stats_lock);
+    QStringList paths;
+    foreach(stream_state stream, streams)
+        paths.append(stream.path);
+    return paths;
+}
+
+QString video_recorder::statsReport()
+{
+    QMutexLocker locker(&stats_lock);
+    if (streams.isEmpty())
+        return last_report.isEmpty() ? "not recording" : "last recording, " + last_report;
+
+    QString report = QString("recorded %1 s\n").arg(recorded_seconds, 0, 'f', 1);
+    foreach(stream_state stream, streams)
+    {
+        double bytes_per_second = recorded_seconds > 0 ? stream.bytes_written / recorded_seconds : 0.0;
+        report += QString("%1 %2x%3 : %4 frames, %5 MB, %6 KB/s\n")
+                .arg(stream.config.name)
+                .arg(stream.size.width).arg(stream.size.height)
+                .arg(stream.frames_written)
+                .arg(stream.bytes_written / 1e6, 0, 'f', 2)
+                .arg(bytes_per_second / 1024.0, 0, 'f', 1);
+        if (stream.config.mode == TILES && stream.compression > 0)
+            report += QString("    %1x less than the mjpg main stream\n").arg(stream.compression, 0, 'f', 1);
+    }
+    return report;
+}
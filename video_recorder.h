@@ -0,0 +1,100 @@
+#ifndef VIDEO_RECORDER_H
+#define VIDEO_RECORDER_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <opencv2/opencv.hpp>
+#include <opencv2/videoio.hpp>
+#include "tile_recorder.h"
+
+/*
+ * writes the same frames into several video streams at once,
+ * e.g. a full resolution archive and a small low fps sub stream.
+ *
+ * streams that ask for the same output size share one resized frame,
+ * so each distinct size is downscaled once per frame.
+ *
+ * recordings are split into self contained segments of segment_seconds.
+ * a segment is written as <name>.inprogress.avi and only renamed to its
+ * final name once closed and synced to disk (off the capture thread), so
+ * a crash loses at most the open segment, which recording_recovery repairs.
+ * segments after the first are named <name>.partNNN.
+ */
+class video_recorder
+{
+public:
+    enum StreamMode{
+        VIDEO,                  // every frame through cv::VideoWriter
+        TILES                   // background keyframes + changed tiles, see tile_recorder
+    };
+
+    struct stream_config{
+        QString name;           // used as file suffix, "main" has none.
+        StreamMode mode=VIDEO;
+        double scale=1.0;       // output size relative to the input frame.
+        int fps_divisor=1;      // keep every n-th frame.
+        int fourcc=cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+        int quality=95;         // encoder quality, 0-100.
+        int replaced_quality=0; // TILES : quality of the mjpg stream they replace, for the ratio.
+    };
+
+    video_recorder();
+    ~video_recorder();
+
+    static QList<stream_config> defaultStreams();
+    static stream_config tileStream(int replaced_quality);
+    void setStreams(QList<stream_config> configs);
+    void setSegmentSeconds(double seconds);
+
+    bool open(QString base_name, cv::Size frame_size, double fps);
+    void write(cv::Mat &frame, const cv::Mat &fg_mask=cv::Mat(), const cv::Mat &background=cv::Mat(),
+               cv::Rect caption=cv::Rect());
+    void release();
+    bool isOpened();
+
+    QStringList outputPaths();
+    QString statsReport();
+
+private:
+    struct stream_state{
+        stream_config config;
+        cv::Size size;
+        cv::VideoWriter *writer=nullptr;
+        tile_recorder *tiles=nullptr;
+        QString path;               // of the open, in progress segment
+        qint64 frames_written=0;
+        qint64 bytes_written=0;
+        qint64 bytes_closed=0;      // of the finished segments
+        double compression=0;       // TILES, see tile_recorder::compressionRatio
+    };
+
+    bool openSegment(stream_state &stream);
+    void closeSegment(stream_state &stream);
+    void nextSegment();
+    cv::Mat &scaledFrame(cv::Mat &frame, cv::Size size);
+    void updateBytesWritten();
+
+    QList<stream_config> configs;
+    QList<stream_state> streams;
+    QString base_name;
+    double input_fps=30;
+    double segment_seconds=60;
+    int segment_index=0;
+    qint64 segment_start_ms=0;
+    qint64 frame_index=0;
+    QElapsedTimer record_timer;
+    double recorded_seconds=0.0;
+    QString last_report;
+
+    // per write cache of resized frames, one entry per distinct size.
+    std::vector<std::pair<cv::Size, cv::Mat>> scaled_cache;
+    size_t scaled_count=0;
+
+    // guards the statistics which are read from the gui thread.
+    QMutex stats_lock;
+};
+
+#endif // VIDEO_RECORDER_H
@@ -0,0 +1,188 @@
+#include "zone_map.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <opencv2/imgproc.hpp>
+
+zone_map::zone_map()
+{
+
+}
+
+void zone_map::setZones(const QList<zone_config> &new_zones)
+{
+    QMutexLocker locker(&stats_lock);
+    zones = new_zones;
+    schedules.clear();
+    foreach(zone_config zone, zones)
+    {
+        QList<zone_config::arm_window> windows;
+        QString error;
+        zone_config::parseSchedule(zone.schedule, windows, error);
+        schedules.append(windows);
+    }
+    armed.assign(zones.size(), true);
+    armed_minute = -1;
+    dirty = true;
+    zone_blobs.assign(zones.size(), 0);
+}
+
+bool zone_map::isEmpty(){return zones.isEmpty();}
+
+QString zone_map::zoneName(int zone){return zones.value(zone).name;}
+
+void zone_map::threshold(const cv::Mat &raw_mask, cv::Mat &mask, int default_threshold)
+{
+    if (zones.isEmpty())
+    {
+        cv::threshold(raw_mask, mask, default_threshold, 255, cv::THRESH_BINARY);
+        return;
+    }
+
+    if (dirty || labels.size() != raw_mask.size())
+        rebuild(raw_mask.size());
+
+    // a zone armed or disarmed only changes the lookup table.
+    if (updateArming(QDateTime::currentDateTime()) || thresholds.empty())
+    {
+        lut = cv::Mat(1, 256, CV_8U, cv::Scalar(255));
+        for (int i=0; i<zones.size(); i++)
+            lut.at<uchar>(i + 1) = armed[i] ? zones[i].fg_threshold : 255;
+        cv::LUT(labels, lut, thresholds);
+    }
+
+    // same as THRESH_BINARY, with the threshold of the pixel's zone.
+    cv::compare(raw_mask, thresholds, mask, cv::CMP_GT);
+}
+
+int zone_map::zoneOf(const cv::Mat &mask, const cv::Rect &blob)
+{
+    if (zones.isEmpty() || labels.size() != mask.size())
+        return -1;
+
+    // only the foreground under the box, not every zone polygon.
+    cv::Rect box = blob & cv::Rect(0, 0, mask.cols, mask.rows);
+    int counts[256] = {0};
+    for (int y=box.y; y<box.y + box.height; y++)
+    {
+        const uchar *m = mask.ptr<uchar>(y);
+        const uchar *l = labels.ptr<uchar>(y);
+        for (int x=box.x; x<box.x + box.width; x++)
+        {
+            if (m[x])
+                counts[l[x]]++;
+        }
+    }
+
+    int best = 0, best_count = 0;
+    for (int label=1; label<=zones.size(); label++)
+    {
+        if (counts[label] > best_count)
+        {
+            best = label;
+            best_count = counts[label];
+        }
+    }
+
+    QMutexLocker locker(&stats_lock);
+    if (best == 0)
+    {
+        rejected_outside++;
+        return -1;
+    }
+    if (best_count < zones[best - 1].min_area)
+    {
+        rejected_small++;
+        return -1;
+    }
+    zone_blobs[best - 1]++;
+    return best - 1;
+}
+
+void zone_map::rebuild(cv::Size size)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    labels = cv::Mat::zeros(size, CV_8U);
+    for (int i=0; i<zones.size(); i++)
+    {
+        QList<QPolygon> polygons;
+        QString error;
+        camera_config::parsePolygons(zones[i].polygon, polygons, error);
+        foreach(QPolygon polygon, polygons)
+        {
+            std::vector<cv::Point> points;
+            foreach(QPoint point, polygon)
+                points.push_back(cv::Point(point.x(), point.y()));
+            cv::fillPoly(labels, std::vector<std::vector<cv::Point>>{points}, cv::Scalar(i + 1));
+        }
+    }
+    thresholds.release();
+    dirty = false;
+
+    QMutexLocker locker(&stats_lock);
+    rebuilds++;
+    rebuild_ms_last = timer.nsecsElapsed() / 1e6;
+}
+
+bool zone_map::updateArming(const QDateTime &now)
+{
+    qint64 minute = now.toMSecsSinceEpoch() / 60000;
+    if (minute == armed_minute)
+        return false;
+    armed_minute = minute;
+
+    QMutexLocker locker(&stats_lock);
+    bool changed = false;
+    for (int i=0; i<zones.size(); i++)
+    {
+        bool now_armed = isArmed(schedules[i], now);
+        changed = changed || now_armed != armed[i];
+        armed[i] = now_armed;
+    }
+    return changed;
+}
+
+bool zone_map::isArmed(const QList<zone_config::arm_window> &windows, const QDateTime &now)
+{
+    if (windows.isEmpty())
+        return true;
+
+    int today = 1 << (now.date().dayOfWeek() - 1);
+    int yesterday = 1 << ((now.date().dayOfWeek() + 5) % 7);
+    int minute = now.time().hour() * 60 + now.time().minute();
+    foreach(zone_config::arm_window window, windows)
+    {
+        // a range past midnight belongs to the day it starts on.
+        if (window.start_min == window.end_min)
+        {
+            if (window.days & today)
+                return true;
+        }
+        else if (window.start_min < window.end_min)
+        {
+            if ((window.days & today) && minute >= window.start_min && minute < window.end_min)
+                return true;
+        }
+        else if (((window.days & today) && minute >= window.start_min)
+                 || ((window.days & yesterday) && minute < window.end_min))
+            return true;
+    }
+    return false;
+}
+
+QString zone_map::statsReport()
+{
+    QMutexLocker locker(&stats_lock);
+    if (zones.isEmpty())
+        return QString("zones : none, the whole frame counts\n");
+
+    QString report = QString("zones : %1, label map built %2 times (last %3 ms), blobs dropped %4 outside, %5 too small\n")
+            .arg(zones.size()).arg(rebuilds).arg(rebuild_ms_last, 0, 'f', 1)
+            .arg(rejected_outside).arg(rejected_small);
+    for (int i=0; i<zones.size(); i++)
+        report += QString("  %1 : %2, threshold %3, %4 blobs\n")
+                .arg(zones[i].name).arg(armed[i] ? "armed" : "disarmed")
+                .arg(zones[i].fg_threshold).arg(zone_blobs[i]);
+    return report;
+}
@@ -0,0 +1,68 @@
+#ifndef ZONE_MAP_H
+#define ZONE_MAP_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMutex>
+#include <QDateTime>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "pipeline_config.h"
+
+/*
+ * the zones of a camera rasterized into a label map, one byte per pixel :
+ * 0 outside every zone, i + 1 inside zone i. where zones overlap the later
+ * one wins.
+ *
+ * threshold() replaces the single cv::threshold of the foreground mask by
+ * a compare against a per pixel threshold image, looked up from the label
+ * map with the fg_threshold of each zone. pixels outside the armed zones
+ * get 255 and never count. the image is only rebuilt when the zones, the
+ * frame size or the armed set change (checked once a minute).
+ *
+ * zoneOf() counts the labels under the foreground pixels of a blob's box,
+ * so a blob costs its own pixels whatever the number of zones.
+ */
+class zone_map
+{
+public:
+    zone_map();
+
+    void setZones(const QList<zone_config> &zones);
+    bool isEmpty();
+
+    // the foreground of raw_mask, 255 where it beats its zone threshold.
+    void threshold(const cv::Mat &raw_mask, cv::Mat &mask, int default_threshold);
+
+    // the zone most of the blob lies in, -1 outside the armed zones or too small.
+    int zoneOf(const cv::Mat &mask, const cv::Rect &blob);
+    QString zoneName(int zone);
+
+    QString statsReport();
+
+private:
+    void rebuild(cv::Size size);
+    bool updateArming(const QDateTime &now);
+    static bool isArmed(const QList<zone_config::arm_window> &windows, const QDateTime &now);
+
+    QList<zone_config> zones;
+    QList<QList<zone_config::arm_window>> schedules;
+    std::vector<bool> armed;
+    qint64 armed_minute=-1;
+
+    cv::Mat labels;                 // CV_8U, 0 or zone + 1
+    cv::Mat thresholds;             // CV_8U, per pixel
+    cv::Mat lut;                    // label -> threshold
+    bool dirty=true;
+
+    // metrics, read from the gui thread
+    QMutex stats_lock;
+    std::vector<qint64> zone_blobs;
+    qint64 rejected_small=0;
+    qint64 rejected_outside=0;
+    qint64 rebuilds=0;
+    double rebuild_ms_last=0;
+};
+
+#endif // ZONE_MAP_H